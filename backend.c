@@ -0,0 +1,372 @@
+#define _GNU_SOURCE
+#include "backend.h"
+#include "llm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <jansson.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Consecutive failures that eject a backend */
+#define BACKEND_EJECT_AFTER 3
+/* First ejection; doubles while probes keep failing */
+#define BACKEND_EJECT_MS 5000.0
+#define BACKEND_EJECT_MAX_MS 60000.0
+/* Latency histogram: bucket i holds latencies below 2^(i+1) ms */
+#define BACKEND_LATENCY_BUCKETS 24
+/* Recent successful latencies kept for percentiles, and how many it
+   takes before they are trusted */
+#define BACKEND_RECENT 256
+#define BACKEND_RECENT_MIN 20
+
+static const char *BACKEND_DEFAULT_URL = "http://localhost:9090/v1/chat/completions";
+
+struct backend {
+    char *url;
+    char *model;
+    char *model_json;           /* quoted for the request body */
+    int weight;
+    int max_active;             /* 0 = no limit */
+
+    /* guarded by backend_mutex */
+    int outstanding;
+    int failures;               /* in a row */
+    double eject_ms;            /* next ejection length */
+    double ejected_until;       /* monotonic ms, 0 = healthy */
+    bool probing;               /* ejection over: one request decides */
+
+    unsigned long requests;
+    unsigned long failed;
+    double latency_sum_ms;
+    double latency_max_ms;
+    unsigned long latency_hist[BACKEND_LATENCY_BUCKETS];
+    double first_start_ms;
+    double last_end_ms;
+};
+
+static pthread_mutex_t backend_mutex = PTHREAD_MUTEX_INITIALIZER;
+static backend *backends = NULL;
+static int backends_count = 0;
+static int backends_cap = 0;
+static double recent_ms[BACKEND_RECENT];
+static unsigned long recent_count = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Caller holds backend_mutex */
+static backend *append_backend(const char *url, const char *model, int weight, int max_active)
+{
+    if (backends_count == backends_cap)
+    {
+        int new_cap = backends_cap ? backends_cap * 2 : 4;
+        backend *grown = realloc(backends, new_cap * sizeof(backend));
+        if (!grown) return NULL;
+        backends = grown;
+        backends_cap = new_cap;
+    }
+    backend *b = &backends[backends_count];
+    memset(b, 0, sizeof(*b));
+    b->url = strdup(url);
+    b->model = strdup(model);
+    json_t *name = json_string(model);
+    b->model_json = name ? json_dumps(name, JSON_ENCODE_ANY) : NULL;
+    json_decref(name);
+    if (!b->url || !b->model || !b->model_json) {
+        free(b->url);
+        free(b->model);
+        free(b->model_json);
+        return NULL;
+    }
+    b->weight = weight > 0 ? weight : 1;
+    b->max_active = max_active > 0 ? max_active : 0;
+    b->eject_ms = BACKEND_EJECT_MS;
+    backends_count++;
+    return b;
+}
+
+bool backend_add(const char *spec)
+{
+    char *copy = strdup(spec);
+    if (!copy) return false;
+
+    char *save = NULL;
+    char *url = strtok_r(copy, ",", &save);
+    const char *model = LLM_MODEL;
+    int weight = 1, max_active = 0;
+    bool ok = url && *url;
+    for (char *field; ok && (field = strtok_r(NULL, ",", &save)); )
+    {
+        while (isspace((unsigned char)*field)) field++;
+        if (strncmp(field, "model=", 6) == 0) model = field + 6;
+        else if (strncmp(field, "weight=", 7) == 0) weight = atoi(field + 7);
+        else if (strncmp(field, "max=", 4) == 0) max_active = atoi(field + 4);
+        else ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Bad backend \"%s\": expected URL[,model=NAME][,weight=W][,max=N]\n", spec);
+        free(copy);
+        return false;
+    }
+
+    pthread_mutex_lock(&backend_mutex);
+    ok = append_backend(url, model, weight, max_active) != NULL;
+    pthread_mutex_unlock(&backend_mutex);
+    free(copy);
+    return ok;
+}
+
+bool backend_add_file(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Cannot read backend list %s\n", path);
+        return false;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    bool ok = true;
+    while (ok && getline(&line, &cap, fp) != -1)
+    {
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        char *end = p + strlen(p);
+        while (end > p && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (*p == '\0' || *p == '#') continue;
+        ok = backend_add(p);
+    }
+    free(line);
+    fclose(fp);
+    return ok;
+}
+
+int backend_count(void)
+{
+    pthread_mutex_lock(&backend_mutex);
+    int n = backends_count;
+    pthread_mutex_unlock(&backend_mutex);
+    return n;
+}
+
+int backend_total_capacity(void)
+{
+    pthread_mutex_lock(&backend_mutex);
+    int total = 0;
+    for (int i = 0; i < backends_count; ++i)
+    {
+        if (backends[i].max_active == 0) {
+            total = 0;
+            break;
+        }
+        total += backends[i].max_active;
+    }
+    pthread_mutex_unlock(&backend_mutex);
+    return total;
+}
+
+/* Load after taking one more request, relative to the weight */
+static double load_with_one_more(const backend *b)
+{
+    return (b->outstanding + 1) / (double)b->weight;
+}
+
+/* Caller holds backend_mutex: whether b can take another request now */
+static bool available(backend *b, double now)
+{
+    if (b->ejected_until > now) return false;
+    if (b->ejected_until != 0) {
+        b->ejected_until = 0;
+        b->probing = true;
+    }
+    if (b->probing && b->outstanding > 0) return false;
+    return !b->max_active || b->outstanding < b->max_active;
+}
+
+/* Caller holds backend_mutex: sets up the built-in endpoint if nothing
+   was configured; false if that failed */
+static bool default_backend(void)
+{
+    return backends_count > 0 || append_backend(BACKEND_DEFAULT_URL, LLM_MODEL, 1, 0);
+}
+
+backend *backend_acquire(const backend *avoid)
+{
+    double now = now_ms();
+    pthread_mutex_lock(&backend_mutex);
+    if (!default_backend()) {
+        pthread_mutex_unlock(&backend_mutex);
+        return NULL;
+    }
+
+    /* Healthy and below its limit; a backend being probed takes one request */
+    backend *best = NULL;
+    for (int i = 0; i < backends_count; ++i)
+    {
+        backend *b = &backends[i];
+        if (b == avoid || !available(b, now)) continue;
+        if (!best || load_with_one_more(b) < load_with_one_more(best)) best = b;
+    }
+    if (!best && avoid && available((backend *)avoid, now)) best = (backend *)avoid;
+    /* Everything full: overcommit the least loaded healthy one */
+    for (int i = 0; !best && i < backends_count; ++i)
+    {
+        backend *b = &backends[i];
+        if (b->ejected_until > now || b->probing) continue;
+        if (!best || load_with_one_more(b) < load_with_one_more(best)) best = b;
+    }
+    /* Everything ejected: the one that comes back first */
+    for (int i = 0; !best && i < backends_count; ++i)
+    {
+        backend *b = &backends[i];
+        if (!best || b->ejected_until < best->ejected_until) best = b;
+    }
+
+    best->outstanding++;
+    if (best->first_start_ms == 0) best->first_start_ms = now;
+    pthread_mutex_unlock(&backend_mutex);
+    return best;
+}
+
+void backend_release(backend *b, bool ok, double latency_ms)
+{
+    if (!b) return;
+    pthread_mutex_lock(&backend_mutex);
+    b->outstanding--;
+    b->requests++;
+    b->last_end_ms = now_ms();
+    b->latency_sum_ms += latency_ms;
+    if (latency_ms > b->latency_max_ms) b->latency_max_ms = latency_ms;
+    int bucket = 0;
+    while (bucket + 1 < BACKEND_LATENCY_BUCKETS && latency_ms >= (double)(2L << bucket)) bucket++;
+    b->latency_hist[bucket]++;
+
+    if (ok)
+    {
+        recent_ms[recent_count++ % BACKEND_RECENT] = latency_ms;
+        b->failures = 0;
+        b->probing = false;
+        b->eject_ms = BACKEND_EJECT_MS;
+    }
+    else
+    {
+        b->failed++;
+        b->failures++;
+        /* A failed probe goes straight back out, for longer */
+        if (b->probing || b->failures >= BACKEND_EJECT_AFTER)
+        {
+            if (b->probing) {
+                b->eject_ms *= 2;
+                if (b->eject_ms > BACKEND_EJECT_MAX_MS) b->eject_ms = BACKEND_EJECT_MAX_MS;
+            }
+            b->probing = false;
+            b->ejected_until = b->last_end_ms + b->eject_ms;
+            if (backends_count > 1)
+                fprintf(stderr, "Backend %s ejected for %.0f s after %d failures\n",
+                        b->url, b->eject_ms / 1000.0, b->failures);
+        }
+    }
+    pthread_mutex_unlock(&backend_mutex);
+}
+
+void backend_cancel(backend *b)
+{
+    if (!b) return;
+    pthread_mutex_lock(&backend_mutex);
+    b->outstanding--;
+    pthread_mutex_unlock(&backend_mutex);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double backend_recent_latency(double p)
+{
+    double sorted[BACKEND_RECENT];
+    pthread_mutex_lock(&backend_mutex);
+    int n = recent_count < BACKEND_RECENT ? (int)recent_count : BACKEND_RECENT;
+    memcpy(sorted, recent_ms, n * sizeof(double));
+    pthread_mutex_unlock(&backend_mutex);
+    if (n < BACKEND_RECENT_MIN) return -1;
+
+    qsort(sorted, n, sizeof(double), compare_double);
+    int i = (int)(p * n);
+    return sorted[i < n ? i : n - 1];
+}
+
+const char *backend_url(const backend *b)
+{
+    return b->url;
+}
+
+const char *backend_model(const backend *b)
+{
+    return b->model;
+}
+
+const char *backend_model_json(const backend *b)
+{
+    return b->model_json;
+}
+
+const backend *backend_primary(void)
+{
+    pthread_mutex_lock(&backend_mutex);
+    const backend *b = default_backend() ? &backends[0] : NULL;
+    pthread_mutex_unlock(&backend_mutex);
+    return b;
+}
+
+int backend_models(const char **models, int max)
+{
+    int n = 0;
+    pthread_mutex_lock(&backend_mutex);
+    for (int i = 0; i < backends_count && n < max; ++i)
+    {
+        bool seen = false;
+        for (int j = 0; j < n && !seen; ++j) seen = strcmp(models[j], backends[i].model) == 0;
+        if (!seen) models[n++] = backends[i].model;
+    }
+    pthread_mutex_unlock(&backend_mutex);
+    if (n == 0 && max > 0) models[n++] = LLM_MODEL;
+    return n;
+}
+
+/* Upper edge of the histogram bucket holding the p-th fraction */
+static double latency_percentile(const backend *b, double p)
+{
+    unsigned long target = (unsigned long)(b->requests * p);
+    unsigned long seen = 0;
+    for (int i = 0; i < BACKEND_LATENCY_BUCKETS; ++i)
+    {
+        seen += b->latency_hist[i];
+        if (seen > target) return (double)(2L << i);
+    }
+    return b->latency_max_ms;
+}
+
+void backend_report(FILE *fp)
+{
+    double now = now_ms();
+    pthread_mutex_lock(&backend_mutex);
+    for (int i = 0; i < backends_count; ++i)
+    {
+        const backend *b = &backends[i];
+        double span_s = (b->last_end_ms - b->first_start_ms) / 1000.0;
+        fprintf(fp, "Backend %s (%s, weight %d, max %d): %lu requests, %lu failed, "
+                "%.2f req/s, latency mean %.0f ms, p95 < %.0f ms, max %.0f ms%s\n",
+                b->url, b->model, b->weight, b->max_active, b->requests, b->failed,
+                span_s > 0 ? b->requests / span_s : 0.0,
+                b->requests ? b->latency_sum_ms / b->requests : 0.0,
+                b->requests ? latency_percentile(b, 0.95) : 0.0, b->latency_max_ms,
+                b->ejected_until > now ? " [ejected]" : "");
+    }
+    pthread_mutex_unlock(&backend_mutex);
+}
@@ -0,0 +1,55 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* -------------------------------------------------
+   Chat completion backends
+   Any number of OpenAI-compatible endpoints, each with its own model
+   name, weight and concurrency limit. A request is bound to a backend
+   when the network engine starts it: the healthy one with the fewest
+   requests in flight relative to its weight. A backend that keeps
+   failing is ejected for a while, then probed with a single request.
+   ------------------------------------------------- */
+
+typedef struct backend backend;
+
+/* "URL[,model=NAME][,weight=W][,max=N]"; max 0 = no limit. Backends
+   are added before the first request and never removed. */
+bool backend_add(const char *spec);
+/* One spec per line; blank lines and # comments are skipped */
+bool backend_add_file(const char *path);
+int backend_count(void);
+/* Sum of the concurrency limits, 0 if any backend has none */
+int backend_total_capacity(void);
+
+/* Picks the backend for a request about to start and counts it as
+   outstanding. Without configured backends the built-in default
+   endpoint is used. Never NULL once the default could be set up.
+   `avoid` (may be NULL) is only taken when nothing else could be. */
+backend *backend_acquire(const backend *avoid);
+/* The request finished: `ok` false for transport errors, 429 and 5xx */
+void backend_release(backend *b, bool ok, double latency_ms);
+/* The request was aborted before it finished: not counted either way */
+void backend_cancel(backend *b);
+
+/* p-th fraction (0..1) of the latency of recent successful requests,
+   across all backends; -1 until there are enough samples to tell */
+double backend_recent_latency(double p);
+
+const char *backend_url(const backend *b);
+const char *backend_model(const backend *b);
+/* The model name as a JSON string literal, quotes included */
+const char *backend_model_json(const backend *b);
+/* The first backend (the built-in default if none was added), whose
+   model a request names until it is bound; NULL if out of memory */
+const backend *backend_primary(void);
+/* The distinct model names, the first backend's first; answers are
+   cached under the model that gave them */
+int backend_models(const char **models, int max);
+
+/* One line per backend: requests, failures, throughput, latency */
+void backend_report(FILE *fp);
+
+#endif
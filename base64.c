@@ -0,0 +1,220 @@
+#include "base64.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BASE64_NEON 1
+#endif
+
+static const char b64_encoding_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* -------------------------------------------------
+   Scalar reference
+   ------------------------------------------------- */
+
+size_t base64_encode_block_scalar(const unsigned char *data, size_t len, char *out)
+{
+    size_t i = 0, j = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t triple = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+        out[j++] = b64_encoding_table[(triple >> 18) & 0x3F];
+        out[j++] = b64_encoding_table[(triple >> 12) & 0x3F];
+        out[j++] = b64_encoding_table[(triple >> 6) & 0x3F];
+        out[j++] = b64_encoding_table[triple & 0x3F];
+    }
+    if (i < len) {
+        uint32_t octet_b = i + 1 < len ? data[i + 1] : 0;
+        uint32_t triple = ((uint32_t)data[i] << 16) | (octet_b << 8);
+        out[j++] = b64_encoding_table[(triple >> 18) & 0x3F];
+        out[j++] = b64_encoding_table[(triple >> 12) & 0x3F];
+        out[j++] = i + 1 < len ? b64_encoding_table[(triple >> 6) & 0x3F] : '=';
+        out[j++] = '=';
+    }
+    return j;
+}
+
+#ifdef BASE64_X86
+/* -------------------------------------------------
+   SSSE3 / AVX2: split 3 bytes into four 6-bit fields with one shuffle
+   and two multiplies, then map fields to ASCII with a 16-entry
+   offset table (W. Muła / A. Klomp's scheme).
+   ------------------------------------------------- */
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle_ssse3(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate_ssse3(__m128i in)
+{
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                      -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    const __m128i mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+    indices = _mm_sub_epi8(indices, mask);
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+
+__attribute__((target("ssse3")))
+static size_t base64_encode_block_ssse3(const unsigned char *data, size_t len, char *out)
+{
+    size_t i = 0, j = 0;
+    /* Loads 16 bytes, consumes 12 */
+    for (; i + 16 <= len; i += 12, j += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(data + i));
+        _mm_storeu_si128((__m128i *)(out + j), enc_translate_ssse3(enc_reshuffle_ssse3(in)));
+    }
+    return j + base64_encode_block_scalar(data + i, len - i, out + j);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i enc_reshuffle_avx2(__m256i in)
+{
+    /* Input is loaded 4 bytes early so each 128-bit lane holds its own
+       12 source bytes at offsets 4..15 (low lane) and 0..11 (high lane) */
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+        14, 15, 13, 14, 11, 12, 10, 11, 8, 9, 7, 8, 5, 6, 4, 5));
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t1, t3);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i enc_translate_avx2(__m256i in)
+{
+    const __m256i lut = _mm256_setr_epi8(
+        65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+        65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+    const __m256i mask = _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25));
+    indices = _mm256_sub_epi8(indices, mask);
+    return _mm256_add_epi8(in, _mm256_shuffle_epi8(lut, indices));
+}
+
+__attribute__((target("avx2")))
+static size_t base64_encode_block_avx2(const unsigned char *data, size_t len, char *out)
+{
+    size_t i = 0, j = 0;
+    if (len >= 32) {
+        /* First block cannot read before `data`: load at 0 and shift up */
+        __m256i in = _mm256_loadu_si256((const __m256i *)data);
+        in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+        _mm256_storeu_si256((__m256i *)out, enc_translate_avx2(enc_reshuffle_avx2(in)));
+        i = 24;
+        j = 32;
+        /* Loads 32 bytes starting 4 before i, consumes 24 */
+        for (; i + 28 <= len; i += 24, j += 32) {
+            in = _mm256_loadu_si256((const __m256i *)(data + i - 4));
+            _mm256_storeu_si256((__m256i *)(out + j), enc_translate_avx2(enc_reshuffle_avx2(in)));
+        }
+    }
+    return j + base64_encode_block_ssse3(data + i, len - i, out + j);
+}
+#endif /* BASE64_X86 */
+
+#ifdef BASE64_NEON
+/* -------------------------------------------------
+   NEON: de-interleave 48 bytes, split into four index vectors and
+   look all 64 indices up in the alphabet with one table instruction.
+   ------------------------------------------------- */
+
+static size_t base64_encode_block_neon(const unsigned char *data, size_t len, char *out)
+{
+    const uint8x16x4_t tbl = vld1q_u8_x4((const uint8_t *)b64_encoding_table);
+    const uint8x16_t mask = vdupq_n_u8(0x3F);
+    size_t i = 0, j = 0;
+    for (; i + 48 <= len; i += 48, j += 64) {
+        uint8x16x3_t in = vld3q_u8(data + i);
+        uint8x16x4_t idx, res;
+        idx.val[0] = vshrq_n_u8(in.val[0], 2);
+        idx.val[1] = vandq_u8(vorrq_u8(vshrq_n_u8(in.val[1], 4), vshlq_n_u8(in.val[0], 4)), mask);
+        idx.val[2] = vandq_u8(vorrq_u8(vshrq_n_u8(in.val[2], 6), vshlq_n_u8(in.val[1], 2)), mask);
+        idx.val[3] = vandq_u8(in.val[2], mask);
+        res.val[0] = vqtbl4q_u8(tbl, idx.val[0]);
+        res.val[1] = vqtbl4q_u8(tbl, idx.val[1]);
+        res.val[2] = vqtbl4q_u8(tbl, idx.val[2]);
+        res.val[3] = vqtbl4q_u8(tbl, idx.val[3]);
+        vst4q_u8((uint8_t *)out + j, res);
+    }
+    return j + base64_encode_block_scalar(data + i, len - i, out + j);
+}
+#endif /* BASE64_NEON */
+
+/* -------------------------------------------------
+   Runtime dispatch
+   ------------------------------------------------- */
+
+static base64_impl impls[4];
+static int impl_count = 0;
+static const base64_impl *best_impl = NULL;
+
+static void detect_impls(void)
+{
+    int n = 0;
+    impls[n++] = (base64_impl){ "scalar", base64_encode_block_scalar };
+#ifdef BASE64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+        impls[n++] = (base64_impl){ "ssse3", base64_encode_block_ssse3 };
+    if (__builtin_cpu_supports("avx2"))
+        impls[n++] = (base64_impl){ "avx2", base64_encode_block_avx2 };
+#endif
+#ifdef BASE64_NEON
+    impls[n++] = (base64_impl){ "neon", base64_encode_block_neon };
+#endif
+    /* Detection is idempotent, so racing first calls are harmless */
+    __atomic_store_n(&impl_count, n, __ATOMIC_RELEASE);
+    __atomic_store_n(&best_impl, &impls[n - 1], __ATOMIC_RELEASE);
+}
+
+static const base64_impl *get_best_impl(void)
+{
+    const base64_impl *impl = __atomic_load_n(&best_impl, __ATOMIC_ACQUIRE);
+    if (!impl) {
+        detect_impls();
+        impl = best_impl;
+    }
+    return impl;
+}
+
+size_t base64_encode_block(const unsigned char *data, size_t len, char *out)
+{
+    return get_best_impl()->encode(data, len, out);
+}
+
+const char *base64_impl_name(void)
+{
+    return get_best_impl()->name;
+}
+
+int base64_implementations(const base64_impl **list)
+{
+    get_best_impl();
+    *list = impls;
+    return __atomic_load_n(&impl_count, __ATOMIC_ACQUIRE);
+}
+
+char *base64_encode(const unsigned char *data, size_t input_length)
+{
+    size_t output_length = 4 * ((input_length + 2) / 3);
+    char *encoded_data = malloc(output_length + 1);
+    if (encoded_data == NULL) return NULL;
+
+    base64_encode_block(data, input_length, encoded_data);
+    encoded_data[output_length] = '\0';
+    return encoded_data;
+}
@@ -0,0 +1,34 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stddef.h>
+
+/* -------------------------------------------------
+   Base64 encoder (standard alphabet, '=' padding, no line breaks)
+   ------------------------------------------------- */
+
+typedef size_t (*base64_block_fn)(const unsigned char *data, size_t len, char *out);
+
+typedef struct {
+    const char *name;
+    base64_block_fn encode;
+} base64_impl;
+
+/* Encodes `len` bytes into `out` (4 * ceil(len / 3) chars, no NUL);
+   a trailing partial group is padded with '='. Returns chars written.
+   Uses the fastest implementation the CPU supports. */
+size_t base64_encode_block(const unsigned char *data, size_t len, char *out);
+
+/* Reference byte-at-a-time implementation */
+size_t base64_encode_block_scalar(const unsigned char *data, size_t len, char *out);
+
+/* Returns a newly allocated NUL-terminated string, or NULL */
+char *base64_encode(const unsigned char *data, size_t input_length);
+
+/* Name of the implementation base64_encode_block dispatches to */
+const char *base64_impl_name(void);
+
+/* Implementations usable on this CPU, scalar first; returns the count */
+int base64_implementations(const base64_impl **list);
+
+#endif
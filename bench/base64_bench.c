@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+#include "../base64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* -------------------------------------------------
+   Base64 microbenchmark: checks every implementation against the
+   scalar reference, then reports encode throughput in GB/s.
+   ------------------------------------------------- */
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Every length 0..1024 and every alignment, plus a few large sizes */
+static int verify(const base64_impl *impl, const unsigned char *data, size_t max_len)
+{
+    char *expect = malloc(4 * (max_len / 3 + 1));
+    char *got = malloc(4 * (max_len / 3 + 1));
+    int failures = 0;
+    size_t sizes[] = { 4096, 65536, 65537, 65538, max_len };
+
+    for (size_t len = 0; len <= 1024 + 16 && !failures; ++len)
+    {
+        size_t offset = len % 16;
+        size_t n1 = base64_encode_block_scalar(data + offset, len, expect);
+        size_t n2 = impl->encode(data + offset, len, got);
+        if (n1 != n2 || memcmp(expect, got, n1) != 0) {
+            fprintf(stderr, "%s: mismatch at length %zu\n", impl->name, len);
+            failures++;
+        }
+    }
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]) && !failures; ++k)
+    {
+        size_t n1 = base64_encode_block_scalar(data, sizes[k], expect);
+        size_t n2 = impl->encode(data, sizes[k], got);
+        if (n1 != n2 || memcmp(expect, got, n1) != 0) {
+            fprintf(stderr, "%s: mismatch at length %zu\n", impl->name, sizes[k]);
+            failures++;
+        }
+    }
+    free(expect);
+    free(got);
+    return failures;
+}
+
+static double measure(const base64_impl *impl, const unsigned char *data, size_t len, char *out)
+{
+    /* Repeat until at least 0.25 s has passed, keep the best pass */
+    double best = 1e30;
+    double start = now_seconds();
+    do {
+        double t0 = now_seconds();
+        impl->encode(data, len, out);
+        double dt = now_seconds() - t0;
+        if (dt < best) best = dt;
+    } while (now_seconds() - start < 0.25);
+    return len / best / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    size_t len = argc > 1 ? strtoull(argv[1], NULL, 10) : 16u << 20;
+    if (len < 1024 + 32) len = 1024 + 32;
+
+    unsigned char *data = malloc(len);
+    char *out = malloc(4 * (len / 3 + 1));
+    if (!data || !out) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    srand(12345);
+    for (size_t i = 0; i < len; ++i) data[i] = (unsigned char)rand();
+
+    const base64_impl *impls;
+    int count = base64_implementations(&impls);
+    int failures = 0;
+
+    printf("base64 encode, %zu byte input, dispatch picks %s\n", len, base64_impl_name());
+    for (int i = 0; i < count; ++i)
+    {
+        int bad = verify(&impls[i], data, len);
+        failures += bad;
+        if (bad) {
+            printf("  %-8s FAILED byte-identity check\n", impls[i].name);
+            continue;
+        }
+        printf("  %-8s %6.2f GB/s\n", impls[i].name, measure(&impls[i], data, len, out));
+    }
+
+    free(data);
+    free(out);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+#define _GNU_SOURCE
+#include "../base64.h"
+#include "../embed.h"
+#include "../files.h"
+#include "../hash.h"
+#include "../image_prep.h"
+#include "../llm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* -------------------------------------------------
+   CPU-side microbenchmarks on synthetic data: base64 and hashing of
+   upload-sized blobs, extension filtering, panel-order sorting, the
+   directory walk over a generated tree, JPEG decoding, response JSON
+   parsing and the embedding dot product. Corrupt EXIF blocks are
+   decoded first as a check; a failure exits non-zero. Each kernel prints one JSON object on stdout
+   (throughput and per-repetition latency percentiles) so runs from
+   different commits can be compared; a readable table goes to stderr.
+   ------------------------------------------------- */
+
+static double min_seconds = 0.5;
+static const char *tag = "";
+static const char *only = NULL;
+static volatile uint64_t sink;      /* keeps results from being optimised away */
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Runs fn(arg) until min_seconds have passed (at least 5 times, at
+   most 100000) and reports `work` units per repetition */
+static void run_kernel(const char *name, double work, const char *unit,
+                       void (*fn)(void *), void *arg)
+{
+    if (only && strncmp(name, only, strlen(only)) != 0) return;
+
+    int cap = 1024, n = 0;
+    double *ns = malloc(cap * sizeof(double));
+    if (!ns) return;
+    fn(arg);    /* warm caches and lazy dispatch */
+    double start = now_seconds();
+    while (n < 100000 && (n < 5 || now_seconds() - start < min_seconds))
+    {
+        if (n == cap) {
+            double *grown = realloc(ns, 2 * cap * sizeof(double));
+            if (!grown) break;
+            ns = grown;
+            cap *= 2;
+        }
+        double t0 = now_seconds();
+        fn(arg);
+        ns[n++] = (now_seconds() - t0) * 1e9;
+    }
+    qsort(ns, n, sizeof(double), compare_double);
+    double p50 = ns[(int)(0.50 * (n - 1))];
+    double p95 = ns[(int)(0.95 * (n - 1))];
+    double p99 = ns[(int)(0.99 * (n - 1))];
+    double per_second = p50 > 0 ? work / (p50 / 1e9) : 0;
+
+    printf("{\"tag\": \"%s\", \"kernel\": \"%s\", \"work\": %.0f, \"unit\": \"%s\", "
+           "\"reps\": %d, \"per_second\": %.1f, \"min_ns\": %.0f, \"p50_ns\": %.0f, "
+           "\"p95_ns\": %.0f, \"p99_ns\": %.0f}\n",
+           tag, name, work, unit, n, per_second, ns[0], p50, p95, p99);
+    fflush(stdout);
+    if (strcmp(unit, "bytes") == 0)
+        fprintf(stderr, "%-28s %10.1f MB/s   p50 %10.3f ms  p99 %10.3f ms\n",
+                name, per_second / 1e6, p50 / 1e6, p99 / 1e6);
+    else
+        fprintf(stderr, "%-28s %10.3f M%s/s p50 %10.3f ms  p99 %10.3f ms\n",
+                name, per_second / 1e6, unit, p50 / 1e6, p99 / 1e6);
+    free(ns);
+}
+
+/* -------------------------------------------------
+   Kernels
+   ------------------------------------------------- */
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    char *out;
+    const base64_impl *impl;
+} blob_arg;
+
+static void k_base64(void *p)
+{
+    blob_arg *a = p;
+    sink += a->impl->encode(a->data, a->len, a->out);
+}
+
+static void k_hash64(void *p)
+{
+    blob_arg *a = p;
+    sink += hash64(a->data, a->len, 0);
+}
+
+typedef struct {
+    char **names;
+    char **scratch;
+    unsigned int n;
+} names_arg;
+
+static void k_extension(void *p)
+{
+    names_arg *a = p;
+    unsigned int hits = 0;
+    for (unsigned int i = 0; i < a->n; ++i)
+        hits += has_image_extension(a->names[i]);
+    sink += hits;
+}
+
+static void k_sort(void *p)
+{
+    names_arg *a = p;
+    memcpy(a->scratch, a->names, a->n * sizeof(char *));
+    qsort(a->scratch, a->n, sizeof(char *), cmp_strings);
+    sink += (uintptr_t)a->scratch[0];
+}
+
+/* The list's own sort: collation keys, sliced across cores */
+static void k_list_sort(void *p)
+{
+    names_arg *a = p;
+    memcpy(a->scratch, a->names, a->n * sizeof(char *));
+    file_list list = { .paths = a->scratch, .count = a->n, .capacity = a->n };
+    file_list_sort(&list);
+    sink += (uintptr_t)a->scratch[0];
+}
+
+typedef struct {
+    const char *root;
+    unsigned int found;
+} walk_arg;
+
+static void k_walk(void *p)
+{
+    walk_arg *a = p;
+    file_list list = load_files(a->root, true);
+    a->found = list.count;
+    file_list_free(&list);
+}
+
+typedef struct {
+    const char *json;
+    int questions;      /* > 0: also parse a multi-question answer */
+} json_arg;
+
+static void k_json(void *p)
+{
+    json_arg *a = p;
+    const char *content, *finish;
+    json_t *root = llm_parse_response(a->json, &content, &finish);
+    if (a->questions > 0) {
+        signed char verdicts[LLM_MAX_QUERIES];
+        sink += llm_parse_multi_answer(content, a->questions, verdicts);
+    }
+    sink += content ? (unsigned char)content[0] : 0;
+    json_decref(root);
+}
+
+typedef struct {
+    const float *query;
+    const float *vectors;
+    int dim;
+    int count;
+} dot_arg;
+
+static void k_dot(void *p)
+{
+    dot_arg *a = p;
+    float best = -2;
+    for (int i = 0; i < a->count; ++i)
+    {
+        float s = embed_dot(a->query, a->vectors + (size_t)i * a->dim, a->dim);
+        if (s > best) best = s;
+    }
+    sink += (uint64_t)(best * 1000);
+}
+
+typedef struct {
+    const unsigned char *jpeg;
+    size_t len;
+} decode_arg;
+
+static void k_decode(void *p)
+{
+    decode_arg *a = p;
+    rgb_image img = { 0 };
+    if (image_decode(a->jpeg, a->len, 0, &img)) sink += img.pixels[0];
+    rgb_image_free(&img);
+}
+
+/* -------------------------------------------------
+   Synthetic data
+   ------------------------------------------------- */
+
+static const char *EXTENSIONS[] = {
+    "jpg", "JPG", "jpeg", "png", "PNG", "gif", "webp", "bmp", "txt", "xmp", "mov", "json"
+};
+
+/* Camera-style names with numbers to collate: "shoot_17/IMG_04211.JPG" */
+static char **make_names(unsigned int n)
+{
+    char **names = malloc(n * sizeof(char *));
+    if (!names) return NULL;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        int ext = rand() % (int)(sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]));
+        if (asprintf(&names[i], "/photos/shoot_%d/%s_%05d.%s", rand() % 200,
+                     rand() % 3 ? "IMG" : "dsc", rand() % 100000, EXTENSIONS[ext]) == -1)
+            names[i] = strdup("");
+    }
+    return names;
+}
+
+/* `n` empty files, 100 per directory, two directory levels deep;
+   one in ten is not an image */
+static bool make_tree(const char *root, unsigned int n)
+{
+    char path[4096];
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        unsigned int dir = i / 100;
+        int len;
+        if (i % 100 == 0)
+        {
+            len = snprintf(path, sizeof(path), "%s/d%03u", root, dir / 100);
+            if (len < 0 || (size_t)len >= sizeof(path)) return false;
+            mkdir(path, 0755);
+            len = snprintf(path, sizeof(path), "%s/d%03u/e%03u", root, dir / 100, dir % 100);
+            if (len < 0 || (size_t)len >= sizeof(path) || mkdir(path, 0755) != 0) return false;
+        }
+        len = snprintf(path, sizeof(path), "%s/d%03u/e%03u/IMG_%07u.%s", root, dir / 100, dir % 100,
+                       i, i % 10 == 9 ? "txt" : "jpg");
+        if (len < 0 || (size_t)len >= sizeof(path)) return false;
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) return false;
+        close(fd);
+    }
+    return true;
+}
+
+/* `jpeg` with an APP1 segment holding "Exif\0\0" + `tiff` after the SOI */
+static unsigned char *with_exif(const unsigned char *jpeg, size_t len,
+                                const unsigned char *tiff, size_t tiff_len, size_t *out_len)
+{
+    size_t segment = 2 + 6 + tiff_len;
+    unsigned char *out = malloc(len + 2 + segment);
+    if (!out) return NULL;
+    memcpy(out, jpeg, 2);
+    out[2] = 0xFF;
+    out[3] = 0xE1;
+    out[4] = (unsigned char)(segment >> 8);
+    out[5] = (unsigned char)segment;
+    memcpy(out + 6, "Exif\0\0", 6);
+    memcpy(out + 12, tiff, tiff_len);
+    memcpy(out + 12 + tiff_len, jpeg + 2, len - 2);
+    *out_len = len + 2 + segment;
+    return out;
+}
+
+/* Decodes a 16x8 JPEG under well-formed and corrupt EXIF blocks: only
+   orientation 6 may turn it, and nothing may read past the segment */
+static bool check_exif(void)
+{
+    static const struct {
+        const char *name;
+        unsigned char tiff[26];
+        size_t len;
+        int width;
+    } cases[] = {
+        { "orientation 6", { 'I', 'I', 42, 0, 8, 0, 0, 0, 1, 0, 0x12, 0x01, 3, 0, 1, 0, 0, 0,
+                             6, 0, 0, 0, 0, 0, 0, 0 }, 26, 8 },
+        { "IFD offset past the end", { 'I', 'I', 42, 0, 0xFE, 0xFF, 0xFF, 0xFF }, 8, 16 },
+        { "IFD offset at the end", { 'M', 'M', 0, 42, 0, 0, 0, 7 }, 8, 16 },
+        { "truncated IFD", { 'I', 'I', 42, 0, 8, 0, 0, 0, 9, 0, 0x12, 0x01, 3, 0 }, 14, 16 },
+    };
+    unsigned char pixels[16 * 8 * 3];
+    for (size_t i = 0; i < sizeof(pixels); ++i) pixels[i] = (unsigned char)(i * 7);
+    rgb_image src = { pixels, 16, 8 };
+    size_t len;
+    unsigned char *jpeg = image_encode_jpeg(&src, 90, &len);
+    if (!jpeg) return false;
+
+    bool ok = true;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+    {
+        size_t tagged_len;
+        unsigned char *tagged = with_exif(jpeg, len, cases[c].tiff, cases[c].len, &tagged_len);
+        rgb_image img = { 0 };
+        if (!tagged || !image_decode(tagged, tagged_len, 0, &img) || img.width != cases[c].width) {
+            fprintf(stderr, "EXIF check failed: %s\n", cases[c].name);
+            ok = false;
+        }
+        rgb_image_free(&img);
+        free(tagged);
+    }
+    free(jpeg);
+    return ok;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+static const char *CHAT_RESPONSE =
+    "{\"id\": \"chatcmpl-8x\", \"object\": \"chat.completion\", \"created\": 1700000000, "
+    "\"model\": \"gpt-4-vision-preview\", \"choices\": [{\"index\": 0, \"message\": "
+    "{\"role\": \"assistant\", \"content\": \"Yes, there is a cat sitting on the windowsill "
+    "next to a potted plant.\"}, \"finish_reason\": \"stop\"}], \"usage\": {\"prompt_tokens\": "
+    "812, \"completion_tokens\": 15, \"total_tokens\": 827}}";
+
+static const char *VERDICT_RESPONSE =
+    "{\"id\": \"chatcmpl-8y\", \"object\": \"chat.completion\", \"choices\": [{\"index\": 0, "
+    "\"message\": {\"role\": \"assistant\", \"content\": \"Yes\"}, \"finish_reason\": \"length\", "
+    "\"logprobs\": {\"content\": [{\"token\": \"Yes\", \"logprob\": -0.0213, \"top_logprobs\": ["
+    "{\"token\": \"Yes\", \"logprob\": -0.0213}, {\"token\": \"No\", \"logprob\": -3.86}, "
+    "{\"token\": \"yes\", \"logprob\": -7.1}, {\"token\": \" Yes\", \"logprob\": -8.4}, "
+    "{\"token\": \"The\", \"logprob\": -9.9}]}]}}], \"usage\": {\"prompt_tokens\": 790, "
+    "\"completion_tokens\": 1, \"total_tokens\": 791}}";
+
+static char *multi_response(int questions)
+{
+    char *content = NULL, *escaped = NULL, *json = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&content, &len);
+    if (!fp) return NULL;
+    fputs("```json\n{", fp);
+    for (int i = 0; i < questions; ++i)
+        fprintf(fp, "%s\"%d\": \"%s\"", i ? ", " : "", i + 1, i % 3 ? "no" : "yes");
+    fputs("}\n```", fp);
+    fclose(fp);
+
+    json_t *str = json_string(content);
+    escaped = str ? json_dumps(str, JSON_ENCODE_ANY) : NULL;
+    json_decref(str);
+    if (escaped && asprintf(&json, "{\"choices\": [{\"index\": 0, \"message\": {\"role\": "
+                            "\"assistant\", \"content\": %s}, \"finish_reason\": \"stop\"}]}",
+                            escaped) == -1)
+        json = NULL;
+    free(content);
+    free(escaped);
+    return json;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --files N      generated tree and name lists (default 10000, up to 1000000)\n"
+            "  --blob BYTES   largest blob for base64 / hashing (default 50 MB)\n"
+            "  --time S       minimum seconds per kernel (default 0.5)\n"
+            "  --only PREFIX  run only kernels whose name starts with PREFIX\n"
+            "  --tag TEXT     recorded in every line, e.g. the commit\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int files = 10000;
+    size_t max_blob = 50u << 20;
+    for (int i = 1; i < argc; ++i)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--files") == 0 && has_value) files = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--blob") == 0 && has_value) max_blob = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--time") == 0 && has_value) min_seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--only") == 0 && has_value) only = argv[++i];
+        else if (strcmp(argv[i], "--tag") == 0 && has_value) tag = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (files < 100) files = 100;
+    if (max_blob < (100u << 10)) max_blob = 100u << 10;
+    srand(12345);
+    if (!check_exif()) return 1;
+
+    /* Blobs: a typical downscaled upload, a large photo, the maximum */
+    unsigned char *data = malloc(max_blob);
+    char *out = malloc(4 * (max_blob / 3 + 1));
+    if (!data || !out) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < max_blob; ++i) data[i] = (unsigned char)rand();
+    size_t sizes[] = { 100u << 10, 4u << 20, max_blob };
+    int size_count = max_blob > (4u << 20) ? 3 : 2;
+    if (max_blob < (4u << 20)) sizes[1] = max_blob;
+
+    const base64_impl *impls;
+    int impl_count = base64_implementations(&impls);
+    char name[64];
+    for (int s = 0; s < size_count; ++s)
+    {
+        blob_arg arg = { data, sizes[s], out, NULL };
+        for (int i = 0; i < impl_count; ++i)
+        {
+            arg.impl = &impls[i];
+            snprintf(name, sizeof(name), "base64/%s/%zuK", impls[i].name, sizes[s] >> 10);
+            run_kernel(name, (double)sizes[s], "bytes", k_base64, &arg);
+        }
+        snprintf(name, sizeof(name), "hash64/%zuK", sizes[s] >> 10);
+        run_kernel(name, (double)sizes[s], "bytes", k_hash64, &arg);
+    }
+    free(out);
+    free(data);
+
+    char **names = make_names(files);
+    char **scratch = malloc(files * sizeof(char *));
+    if (names && scratch)
+    {
+        names_arg arg = { names, scratch, files };
+        run_kernel("filter/has_image_extension", files, "names", k_extension, &arg);
+        snprintf(name, sizeof(name), "sort/cmp_strings/%u", files);
+        run_kernel(name, files, "names", k_sort, &arg);
+        snprintf(name, sizeof(name), "sort/file_list_sort/%u", files);
+        run_kernel(name, files, "names", k_list_sort, &arg);
+    }
+    for (unsigned int i = 0; names && i < files; ++i) free(names[i]);
+    free(names);
+    free(scratch);
+
+    /* The walk reads a real tree; after the first pass it is in the page cache */
+    if (!only || strncmp("walk", only, strlen(only)) == 0)
+    {
+        const char *tmpdir = getenv("TMPDIR");
+        char root[4096];
+        snprintf(root, sizeof(root), "%s/llm_image_search_bench_XXXXXX", tmpdir ? tmpdir : "/tmp");
+        if (mkdtemp(root))
+        {
+            double t0 = now_seconds();
+            if (make_tree(root, files)) {
+                fprintf(stderr, "(generated %u files in %.1f s)\n", files, now_seconds() - t0);
+                walk_arg arg = { root, 0 };
+                snprintf(name, sizeof(name), "walk/load_files/%u", files);
+                run_kernel(name, files, "files", k_walk, &arg);
+                if (arg.found != files - files / 10)
+                    fprintf(stderr, "walk found %u images, expected %u\n", arg.found, files - files / 10);
+            } else {
+                fprintf(stderr, "Cannot generate the tree under %s\n", root);
+            }
+            nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+        }
+    }
+
+    /* A 640x480 photo-sized JPEG with an EXIF orientation to bake in */
+    static const unsigned char rotated[26] = { 'I', 'I', 42, 0, 8, 0, 0, 0, 1, 0, 0x12, 0x01, 3, 0,
+                                               1, 0, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0 };
+    unsigned char *photo = malloc(640 * 480 * 3);
+    if (photo)
+    {
+        for (size_t i = 0; i < 640 * 480 * 3; ++i) photo[i] = (unsigned char)(i / 3 % 640 + rand() % 16);
+        rgb_image src = { photo, 640, 480 };
+        size_t len, tagged_len = 0;
+        unsigned char *jpeg = image_encode_jpeg(&src, 85, &len);
+        unsigned char *tagged = jpeg ? with_exif(jpeg, len, rotated, sizeof(rotated), &tagged_len) : NULL;
+        if (tagged) {
+            decode_arg arg = { tagged, tagged_len };
+            run_kernel("decode/jpeg_exif/640x480", (double)tagged_len, "bytes", k_decode, &arg);
+        }
+        free(tagged);
+        free(jpeg);
+        free(photo);
+    }
+
+    json_arg chat = { CHAT_RESPONSE, 0 };
+    run_kernel("json/chat", strlen(CHAT_RESPONSE), "bytes", k_json, &chat);
+    json_arg verdict = { VERDICT_RESPONSE, 0 };
+    run_kernel("json/verdict_logprobs", strlen(VERDICT_RESPONSE), "bytes", k_json, &verdict);
+    char *multi_json = multi_response(LLM_MAX_QUERIES);
+    if (multi_json) {
+        json_arg multi = { multi_json, LLM_MAX_QUERIES };
+        run_kernel("json/multi_answer", strlen(multi_json), "bytes", k_json, &multi);
+        free(multi_json);
+    }
+
+    /* Prefilter scan: one query against 10k CLIP-sized vectors */
+    int dim = 768, count = 10000;
+    float *vectors = malloc((size_t)dim * count * sizeof(float));
+    float *query = malloc(dim * sizeof(float));
+    if (vectors && query)
+    {
+        for (size_t i = 0; i < (size_t)dim * count; ++i) vectors[i] = rand() / (float)RAND_MAX - 0.5f;
+        for (int i = 0; i < dim; ++i) query[i] = rand() / (float)RAND_MAX - 0.5f;
+        dot_arg arg = { query, vectors, dim, count };
+        snprintf(name, sizeof(name), "embed_dot/%s/%dx%d", embed_dot_impl_name(), count, dim);
+        run_kernel(name, count, "vectors", k_dot, &arg);
+    }
+    free(vectors);
+    free(query);
+    return 0;
+}
@@ -0,0 +1,377 @@
+#define _GNU_SOURCE
+#include "../backend.h"
+#include "../image_prep.h"
+#include "../llm.h"
+#include "../net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <curl/curl.h>
+#include <sys/resource.h>
+
+/* -------------------------------------------------
+   End-to-end load test: the real request path (worker pool with image
+   prep, or blocking getLLMResponse calls from many threads) against a
+   backend, usually bench/mock_server.py, at every combination of
+   concurrency and image size. One JSON line per run on stdout: images/s,
+   mean requests in flight against the slots, client CPU and memory per
+   image; a readable table goes to stderr.
+   ------------------------------------------------- */
+
+static const char *PROMPT_PHRASE = "a cat";
+static const char *tag = "";
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static long rss_kb(void)
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(fp);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* A photo-like JPEG: smooth gradients plus noise, `edge` pixels square */
+static char *make_image(const char *dir, int edge, size_t *size)
+{
+    rgb_image img = { malloc((size_t)edge * edge * 3), edge, edge };
+    if (!img.pixels) return NULL;
+    for (int y = 0; y < edge; ++y)
+        for (int x = 0; x < edge; ++x)
+        {
+            unsigned char *p = img.pixels + ((size_t)y * edge + x) * 3;
+            int noise = rand() % 48;
+            p[0] = (unsigned char)((x * 200 / edge + noise) & 0xff);
+            p[1] = (unsigned char)((y * 200 / edge + noise) & 0xff);
+            p[2] = (unsigned char)(((x + y) * 100 / edge + noise) & 0xff);
+        }
+    unsigned char *jpeg = image_encode_jpeg(&img, 90, size);
+    rgb_image_free(&img);
+    if (!jpeg) return NULL;
+
+    char *path = NULL;
+    FILE *fp = NULL;
+    if (asprintf(&path, "%s/load_%d.jpg", dir, edge) != -1 && (fp = fopen(path, "wb")))
+    {
+        fwrite(jpeg, 1, *size, fp);
+        fclose(fp);
+    }
+    free(jpeg);
+    if (!fp) {
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+/* The backend answers anything at all: the mock may still be starting */
+static bool wait_for_server(const char *url)
+{
+    for (int attempt = 0; attempt < 50; ++attempt)
+    {
+        CURL *curl = curl_easy_init();
+        if (!curl) return false;
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 1L);
+        CURLcode code = curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+        if (code == CURLE_OK) return true;
+        usleep(100000);
+    }
+    return false;
+}
+
+typedef struct {
+    double wall_s;
+    double cpu_s;
+    long rss_before_kb;
+    long rss_after_kb;
+    int ok;
+    int errors;
+    double wire_ms;         /* summed time requests spent on a connection */
+    double file_bytes;
+    double upload_bytes;
+    double latency_ms[4];   /* p50, p95, p99, max of per-image totals */
+} run_stats;
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void set_percentiles(run_stats *st, double *totals, int n)
+{
+    if (n == 0) return;
+    qsort(totals, n, sizeof(double), compare_double);
+    st->latency_ms[0] = totals[(int)(0.50 * (n - 1))];
+    st->latency_ms[1] = totals[(int)(0.95 * (n - 1))];
+    st->latency_ms[2] = totals[(int)(0.99 * (n - 1))];
+    st->latency_ms[3] = totals[n - 1];
+}
+
+/* The batch path: pool prep threads and the network engine */
+static bool run_pool(const char *path, int images, int jobs, run_stats *st)
+{
+    if (!llm_pool_start(jobs)) return false;
+    double *totals = calloc(images, sizeof(double));
+    if (!totals) {
+        llm_pool_stop();
+        return false;
+    }
+    st->rss_before_kb = rss_kb();
+    double cpu0 = cpu_seconds(), t0 = now_seconds();
+    for (int i = 0; i < images; ++i)
+        llm_pool_submit(path, PROMPT_PHRASE, 1);
+
+    int got = 0;
+    while (got < images)
+    {
+        llm_result r;
+        if (!llm_pool_wait(&r, 1000)) continue;
+        if (r.ok) st->ok++;
+        else st->errors++;
+        st->wire_ms += r.request_ms - r.wait_ms;
+        st->file_bytes += r.file_bytes;
+        st->upload_bytes += r.upload_bytes;
+        totals[got++] = r.total_ms;
+        llm_result_free(&r);
+    }
+    st->wall_s = now_seconds() - t0;
+    st->cpu_s = cpu_seconds() - cpu0;
+    st->rss_after_kb = rss_kb();
+    llm_pool_stop();
+    set_percentiles(st, totals, images);
+    free(totals);
+    return true;
+}
+
+/* The blocking path: getLLMResponse from `jobs` threads at once */
+typedef struct {
+    const unsigned char *image;
+    size_t size;
+    int images;
+    int next;               /* atomic */
+    double *totals;
+    int ok;                 /* atomic */
+} direct_work;
+
+static void *direct_worker(void *arg)
+{
+    direct_work *w = arg;
+    char *prompt = NULL;
+    if (asprintf(&prompt, "Does the image contain %s?", PROMPT_PHRASE) == -1) return NULL;
+    int i;
+    while ((i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED)) < w->images)
+    {
+        double t0 = now_seconds();
+        char *response = getLLMResponse(prompt, w->image, w->size, "image/jpeg", LLM_TEMPERATURE);
+        const char *content, *finish;
+        json_t *root = llm_parse_response(response, &content, &finish);
+        if (root) __atomic_fetch_add(&w->ok, 1, __ATOMIC_RELAXED);
+        json_decref(root);
+        free(response);
+        w->totals[i] = (now_seconds() - t0) * 1000;
+    }
+    free(prompt);
+    return NULL;
+}
+
+static bool run_direct(const char *path, int images, int jobs, run_stats *st)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    unsigned char *image = malloc(size > 0 ? size : 1);
+    bool read_ok = image && fread(image, 1, size, fp) == (size_t)size;
+    fclose(fp);
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    direct_work w = { image, (size_t)size, images, 0, calloc(images, sizeof(double)), 0 };
+    if (!read_ok || !threads || !w.totals || !net_start(jobs, true)) {
+        free(image);
+        free(threads);
+        free(w.totals);
+        return false;
+    }
+
+    st->rss_before_kb = rss_kb();
+    double cpu0 = cpu_seconds(), t0 = now_seconds();
+    int started = 0;
+    while (started < jobs && pthread_create(&threads[started], NULL, direct_worker, &w) == 0)
+        started++;
+    for (int t = 0; t < started; ++t)
+        pthread_join(threads[t], NULL);
+    st->wall_s = now_seconds() - t0;
+    st->cpu_s = cpu_seconds() - cpu0;
+    st->rss_after_kb = rss_kb();
+    net_stop();
+
+    st->ok = w.ok;
+    st->errors = images - w.ok;
+    for (int i = 0; i < images; ++i) st->wire_ms += w.totals[i];
+    st->file_bytes = st->upload_bytes = (double)size * images;
+    set_percentiles(st, w.totals, images);
+    free(w.totals);
+    free(threads);
+    free(image);
+    return started > 0;
+}
+
+static void report(const char *mode, int edge, int images, int jobs, const run_stats *st)
+{
+    double per_second = st->wall_s > 0 ? images / st->wall_s : 0;
+    double in_flight = st->wall_s > 0 ? st->wire_ms / 1000 / st->wall_s : 0;
+    double cpu_ms = st->cpu_s * 1000 / images;
+    double rss_per_image = (st->rss_after_kb - st->rss_before_kb) * 1024.0 / images;
+
+    printf("{\"tag\": \"%s\", \"mode\": \"%s\", \"edge\": %d, \"jobs\": %d, \"images\": %d, "
+           "\"ok\": %d, \"errors\": %d, \"images_per_second\": %.2f, \"mean_in_flight\": %.2f, "
+           "\"occupancy\": %.3f, \"file_bytes\": %.0f, \"upload_bytes\": %.0f, "
+           "\"latency_ms\": {\"p50\": %.1f, \"p95\": %.1f, \"p99\": %.1f, \"max\": %.1f}, "
+           "\"cpu_ms_per_image\": %.3f, \"rss_bytes_per_image\": %.0f, \"peak_rss_kb\": %ld}\n",
+           tag, mode, edge, jobs, images, st->ok, st->errors, per_second, in_flight,
+           in_flight / jobs, st->file_bytes / images, st->upload_bytes / images,
+           st->latency_ms[0], st->latency_ms[1], st->latency_ms[2], st->latency_ms[3],
+           cpu_ms, rss_per_image, peak_rss_kb());
+    fflush(stdout);
+    fprintf(stderr, "%-6s %5dpx %4d jobs: %8.2f images/s, %5.1f in flight (%3.0f%%), "
+            "p95 %7.1f ms, %7.3f CPU ms/image, %4d errors\n",
+            mode, edge, jobs, per_second, in_flight, 100 * in_flight / jobs,
+            st->latency_ms[1], cpu_ms, st->errors);
+}
+
+/* "1,4,16" -> ints; returns the count */
+static int parse_list(const char *text, int *values, int max)
+{
+    int n = 0;
+    while (*text && n < max)
+    {
+        char *end;
+        long v = strtol(text, &end, 10);
+        if (end == text) break;
+        if (v > 0) values[n++] = (int)v;
+        text = *end ? end + 1 : end;
+    }
+    return n;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --url URL        chat completions endpoint (default http://127.0.0.1:9090/v1/chat/completions)\n"
+            "  --jobs LIST      concurrency levels (default 1,2,4,8,16)\n"
+            "  --edges LIST     generated JPEG sizes in pixels (default 512,1536,4000)\n"
+            "  --images N       requests per run (default 200)\n"
+            "  --direct         blocking getLLMResponse calls instead of the batch pool\n"
+            "  --max-edge PX    downscale before upload (default 1024, 0 = send originals)\n"
+            "  --fast-verdict   one-token answers with logprobs\n"
+            "  --tag TEXT       recorded in every line\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *url = "http://127.0.0.1:9090/v1/chat/completions";
+    int jobs[32], job_count = parse_list("1,2,4,8,16", jobs, 32);
+    int edges[32], edge_count = parse_list("512,1536,4000", edges, 32);
+    int images = 200;
+    bool direct = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--url") == 0 && has_value) url = argv[++i];
+        else if (strcmp(argv[i], "--jobs") == 0 && has_value) job_count = parse_list(argv[++i], jobs, 32);
+        else if (strcmp(argv[i], "--edges") == 0 && has_value) edge_count = parse_list(argv[++i], edges, 32);
+        else if (strcmp(argv[i], "--images") == 0 && has_value) images = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--direct") == 0) direct = true;
+        else if (strcmp(argv[i], "--max-edge") == 0 && has_value) prep_opts.max_edge = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fast-verdict") == 0) llm_opts.fast_verdict = true;
+        else if (strcmp(argv[i], "--tag") == 0 && has_value) tag = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (images < 1 || job_count == 0 || edge_count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    llm_log_progress = false;
+    if (!backend_add(url)) return 1;
+    if (!wait_for_server(url)) {
+        fprintf(stderr, "No server at %s\n", url);
+        return 1;
+    }
+
+    const char *tmpdir = getenv("TMPDIR");
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/llm_image_search_load_XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create a directory under %s\n", tmpdir ? tmpdir : "/tmp");
+        return 1;
+    }
+
+    /* Every run submits the same file: the verdict cache is never opened */
+    int failures = 0;
+    srand(12345);
+    for (int e = 0; e < edge_count; ++e)
+    {
+        size_t size = 0;
+        char *path = make_image(dir, edges[e], &size);
+        if (!path) {
+            fprintf(stderr, "Cannot generate a %d px image\n", edges[e]);
+            failures++;
+            continue;
+        }
+        for (int j = 0; j < job_count; ++j)
+        {
+            run_stats st;
+            memset(&st, 0, sizeof(st));
+            bool ran = direct ? run_direct(path, images, jobs[j], &st)
+                              : run_pool(path, images, jobs[j], &st);
+            if (!ran) {
+                failures++;
+                continue;
+            }
+            report(direct ? "direct" : "pool", edges[e], images, jobs[j], &st);
+            if (st.errors) failures++;
+        }
+        remove(path);
+        free(path);
+    }
+    rmdir(dir);
+    curl_global_cleanup();
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Mock OpenAI-compatible backend for load tests (Python 3 stdlib only).
+
+Serves /v1/chat/completions and /v1/embeddings the way the client uses
+them: yes/no answers (one-token logprob verdicts with max_tokens 1),
+numbered multi-question answers and 0-10 ratings, whole or streamed as
+server-sent events ("stream": true). Latency, generation speed, slot
+concurrency, errors and hangs are configurable; GET /stats returns the
+counters as JSON.
+
+    python3 bench/mock_server.py --port 9090 --slots 8 \\
+        --latency lognormal:0.3,0.4 --per-mb 0.05 --error-rate 0.01 \\
+        --verbose 60 --token-seconds 0.03
+"""
+
+import argparse
+import hashlib
+import http.server
+import json
+import math
+import random
+import re
+import socket
+import sys
+import threading
+import time
+
+
+def parse_latency(spec):
+    """fixed:S | uniform:LO,HI | normal:MEAN,SD | lognormal:MEDIAN,SIGMA (seconds)"""
+    kind, _, args = spec.partition(":")
+    values = [float(v) for v in args.split(",")] if args else []
+    if kind == "fixed" and len(values) == 1:
+        return lambda: values[0]
+    if kind == "uniform" and len(values) == 2:
+        return lambda: random.uniform(values[0], values[1])
+    if kind == "normal" and len(values) == 2:
+        return lambda: max(0.0, random.gauss(values[0], values[1]))
+    if kind == "lognormal" and len(values) == 2:
+        return lambda: random.lognormvariate(math.log(values[0]), values[1])
+    raise argparse.ArgumentTypeError("bad latency spec: " + spec)
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.requests = 0
+        self.errors = 0
+        self.hangs = 0
+        self.streams = 0
+        self.streams_cut = 0
+        self.tokens = 0
+        self.bytes_in = 0
+        self.active = 0
+        self.max_active = 0
+        self.queued = 0
+        self.max_queued = 0
+
+    def snapshot(self):
+        with self.lock:
+            return {k: v for k, v in self.__dict__.items() if k != "lock"}
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def setup(self):
+        super().setup()
+        self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def send_json(self, status, obj):
+        out = json.dumps(obj).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(out)))
+        self.end_headers()
+        self.wfile.write(out)
+
+    def do_GET(self):
+        if self.path == "/stats":
+            self.send_json(200, self.server.stats.snapshot())
+        else:
+            self.send_json(404, {"error": "not found"})
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        opts, stats = self.server.opts, self.server.stats
+        with stats.lock:
+            stats.requests += 1
+            stats.bytes_in += len(body)
+        try:
+            req = json.loads(body)
+        except ValueError:
+            self.send_json(400, {"error": "bad json"})
+            return
+
+        # Wait for a slot like a server with a fixed number of sequences
+        with stats.lock:
+            stats.queued += 1
+            stats.max_queued = max(stats.max_queued, stats.queued)
+        self.server.slots.acquire()
+        with stats.lock:
+            stats.queued -= 1
+            stats.active += 1
+            stats.max_active = max(stats.max_active, stats.active)
+        try:
+            self.answer(req, body, opts, stats)
+        finally:
+            with stats.lock:
+                stats.active -= 1
+            self.server.slots.release()
+
+    def answer(self, req, body, opts, stats):
+        roll = random.random()
+        if roll < opts.hang_rate:
+            # Never answers: the client's deadline has to cut it off
+            with stats.lock:
+                stats.hangs += 1
+            time.sleep(opts.hang_seconds)
+            self.close_connection = True
+            return
+
+        # Prompt processing until the first token
+        time.sleep(opts.latency() + opts.per_mb * len(body) / 1e6)
+        if roll < opts.hang_rate + opts.error_rate:
+            with stats.lock:
+                stats.errors += 1
+            self.send_json(opts.error_status, {"error": {"message": "injected failure"}})
+            return
+
+        if self.path.endswith("/embeddings"):
+            digest = hashlib.sha256(json.dumps(req.get("input")).encode()).digest()
+            vec = [(digest[i % 32] - 128) / 128.0 for i in range(opts.embed_dim)]
+            self.send_json(200, {"data": [{"embedding": vec, "index": 0}], "model": req.get("model")})
+            return
+
+        yes = lambda: random.random() < opts.yes_ratio
+        questions = len(re.findall(rb"\\n\d+\. Does", body))
+        choice = {"index": 0, "finish_reason": "stop"}
+        if questions:
+            answers = {str(i + 1): "yes" if yes() else "no" for i in range(questions)}
+            content = json.dumps(answers)
+        elif b"Rate it from 0" in body:
+            content = str(random.randint(0, 10))
+        elif req.get("max_tokens") == 1:
+            p_yes = random.betavariate(8, 2) if yes() else random.betavariate(2, 8)
+            content = "Yes" if p_yes >= 0.5 else "No"
+            choice["finish_reason"] = "length"
+            choice["logprobs"] = {"content": [{
+                "token": content, "logprob": math.log(max(p_yes, 1 - p_yes)),
+                "top_logprobs": [{"token": "Yes", "logprob": math.log(max(p_yes, 1e-9))},
+                                 {"token": "No", "logprob": math.log(max(1 - p_yes, 1e-9))}]}]}
+        else:
+            content = "Yes, it does." if yes() else "No."
+        if opts.verbose and req.get("max_tokens") is None:
+            # A chatty model explains itself after the answer
+            words = (FILLER * (opts.verbose // len(FILLER) + 1))[:opts.verbose]
+            content += "\n\n" + " ".join(words)
+
+        tokens = re.findall(r"\s*\S+", content)
+        if req.get("stream"):
+            self.stream(req, choice, tokens, opts, stats)
+            return
+        time.sleep(opts.token_seconds * len(tokens))
+        with stats.lock:
+            stats.tokens += len(tokens)
+        choice["message"] = {"role": "assistant", "content": content}
+        self.send_json(200, {"object": "chat.completion", "model": req.get("model"),
+                             "choices": [choice]})
+
+    def stream(self, req, choice, tokens, opts, stats):
+        """One chunk per token; a client that hangs up stops the generation."""
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        with stats.lock:
+            stats.streams += 1
+
+        def event(delta, finish_reason=None):
+            obj = {"object": "chat.completion.chunk", "model": req.get("model"),
+                   "choices": [{"index": 0, "delta": delta, "finish_reason": finish_reason}]}
+            return b"data: " + json.dumps(obj).encode() + b"\n\n"
+
+        def send(data):
+            self.wfile.write(b"%x\r\n%s\r\n" % (len(data), data))
+            self.wfile.flush()
+
+        sent = 0
+        try:
+            send(event({"role": "assistant", "content": ""}))
+            for token in tokens:
+                send(event({"content": token}))
+                sent += 1
+                time.sleep(opts.token_seconds)
+            send(event({}, choice["finish_reason"]) + b"data: [DONE]\n\n")
+            self.wfile.write(b"0\r\n\r\n")
+        except (BrokenPipeError, ConnectionResetError):
+            self.close_connection = True
+            with stats.lock:
+                stats.streams_cut += 1
+        with stats.lock:
+            stats.tokens += sent
+
+
+FILLER = ("The image shows a scene with several objects in it and the lighting "
+          "suggests it was taken indoors during the day").split()
+
+
+class Server(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+    request_queue_size = 1024
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=9090)
+    ap.add_argument("--slots", type=int, default=4, help="requests served at once; the rest queue")
+    ap.add_argument("--latency", type=parse_latency, default=parse_latency("fixed:0.2"),
+                    help="per-request time: fixed:S, uniform:LO,HI, normal:MEAN,SD, lognormal:MEDIAN,SIGMA")
+    ap.add_argument("--per-mb", type=float, default=0.0, help="extra seconds per MB of request body")
+    ap.add_argument("--token-seconds", type=float, default=0.0, help="generation time per answer token")
+    ap.add_argument("--verbose", type=int, default=0, metavar="N",
+                    help="append N words of explanation to text answers")
+    ap.add_argument("--yes-ratio", type=float, default=0.5)
+    ap.add_argument("--error-rate", type=float, default=0.0)
+    ap.add_argument("--error-status", type=int, default=503)
+    ap.add_argument("--hang-rate", type=float, default=0.0, help="requests that never answer")
+    ap.add_argument("--hang-seconds", type=float, default=3600.0)
+    ap.add_argument("--embed-dim", type=int, default=512)
+    ap.add_argument("--seed", type=int, default=None)
+    opts = ap.parse_args()
+    random.seed(opts.seed)
+
+    server = Server((opts.host, opts.port), Handler)
+    server.opts = opts
+    server.stats = Stats()
+    server.slots = threading.BoundedSemaphore(max(1, opts.slots))
+    print("mock backend on http://%s:%d/v1/chat/completions (%d slots)" % (opts.host, opts.port, opts.slots),
+          file=sys.stderr, flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print(json.dumps(server.stats.snapshot()), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include "cache.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/* -------------------------------------------------
+   On-disk format: an append-only TSV log, one verdict per line
+       <content hash>\t<request key>\t<y|n>\t<answer>\n
+   Later lines win, so re-asking simply appends.
+   ------------------------------------------------- */
+
+#define CACHE_ANSWER_MAX 512
+
+typedef struct {
+    uint64_t content;
+    uint64_t request;
+    bool keep;
+    bool used;
+    char *answer;
+} cache_entry;
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cache_entry *table = NULL;
+static size_t table_cap = 0;     /* power of two */
+static size_t table_count = 0;
+static FILE *cache_fp = NULL;
+
+static size_t slot_for(uint64_t content, uint64_t request)
+{
+    return (size_t)((content ^ (request * 0x9E3779B97F4A7C15ULL)) & (table_cap - 1));
+}
+
+static bool table_grow(void)
+{
+    size_t new_cap = table_cap ? table_cap * 2 : 1024;
+    cache_entry *new_table = calloc(new_cap, sizeof(cache_entry));
+    if (!new_table) return false;
+
+    cache_entry *old = table;
+    size_t old_cap = table_cap;
+    table = new_table;
+    table_cap = new_cap;
+    for (size_t i = 0; i < old_cap; ++i)
+    {
+        if (!old[i].used) continue;
+        size_t s = slot_for(old[i].content, old[i].request);
+        while (table[s].used) s = (s + 1) & (table_cap - 1);
+        table[s] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+/* Caller holds cache_mutex; takes ownership of `answer` */
+static void table_put(uint64_t content, uint64_t request, bool keep, char *answer)
+{
+    if ((table_count + 1) * 4 > table_cap * 3 && !table_grow()) {
+        free(answer);
+        return;
+    }
+    size_t s = slot_for(content, request);
+    while (table[s].used && !(table[s].content == content && table[s].request == request))
+        s = (s + 1) & (table_cap - 1);
+    if (table[s].used) {
+        free(table[s].answer);
+    } else {
+        table[s].used = true;
+        table[s].content = content;
+        table[s].request = request;
+        table_count++;
+    }
+    table[s].keep = keep;
+    table[s].answer = answer;
+}
+
+static void mkdir_parents(const char *path)
+{
+    char *tmp = strdup(path);
+    if (!tmp) return;
+    for (char *p = tmp + 1; *p; ++p)
+    {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) == -1 && errno != EEXIST) break;
+        *p = '/';
+    }
+    free(tmp);
+}
+
+char *cache_file_path(const char *name)
+{
+    char *path = NULL;
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int rc;
+    if (xdg && *xdg)
+        rc = asprintf(&path, "%s/llm_image_search/%s", xdg, name);
+    else if (home && *home)
+        rc = asprintf(&path, "%s/.cache/llm_image_search/%s", home, name);
+    else
+        rc = asprintf(&path, "llm_image_search_%s", name);
+    if (rc == -1) return NULL;
+    mkdir_parents(path);
+    return path;
+}
+
+static void load_entries(FILE *fp)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, fp)) != -1)
+    {
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        uint64_t content, request;
+        char verdict;
+        int consumed = 0;
+        if (sscanf(line, "%" SCNx64 "\t%" SCNx64 "\t%c\t%n",
+                   &content, &request, &verdict, &consumed) < 3 || consumed == 0)
+            continue; /* torn or foreign line */
+        table_put(content, request, verdict == 'y', strdup(line + consumed));
+    }
+    free(line);
+}
+
+bool verdict_cache_open(const char *path)
+{
+    char *owned = NULL;
+    if (!path) {
+        owned = cache_file_path("verdicts.tsv");
+        if (!owned) return false;
+        path = owned;
+    } else {
+        mkdir_parents(path);
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    FILE *fp = fopen(path, "a+");
+    if (fp) {
+        rewind(fp);
+        load_entries(fp);
+        cache_fp = fp;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (!fp) fprintf(stderr, "Failed to open verdict cache %s\n", path);
+    else fprintf(stderr, "Verdict cache: %s (%zu entries)\n", path, table_count);
+    free(owned);
+    return fp != NULL;
+}
+
+void verdict_cache_close(void)
+{
+    pthread_mutex_lock(&cache_mutex);
+    if (cache_fp) fclose(cache_fp);
+    cache_fp = NULL;
+    for (size_t i = 0; i < table_cap; ++i)
+        if (table[i].used) free(table[i].answer);
+    free(table);
+    table = NULL;
+    table_cap = table_count = 0;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+bool verdict_cache_enabled(void)
+{
+    return cache_fp != NULL;
+}
+
+uint64_t verdict_cache_request_key(const char *prompt, const char *model, double temperature)
+{
+    char *key = NULL;
+    int len = asprintf(&key, "%s\n%s\n%.6f", prompt, model, temperature);
+    if (len == -1) return 0;
+    uint64_t h = hash64(key, (size_t)len, 0);
+    free(key);
+    return h;
+}
+
+bool verdict_cache_lookup(uint64_t content_hash, uint64_t request_key,
+                          bool *keep, char **answer)
+{
+    bool hit = false;
+    pthread_mutex_lock(&cache_mutex);
+    if (table_cap)
+    {
+        size_t s = slot_for(content_hash, request_key);
+        while (table[s].used)
+        {
+            if (table[s].content == content_hash && table[s].request == request_key)
+            {
+                *keep = table[s].keep;
+                if (answer) *answer = strdup(table[s].answer ? table[s].answer : "");
+                hit = true;
+                break;
+            }
+            s = (s + 1) & (table_cap - 1);
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return hit;
+}
+
+void verdict_cache_store(uint64_t content_hash, uint64_t request_key,
+                         bool keep, const char *answer)
+{
+    /* One line per entry: fold whitespace and cap the stored answer */
+    char clean[CACHE_ANSWER_MAX + 1];
+    size_t n = 0;
+    for (const char *p = answer ? answer : ""; *p && n < CACHE_ANSWER_MAX; ++p)
+        clean[n++] = (*p == '\t' || *p == '\n' || *p == '\r') ? ' ' : *p;
+    clean[n] = '\0';
+
+    pthread_mutex_lock(&cache_mutex);
+    if (cache_fp)
+    {
+        table_put(content_hash, request_key, keep, strdup(clean));
+        fprintf(cache_fp, "%016" PRIx64 "\t%016" PRIx64 "\t%c\t%s\n",
+                content_hash, request_key, keep ? 'y' : 'n', clean);
+        fflush(cache_fp);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,32 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* -------------------------------------------------
+   Persistent verdict cache
+   Maps (content hash, request key) to the model's answer so repeat
+   searches over unchanged files never touch the network.
+   ------------------------------------------------- */
+
+/* Opens (creating if needed) the cache file; NULL selects the default
+   $XDG_CACHE_HOME/llm_image_search/verdicts.tsv location. */
+bool verdict_cache_open(const char *path);
+void verdict_cache_close(void);
+bool verdict_cache_enabled(void);
+
+/* Key for everything about the request that is not the image */
+uint64_t verdict_cache_request_key(const char *prompt, const char *model, double temperature);
+
+/* On a hit stores the verdict and a malloc'd copy of the answer */
+bool verdict_cache_lookup(uint64_t content_hash, uint64_t request_key,
+                          bool *keep, char **answer);
+void verdict_cache_store(uint64_t content_hash, uint64_t request_key,
+                         bool keep, const char *answer);
+
+/* malloc'd path of `name` in the cache directory
+   ($XDG_CACHE_HOME/llm_image_search/); parent directories are created */
+char *cache_file_path(const char *name);
+
+#endif
@@ -0,0 +1,779 @@
+#define _GNU_SOURCE
+#include "catalog.h"
+#include "cache.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* -------------------------------------------------
+   On-disk format, native byte order, rewritten whole and renamed
+   into place:
+       catalog_header
+       dir_record   dirs[dir_count]     by strcmp on the path
+       file_record  files[file_count]   in panel order (cmp_strings)
+       char         strings[]           NUL-terminated paths, root first
+   Creating, deleting or renaming an entry bumps its directory's mtime,
+   so a directory whose stamp matches still holds exactly the files
+   recorded under it. File stats are only kept next to a content hash
+   and checked when the hash is used.
+   ------------------------------------------------- */
+
+#define CATALOG_MAGIC "LISCAT\0\1"
+#define CATALOG_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t recursive;
+    uint64_t dir_count;
+    uint64_t file_count;
+    uint64_t strings_size;
+    uint64_t root;              /* offset of the root path */
+} catalog_header;
+
+typedef struct {
+    int64_t mtime_ns;
+    uint64_t ino;
+    uint64_t path;              /* offset in strings */
+} dir_record;
+
+typedef struct {
+    uint64_t content_hash;      /* 0 = not hashed yet */
+    uint64_t size;              /* stat when the hash was taken */
+    int64_t mtime_ns;
+    uint64_t ino;
+    uint64_t path;
+    uint64_t dir;               /* index of the parent directory */
+} file_record;
+
+typedef struct {
+    unsigned char *map;
+    size_t size;
+    const catalog_header *hdr;
+    const dir_record *dirs;
+    const file_record *files;
+    const char *strings;
+} catalog_view;
+
+/* Hashes learned since the load, keyed by path hash */
+typedef struct {
+    uint64_t key;               /* 0 = empty slot */
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t ino;
+    uint64_t content_hash;
+} hash_memo;
+
+typedef struct {
+    dir_stamp *items;
+    unsigned int count;
+    unsigned int cap;
+} stamp_list;
+
+struct catalog_build {
+    char *root;
+    bool recursive;
+    char *blob;                 /* copied paths, NUL-terminated */
+    size_t blob_len;
+    size_t blob_cap;
+    size_t *offsets;
+    unsigned int count;
+    unsigned int cap;
+};
+
+static pthread_mutex_t catalog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *current_root = NULL;
+static bool current_recursive = false;
+static catalog_view current = {0};
+static hash_memo *memo = NULL;
+static size_t memo_cap = 0;     /* power of two */
+static size_t memo_count = 0;
+
+static int64_t mtime_ns(const struct stat *st)
+{
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+static bool stat_matches(uint64_t size, int64_t mtime, uint64_t ino, const struct stat *st)
+{
+    return size == (uint64_t)st->st_size && mtime == mtime_ns(st) && ino == (uint64_t)st->st_ino;
+}
+
+/* Same spelling the scanner uses for the paths below it */
+static char *normalize_root(const char *root)
+{
+    char *copy = strdup(root);
+    if (!copy) return NULL;
+    size_t len = strlen(copy);
+    while (len > 1 && copy[len - 1] == '/') copy[--len] = '\0';
+    return copy;
+}
+
+static char *catalog_file_path(const char *root, bool recursive)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "catalogs/%016" PRIx64 "%s.cat",
+             hash64(root, strlen(root), 0), recursive ? "-r" : "");
+    return cache_file_path(name);
+}
+
+/* -------------------------------------------------
+   Mapped catalogs
+   ------------------------------------------------- */
+
+static void view_close(catalog_view *v)
+{
+    if (v->map) munmap(v->map, v->size);
+    *v = (catalog_view){0};
+}
+
+/* Maps `file` if it is a well-formed catalog of (root, recursive) */
+static bool view_open(catalog_view *v, const char *file, const char *root, bool recursive)
+{
+    *v = (catalog_view){0};
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(catalog_header)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    v->map = map;
+    v->size = (size_t)st.st_size;
+    v->hdr = map;
+
+    /* Sizes first, without trusting any count enough to overflow */
+    const catalog_header *h = v->hdr;
+    size_t avail = v->size - sizeof(catalog_header);
+    bool valid = memcmp(h->magic, CATALOG_MAGIC, 8) == 0 && h->version == CATALOG_VERSION &&
+                 h->recursive == (recursive ? 1u : 0u);
+    valid = valid && h->dir_count <= avail / sizeof(dir_record);
+    if (valid) avail -= h->dir_count * sizeof(dir_record);
+    valid = valid && h->file_count <= avail / sizeof(file_record);
+    if (valid) avail -= h->file_count * sizeof(file_record);
+    valid = valid && h->strings_size == avail && avail > 0;
+    if (valid)
+    {
+        v->dirs = (const dir_record *)(v->map + sizeof(catalog_header));
+        v->files = (const file_record *)(v->dirs + h->dir_count);
+        v->strings = (const char *)(v->files + h->file_count);
+        valid = v->strings[avail - 1] == '\0' && h->root < avail &&
+                strcmp(v->strings + h->root, root) == 0;
+    }
+    for (uint64_t i = 0; valid && i < h->dir_count; ++i)
+        valid = v->dirs[i].path < avail;
+    for (uint64_t i = 0; valid && i < h->file_count; ++i)
+        valid = v->files[i].path < avail && v->files[i].dir < h->dir_count;
+
+    if (!valid) {
+        fprintf(stderr, "Ignoring damaged catalog %s\n", file);
+        view_close(v);
+    }
+    return valid;
+}
+
+static const file_record *view_find_file(const catalog_view *v, const char *path)
+{
+    size_t lo = 0, hi = v->map ? v->hdr->file_count : 0;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *probe = v->strings + v->files[mid].path;
+        int c = cmp_strings(&path, &probe);
+        if (c == 0) return &v->files[mid];
+        if (c < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+static bool view_has_dir(const catalog_view *v, const char *path)
+{
+    size_t lo = 0, hi = v->map ? v->hdr->dir_count : 0;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(path, v->strings + v->dirs[mid].path);
+        if (c == 0) return true;
+        if (c < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return false;
+}
+
+/* -------------------------------------------------
+   Hash memo (caller holds catalog_mutex)
+   ------------------------------------------------- */
+
+static uint64_t memo_key(const char *path)
+{
+    uint64_t key = hash64(path, strlen(path), 0);
+    return key ? key : 1;
+}
+
+static hash_memo *memo_find(uint64_t key)
+{
+    if (memo_count == 0) return NULL;
+    for (size_t s = key & (memo_cap - 1); memo[s].key; s = (s + 1) & (memo_cap - 1))
+        if (memo[s].key == key) return &memo[s];
+    return NULL;
+}
+
+static void memo_put(const hash_memo *entry)
+{
+    if ((memo_count + 1) * 4 > memo_cap * 3)
+    {
+        size_t new_cap = memo_cap ? memo_cap * 2 : 1024;
+        hash_memo *grown = calloc(new_cap, sizeof(hash_memo));
+        if (!grown) return;
+        for (size_t i = 0; i < memo_cap; ++i)
+        {
+            if (!memo[i].key) continue;
+            size_t s = memo[i].key & (new_cap - 1);
+            while (grown[s].key) s = (s + 1) & (new_cap - 1);
+            grown[s] = memo[i];
+        }
+        free(memo);
+        memo = grown;
+        memo_cap = new_cap;
+    }
+    size_t s = entry->key & (memo_cap - 1);
+    while (memo[s].key && memo[s].key != entry->key) s = (s + 1) & (memo_cap - 1);
+    if (!memo[s].key) memo_count++;
+    memo[s] = *entry;
+}
+
+static void memo_clear(void)
+{
+    free(memo);
+    memo = NULL;
+    memo_cap = memo_count = 0;
+}
+
+/* -------------------------------------------------
+   Writing
+   ------------------------------------------------- */
+
+static int cmp_stamps(const void *a, const void *b)
+{
+    return strcmp(((const dir_stamp *)a)->path, ((const dir_stamp *)b)->path);
+}
+
+/* Index of the directory `path`[0, len) in the sorted stamps, or -1 */
+static long find_stamp(const dir_stamp *stamps, unsigned int count, const char *path, size_t len)
+{
+    unsigned int lo = 0, hi = count;
+    while (lo < hi)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+        const char *dir = stamps[mid].path;
+        int c = strncmp(path, dir, len);
+        if (c == 0 && dir[len] != '\0') c = -1;
+        if (c == 0) return mid;
+        if (c < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return -1;
+}
+
+/* `paths` sorted by cmp_strings, `stamps` by strcmp. Hashes are carried
+   over from `old` (same order, so one merge pass) and, if `with_memo`,
+   the memo; the caller then holds catalog_mutex. */
+static bool write_catalog(const char *root, bool recursive,
+                          char *const *paths, unsigned int count,
+                          const dir_stamp *stamps, unsigned int stamp_count,
+                          const catalog_view *old, bool with_memo)
+{
+    char *file = catalog_file_path(root, recursive);
+    char *tmp = NULL;
+    if (!file || asprintf(&tmp, "%s.%d.tmp", file, (int)getpid()) == -1) {
+        free(file);
+        return false;
+    }
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        fprintf(stderr, "Failed to write catalog %s\n", tmp);
+        free(tmp);
+        free(file);
+        return false;
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    uint64_t strings_size = strlen(root) + 1;
+    for (unsigned int i = 0; i < stamp_count; ++i) strings_size += strlen(stamps[i].path) + 1;
+    for (unsigned int i = 0; i < count; ++i) strings_size += strlen(paths[i]) + 1;
+
+    catalog_header h = {0};
+    memcpy(h.magic, CATALOG_MAGIC, 8);
+    h.version = CATALOG_VERSION;
+    h.recursive = recursive ? 1 : 0;
+    h.dir_count = stamp_count;
+    h.file_count = count;
+    h.strings_size = strings_size;
+    h.root = 0;
+    fwrite(&h, sizeof(h), 1, fp);
+
+    uint64_t offset = strlen(root) + 1;
+    for (unsigned int i = 0; i < stamp_count; ++i)
+    {
+        dir_record d = { stamps[i].mtime_ns, stamps[i].ino, offset };
+        fwrite(&d, sizeof(d), 1, fp);
+        offset += strlen(stamps[i].path) + 1;
+    }
+
+    bool ok = true;
+    uint64_t old_count = old && old->map ? old->hdr->file_count : 0;
+    uint64_t cursor = 0;
+    for (unsigned int i = 0; i < count && ok; ++i)
+    {
+        const char *path = paths[i];
+        const char *slash = strrchr(path, '/');
+        long dir = slash ? find_stamp(stamps, stamp_count, path, (size_t)(slash - path)) : -1;
+        if (dir < 0) {
+            /* Could never be revalidated; better no catalog than a wrong one */
+            fprintf(stderr, "Catalog: no directory stamp for %s\n", path);
+            ok = false;
+            break;
+        }
+        file_record f = { 0, 0, 0, 0, offset, (uint64_t)dir };
+        offset += strlen(path) + 1;
+
+        while (cursor < old_count)
+        {
+            const char *probe = old->strings + old->files[cursor].path;
+            int c = cmp_strings(&probe, &path);
+            if (c > 0) break;
+            if (c == 0) {
+                const file_record *o = &old->files[cursor];
+                f.content_hash = o->content_hash;
+                f.size = o->size;
+                f.mtime_ns = o->mtime_ns;
+                f.ino = o->ino;
+            }
+            cursor++;
+        }
+        const hash_memo *m = with_memo && memo_count ? memo_find(memo_key(path)) : NULL;
+        if (m) {
+            f.content_hash = m->content_hash;
+            f.size = m->size;
+            f.mtime_ns = m->mtime_ns;
+            f.ino = m->ino;
+        }
+        fwrite(&f, sizeof(f), 1, fp);
+    }
+
+    if (ok)
+    {
+        fwrite(root, strlen(root) + 1, 1, fp);
+        for (unsigned int i = 0; i < stamp_count; ++i)
+            fwrite(stamps[i].path, strlen(stamps[i].path) + 1, 1, fp);
+        for (unsigned int i = 0; i < count; ++i)
+            fwrite(paths[i], strlen(paths[i]) + 1, 1, fp);
+    }
+    if (ferror(fp)) ok = false;
+    if (fclose(fp) != 0) ok = false;
+    if (ok && rename(tmp, file) == -1) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Failed to write catalog %s\n", file);
+        unlink(tmp);
+    }
+    free(tmp);
+    free(file);
+    return ok;
+}
+
+/* Writes a fresh catalog and maps it if (root, recursive) is current.
+   Sorts `stamps`. Caller holds catalog_mutex. */
+static void write_and_adopt(const char *root, bool recursive, char *const *paths,
+                            unsigned int count, dir_stamp *stamps, unsigned int stamp_count)
+{
+    qsort(stamps, stamp_count, sizeof(dir_stamp), cmp_stamps);
+    /* A root that could not be read has no stamp to notice it appear */
+    if (find_stamp(stamps, stamp_count, root, strlen(root)) < 0) return;
+    if (!write_catalog(root, recursive, paths, count, stamps, stamp_count, NULL, true)) return;
+    if (current_root && !current.map && current_recursive == recursive &&
+        strcmp(current_root, root) == 0)
+    {
+        char *file = catalog_file_path(root, recursive);
+        if (file) view_open(&current, file, root, recursive);
+        free(file);
+    }
+}
+
+/* -------------------------------------------------
+   Loading
+   ------------------------------------------------- */
+
+static void stamp_push(stamp_list *list, char *path, int64_t mtime, uint64_t ino)
+{
+    if (!path) return;
+    if (list->count == list->cap)
+    {
+        unsigned int new_cap = list->cap ? list->cap * 2 : 64;
+        dir_stamp *items = realloc(list->items, new_cap * sizeof(dir_stamp));
+        if (!items) {
+            free(path);
+            return;
+        }
+        list->items = items;
+        list->cap = new_cap;
+    }
+    list->items[list->count++] = (dir_stamp){ path, mtime, ino };
+}
+
+static void stamp_list_free(stamp_list *list)
+{
+    for (unsigned int i = 0; i < list->count; ++i)
+        free(list->items[i].path);
+    free(list->items);
+    *list = (stamp_list){0};
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    char *full = NULL;
+    if (asprintf(&full, "%s/%s", dir, name) == -1) return NULL;
+    return full;
+}
+
+/* A folder the catalog never saw: walk all of it */
+static void scan_new_tree(const char *dir, file_list *found, stamp_list *stamps)
+{
+    file_scan *scan = file_scan_start(dir, true, 0);
+    if (!scan) return;
+    file_list chunk = {0};
+    while (file_scan_next(scan, &chunk, 1000))
+        file_list_splice(found, &chunk);
+    unsigned int n = 0;
+    dir_stamp *taken = file_scan_take_dirs(scan, &n);
+    for (unsigned int i = 0; i < n; ++i)
+        stamp_push(stamps, taken[i].path, taken[i].mtime_ns, taken[i].ino);
+    free(taken);
+    file_list_free(&chunk);
+    file_scan_free(scan);
+}
+
+/* Entries came or went in `dir`: read it again, one level */
+static void rescan_dir(const catalog_view *v, const char *dir, bool recursive,
+                       file_list *found, stamp_list *stamps)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return;
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) stamp_push(stamps, strdup(dir), mtime_ns(&st), st.st_ino);
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK)
+        {
+            if (fstatat(fd, name, &st, 0) == -1) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_REG && has_image_extension(name))
+        {
+            char *full = join_path(dir, name);
+            if (full) file_list_append(found, full);
+            free(full);
+        }
+        else if (type == DT_DIR && recursive)
+        {
+            /* Known sub-folders are checked against their own stamp */
+            char *sub = join_path(dir, name);
+            if (sub && !view_has_dir(v, sub)) scan_new_tree(sub, found, stamps);
+            free(sub);
+        }
+    }
+    closedir(d);
+}
+
+enum { DIR_SAME, DIR_CHANGED, DIR_GONE };
+
+/* Makes (root, recursive) the catalog hashes are looked up in and
+   stored for; takes ownership of `root` and `v` */
+static void publish_current(char *root, bool recursive, catalog_view *v)
+{
+    pthread_mutex_lock(&catalog_mutex);
+    /* A load that raced this one is replaced, its hashes unsaved */
+    view_close(&current);
+    memo_clear();
+    free(current_root);
+    current_root = root;
+    current_recursive = recursive;
+    current = *v;
+    pthread_mutex_unlock(&catalog_mutex);
+    *v = (catalog_view){0};
+}
+
+/* Stats and rescans work on a private view: prep threads looking up
+   hashes are not held up by a slow folder walk */
+bool catalog_load(const char *root, bool recursive, file_list *out)
+{
+    *out = (file_list){0};
+    catalog_close();
+    char *norm = normalize_root(root);
+    if (!norm) return false;
+
+    char *file = catalog_file_path(norm, recursive);
+    catalog_view v = {0};
+    if (!file || !view_open(&v, file, norm, recursive) || !view_has_dir(&v, norm)) {
+        /* The scan that follows writes a catalog and adopts it */
+        free(file);
+        view_close(&v);
+        publish_current(norm, recursive, &v);
+        return false;
+    }
+    free(file);
+
+    /* Only directories are stat'ed: their stamps vouch for the files */
+    uint64_t dir_count = v.hdr->dir_count;
+    uint64_t file_count = v.hdr->file_count;
+    unsigned char *state = malloc(dir_count ? dir_count : 1);
+    /* One block takes every string the catalog lists */
+    if (!state || !file_list_reserve(out, (unsigned int)file_count, v.hdr->strings_size)) {
+        free(state);
+        file_list_free(out);
+        view_close(&v);
+        publish_current(norm, recursive, &v);
+        return false;
+    }
+
+    stamp_list stamps = {0};
+    unsigned int changed = 0;
+    for (uint64_t i = 0; i < dir_count; ++i)
+    {
+        const char *path = v.strings + v.dirs[i].path;
+        struct stat st;
+        if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+            state[i] = DIR_GONE;
+        else if (mtime_ns(&st) == v.dirs[i].mtime_ns && (uint64_t)st.st_ino == v.dirs[i].ino) {
+            state[i] = DIR_SAME;
+            stamp_push(&stamps, strdup(path), mtime_ns(&st), st.st_ino);
+            continue;
+        }
+        else
+            state[i] = DIR_CHANGED;
+        changed++;
+    }
+
+    /* Already in panel order */
+    for (uint64_t i = 0; i < file_count; ++i)
+        if (state[v.files[i].dir] == DIR_SAME)
+            file_list_append(out, v.strings + v.files[i].path);
+
+    if (changed)
+    {
+        file_list found = {0};
+        for (uint64_t i = 0; i < dir_count; ++i)
+            if (state[i] == DIR_CHANGED)
+                rescan_dir(&v, v.strings + v.dirs[i].path, recursive, &found, &stamps);
+        file_list_sort(&found);
+        file_list_merge(out, &found);
+        file_list_free(&found);
+
+        /* Nothing is memoized for this root before it is published */
+        qsort(stamps.items, stamps.count, sizeof(dir_stamp), cmp_stamps);
+        write_catalog(norm, recursive, out->paths, out->count, stamps.items, stamps.count, &v, false);
+        view_close(&v);
+        file = catalog_file_path(norm, recursive);
+        if (file) view_open(&v, file, norm, recursive);
+        free(file);
+        fprintf(stderr, "Catalog: %u of %" PRIu64 " folders changed\n", changed, dir_count);
+    }
+    publish_current(norm, recursive, &v);
+    stamp_list_free(&stamps);
+    free(state);
+    return true;
+}
+
+catalog_build *catalog_build_begin(const char *root, bool recursive)
+{
+    catalog_build *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->root = normalize_root(root);
+    b->recursive = recursive;
+    if (!b->root) {
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+void catalog_build_add(catalog_build *b, const file_list *chunk)
+{
+    if (!b) return;
+    for (unsigned int i = 0; i < chunk->count; ++i)
+    {
+        size_t len = strlen(chunk->paths[i]) + 1;
+        if (b->blob_len + len > b->blob_cap)
+        {
+            size_t new_cap = b->blob_cap ? b->blob_cap * 2 : 64 * 1024;
+            while (new_cap < b->blob_len + len) new_cap *= 2;
+            char *blob = realloc(b->blob, new_cap);
+            if (!blob) return;
+            b->blob = blob;
+            b->blob_cap = new_cap;
+        }
+        if (b->count == b->cap)
+        {
+            unsigned int new_cap = b->cap ? b->cap * 2 : 1024;
+            size_t *offsets = realloc(b->offsets, new_cap * sizeof(size_t));
+            if (!offsets) return;
+            b->offsets = offsets;
+            b->cap = new_cap;
+        }
+        memcpy(b->blob + b->blob_len, chunk->paths[i], len);
+        b->offsets[b->count++] = b->blob_len;
+        b->blob_len += len;
+    }
+}
+
+void catalog_build_finish(catalog_build *b, file_scan *scan)
+{
+    if (!b) return;
+    unsigned int stamp_count = 0;
+    dir_stamp *stamps = file_scan_take_dirs(scan, &stamp_count);
+    char **paths = malloc((b->count ? b->count : 1) * sizeof(char *));
+    if (paths)
+    {
+        for (unsigned int i = 0; i < b->count; ++i)
+            paths[i] = b->blob + b->offsets[i];
+        qsort(paths, b->count, sizeof(char *), cmp_strings);
+
+        pthread_mutex_lock(&catalog_mutex);
+        write_and_adopt(b->root, b->recursive, paths, b->count, stamps, stamp_count);
+        pthread_mutex_unlock(&catalog_mutex);
+        free(paths);
+    }
+    for (unsigned int i = 0; i < stamp_count; ++i)
+        free(stamps[i].path);
+    free(stamps);
+    catalog_build_abort(b);
+}
+
+void catalog_build_abort(catalog_build *b)
+{
+    if (!b) return;
+    free(b->root);
+    free(b->blob);
+    free(b->offsets);
+    free(b);
+}
+
+file_list catalog_load_files(const char *root, bool recursive)
+{
+    file_list list = {0};
+    if (catalog_load(root, recursive, &list)) return list;
+
+    file_scan *scan = file_scan_start(root, recursive, 0);
+    if (!scan) return list;
+    while (file_scan_next(scan, &list, 1000))
+        ;
+    file_list_sort(&list);
+
+    char *norm = normalize_root(root);
+    unsigned int stamp_count = 0;
+    dir_stamp *stamps = file_scan_take_dirs(scan, &stamp_count);
+    if (norm)
+    {
+        pthread_mutex_lock(&catalog_mutex);
+        write_and_adopt(norm, recursive, list.paths, list.count, stamps, stamp_count);
+        pthread_mutex_unlock(&catalog_mutex);
+    }
+    for (unsigned int i = 0; i < stamp_count; ++i)
+        free(stamps[i].path);
+    free(stamps);
+    free(norm);
+    file_scan_free(scan);
+    return list;
+}
+
+/* -------------------------------------------------
+   Content hashes
+   ------------------------------------------------- */
+
+bool catalog_lookup_hash(const char *path, const struct stat *st, uint64_t *hash)
+{
+    bool found = false;
+    pthread_mutex_lock(&catalog_mutex);
+    if (current_root)
+    {
+        const hash_memo *m = memo_find(memo_count ? memo_key(path) : 0);
+        const file_record *f = m ? NULL : view_find_file(&current, path);
+        if (m && stat_matches(m->size, m->mtime_ns, m->ino, st)) {
+            *hash = m->content_hash;
+            found = true;
+        } else if (f && f->content_hash && stat_matches(f->size, f->mtime_ns, f->ino, st)) {
+            *hash = f->content_hash;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&catalog_mutex);
+    return found;
+}
+
+void catalog_store_hash(const char *path, const struct stat *st, uint64_t hash)
+{
+    pthread_mutex_lock(&catalog_mutex);
+    if (current_root)
+    {
+        const file_record *f = view_find_file(&current, path);
+        if (!(f && f->content_hash == hash && stat_matches(f->size, f->mtime_ns, f->ino, st)))
+        {
+            hash_memo m = { memo_key(path), (uint64_t)st->st_size, mtime_ns(st),
+                            (uint64_t)st->st_ino, hash };
+            memo_put(&m);
+        }
+    }
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+void catalog_close(void)
+{
+    pthread_mutex_lock(&catalog_mutex);
+    if (current_root && current.map && memo_count > 0)
+    {
+        /* Same listing and stamps as loaded, plus the new hashes */
+        uint64_t file_count = current.hdr->file_count;
+        uint64_t dir_count = current.hdr->dir_count;
+        char **paths = malloc((file_count ? file_count : 1) * sizeof(char *));
+        dir_stamp *stamps = malloc((dir_count ? dir_count : 1) * sizeof(dir_stamp));
+        if (paths && stamps)
+        {
+            for (uint64_t i = 0; i < file_count; ++i)
+                paths[i] = (char *)current.strings + current.files[i].path;
+            for (uint64_t i = 0; i < dir_count; ++i)
+                stamps[i] = (dir_stamp){ (char *)current.strings + current.dirs[i].path,
+                                         current.dirs[i].mtime_ns, current.dirs[i].ino };
+            write_catalog(current_root, current_recursive, paths, (unsigned int)file_count,
+                          stamps, (unsigned int)dir_count, &current, true);
+        }
+        free(paths);
+        free(stamps);
+    }
+    view_close(&current);
+    memo_clear();
+    free(current_root);
+    current_root = NULL;
+    pthread_mutex_unlock(&catalog_mutex);
+}
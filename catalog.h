@@ -0,0 +1,45 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "files.h"
+
+/* -------------------------------------------------
+   On-disk catalog per loaded folder
+   A memory-mapped snapshot of the sorted path table, the stamp of
+   every directory and the content hash of every file hashed so far.
+   Reopening a folder only stats its directories; files are re-read
+   only when their size, mtime or inode changed.
+   ------------------------------------------------- */
+
+/* Makes (root, recursive) the current catalog and lists the folder
+   from it: directories whose stamp still matches are taken as they
+   are, the others are read again (and the catalog rewritten). Returns
+   false, leaving `out` empty, if there is no usable catalog yet. */
+bool catalog_load(const char *root, bool recursive, file_list *out);
+
+/* No catalog yet: record a full scan while it streams */
+typedef struct catalog_build catalog_build;
+catalog_build *catalog_build_begin(const char *root, bool recursive);
+/* Copies the paths of a scanned chunk */
+void catalog_build_add(catalog_build *b, const file_list *chunk);
+/* The walk completed: writes the catalog with the scan's directories
+   and, if (root, recursive) is still current, maps it */
+void catalog_build_finish(catalog_build *b, file_scan *scan);
+void catalog_build_abort(catalog_build *b);
+
+/* Blocking load: from the catalog, else a full scan that writes it.
+   Always sorted. */
+file_list catalog_load_files(const char *root, bool recursive);
+
+/* Content hash remembered for `path`, if `st` still matches the stat
+   it was taken with */
+bool catalog_lookup_hash(const char *path, const struct stat *st, uint64_t *hash);
+void catalog_store_hash(const char *path, const struct stat *st, uint64_t hash);
+
+/* Writes back hashes learned since the load and unmaps */
+void catalog_close(void);
+
+#endif
@@ -0,0 +1,580 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <curl/curl.h>
+#include <jansson.h>
+#include "llm.h"
+#include "files.h"
+#include "options.h"
+#include "cache.h"
+#include "catalog.h"
+#include "rank.h"
+#include "embed.h"
+#include "dedup.h"
+#include "backend.h"
+#include "metrics.h"
+
+/* -------------------------------------------------
+   Headless batch search: same loader, encoder and LLM client as the
+   GUI, one JSON line per image on the output, summary on stderr.
+   ------------------------------------------------- */
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_sigint(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s --dir DIR --query PHRASE [--query PHRASE ...] [options]\n"
+            "  --dir DIR             directory to search\n"
+            "  -r, --recursive       include sub-folders\n"
+            "  -q, --query PHRASE    what the images should contain; repeat to ask\n"
+            "                        up to %d questions in one upload per image\n"
+            "  -o, --out FILE        JSON lines output (default stdout)\n"
+            "  -v, --verbose         print progress to stdout/stderr\n"
+            "  --prefilter N         ask only about the N images whose embeddings\n"
+            "                        are closest to the query\n"
+            "  --embed-url URL       embeddings endpoint (default %s)\n"
+            "  --embed-model NAME    embedding model (default %s)\n"
+            "  --dedup D             ask once per group of near-duplicate images\n"
+            "                        (perceptual hashes within D of %d bits)\n"
+            "  --dedup-verify        also ask group members whose answer is borderline\n",
+            prog, LLM_MAX_QUERIES, llm_opts.embed_url, llm_opts.embed_model, 64);
+    print_common_usage();
+}
+
+static const char *verdict_name(signed char v)
+{
+    return v > 0 ? "yes" : v == 0 ? "no" : NULL;
+}
+
+/* `duplicate_of`: the answer was copied from this near-duplicate */
+static void write_result_line(FILE *out, const llm_result *r, const char *const *queries,
+                              const char *duplicate_of)
+{
+    json_t *line = json_object();
+    json_object_set_new(line, "path", json_string(r->path));
+    if (duplicate_of)
+        json_object_set_new(line, "duplicate_of", json_string(duplicate_of));
+    json_object_set_new(line, "ok", json_boolean(r->ok));
+    json_object_set_new(line, "verdict", r->ok ? json_string(r->keep ? "yes" : "no") : json_null());
+    if (r->query_count > 1)
+    {
+        /* Per-phrase verdicts; the overall one is "yes" unless any is "no" */
+        json_t *per_query = json_object();
+        for (int i = 0; i < r->query_count; ++i)
+        {
+            const char *v = r->ok ? verdict_name(r->verdicts[i]) : NULL;
+            json_object_set_new(per_query, queries[i], v ? json_string(v) : json_null());
+        }
+        json_object_set_new(line, "queries", per_query);
+    }
+    json_object_set_new(line, "answer", r->answer ? json_string(r->answer) : json_null());
+    if (r->p_yes >= 0)
+        json_object_set_new(line, "p_yes", json_real(r->p_yes));
+    if (r->score >= 0)
+        json_object_set_new(line, "score", json_real(r->score));
+    json_object_set_new(line, "cached", json_boolean(r->cached));
+    json_object_set_new(line, "file_bytes", json_integer((json_int_t)r->file_bytes));
+    json_object_set_new(line, "upload_bytes", json_integer((json_int_t)r->upload_bytes));
+
+    json_t *timings = json_object();
+    json_object_set_new(timings, "queue", json_real(r->queue_ms));
+    json_object_set_new(timings, "prep", json_real(r->prep_ms));
+    json_object_set_new(timings, "read", json_real(r->read_ms));
+    json_object_set_new(timings, "encode", json_real(r->encode_ms));
+    json_object_set_new(timings, "request", json_real(r->request_ms));
+    if (r->first_byte_ms > 0)
+    {
+        json_object_set_new(timings, "wait", json_real(r->wait_ms));
+        json_object_set_new(timings, "connect", json_real(r->connect_ms));
+        json_object_set_new(timings, "upload", json_real(r->upload_ms));
+        json_object_set_new(timings, "first_byte", json_real(r->first_byte_ms));
+    }
+    json_object_set_new(timings, "parse", json_real(r->parse_ms));
+    json_object_set_new(timings, "total", json_real(r->total_ms));
+    json_object_set_new(line, "timings_ms", timings);
+
+    char *text = json_dumps(line, JSON_COMPACT);
+    if (text) {
+        fprintf(out, "%s\n", text);
+        fflush(out);
+        free(text);
+    }
+    json_decref(line);
+}
+
+/* Ranked runs end with {"top_k": [{"path": ..., "score": ...}, ...]}, best first */
+static void write_ranking(FILE *out, const top_k *ranking)
+{
+    rank_entry *sorted = malloc((ranking->k ? ranking->k : 1) * sizeof(rank_entry));
+    if (!sorted) return;
+    int n = top_k_sorted(ranking, sorted);
+    json_t *list = json_array();
+    for (int i = 0; i < n; ++i)
+    {
+        json_t *entry = json_object();
+        json_object_set_new(entry, "path", json_string(sorted[i].path));
+        json_object_set_new(entry, "score", json_real(sorted[i].score));
+        json_array_append_new(list, entry);
+    }
+    json_t *line = json_object();
+    json_object_set_new(line, "top_k", list);
+    char *text = json_dumps(line, JSON_COMPACT);
+    if (text) {
+        fprintf(out, "%s\n", text);
+        free(text);
+    }
+    json_decref(line);
+    free(sorted);
+}
+
+/* -------------------------------------------------
+   Prefilter: embed every image once (the index remembers them across
+   runs), embed each query as text and keep the `keep` images closest
+   to all of them. Only those are asked the yes/no questions.
+   ------------------------------------------------- */
+
+static char **prefilter(const file_list *files, const char *const *queries, int query_count,
+                        int keep, unsigned int *out_count, bool verbose)
+{
+    double t_start = now_seconds();
+    float *query_vecs[LLM_MAX_QUERIES] = {0};
+    int dims[LLM_MAX_QUERIES];
+    for (int q = 0; q < query_count; ++q)
+        if (!(query_vecs[q] = llm_embed_text(queries[q], &dims[q]))) {
+            fprintf(stderr, "Failed to embed the query \"%s\"\n", queries[q]);
+            goto fail;
+        }
+
+    char **paths = malloc((files->count ? files->count : 1) * sizeof(char *));
+    uint64_t *hashes = malloc((files->count ? files->count : 1) * sizeof(uint64_t));
+    if (!paths || !hashes) {
+        free(paths);
+        free(hashes);
+        goto fail;
+    }
+    int embedded = 0, reused = 0, in_flight = 0;
+    bool cancelled = false;
+    unsigned int next = 0;
+    int max_in_flight = app_opts.jobs * 2;
+    for (;;)
+    {
+        while (!stop_requested && in_flight < max_in_flight && next < files->count)
+        {
+            const char *path = files->paths[next++];
+            if (!has_image_extension(path)) continue;
+            if (!llm_pool_submit_embed(path, 0)) break;
+            in_flight++;
+        }
+        if (stop_requested && !cancelled) {
+            cancelled = true;
+            in_flight -= llm_pool_cancel();
+        }
+        if (in_flight == 0) break;
+
+        llm_result r;
+        if (!llm_pool_wait(&r, 200)) continue;
+        in_flight--;
+        if (r.ok) {
+            paths[embedded] = r.path;
+            hashes[embedded++] = r.content_hash;
+            r.path = NULL;
+            if (r.cached) reused++;
+        } else if (verbose && !r.cancelled) {
+            fprintf(stderr, "Failed to embed %s\n", r.path);
+        }
+        llm_result_free(&r);
+    }
+
+    /* A candidate has to be close to every query: rank by the lowest */
+    float *scores = malloc((embedded ? embedded : 1) * sizeof(float));
+    float *worst = malloc((embedded ? embedded : 1) * sizeof(float));
+    top_k nearest = {0};
+    char **kept = NULL;
+    unsigned int kept_count = 0;
+    if (scores && worst && top_k_init(&nearest, keep))
+    {
+        for (int i = 0; i < embedded; ++i) worst[i] = 2.0f;
+        for (int q = 0; q < query_count; ++q)
+        {
+            embed_index_score(query_vecs[q], dims[q], hashes, embedded, scores);
+            for (int i = 0; i < embedded; ++i)
+                if (scores[i] < worst[i]) worst[i] = scores[i];
+        }
+        for (int i = 0; i < embedded; ++i)
+            if (worst[i] > -2.0f) top_k_offer(&nearest, paths[i], worst[i]);
+
+        rank_entry *sorted = malloc(keep * sizeof(rank_entry));
+        kept = malloc(keep * sizeof(char *));
+        int n = sorted && kept ? top_k_sorted(&nearest, sorted) : 0;
+        for (int i = 0; i < n; ++i)
+            if ((kept[kept_count] = strdup(sorted[i].path))) kept_count++;
+        free(sorted);
+    }
+    top_k_free(&nearest);
+    free(scores);
+    free(worst);
+    for (int i = 0; i < embedded; ++i) free(paths[i]);
+    free(paths);
+    free(hashes);
+    for (int q = 0; q < query_count; ++q) free(query_vecs[q]);
+
+    if (verbose)
+        fprintf(stderr, "Prefilter: %d images embedded (%d from the index), %u candidates "
+                "(%s dot product, %.2f s)\n", embedded, reused, kept_count,
+                embed_dot_impl_name(), now_seconds() - t_start);
+    *out_count = kept_count;
+    return kept;
+
+fail:
+    for (int q = 0; q < query_count; ++q) free(query_vecs[q]);
+    *out_count = 0;
+    return NULL;
+}
+
+/* -------------------------------------------------
+   Near-duplicate groups over the images to ask about: only the
+   representative of a group is sent, the members take its answer
+   ------------------------------------------------- */
+
+typedef struct {
+    unsigned int *rep;
+    unsigned char *distance;
+    unsigned int *first_member;     /* per representative, UINT_MAX = none */
+    unsigned int *next_member;
+    unsigned int *verify;           /* members to ask about themselves */
+    unsigned int verify_count;
+    int max_distance;
+} dup_groups;
+
+static void dup_groups_free(dup_groups *g)
+{
+    free(g->rep);
+    free(g->distance);
+    free(g->first_member);
+    free(g->next_member);
+    free(g->verify);
+    memset(g, 0, sizeof(*g));
+}
+
+static bool dup_groups_build(dup_groups *g, char **paths, unsigned int n, int max_distance,
+                             bool verbose)
+{
+    double t_start = now_seconds();
+    size_t count = n ? n : 1;
+    uint64_t *hashes = malloc(count * sizeof(uint64_t));
+    bool *ok = malloc(count * sizeof(bool));
+    g->rep = malloc(count * sizeof(unsigned int));
+    g->distance = malloc(count);
+    g->first_member = malloc(count * sizeof(unsigned int));
+    g->next_member = malloc(count * sizeof(unsigned int));
+    g->verify = malloc(count * sizeof(unsigned int));
+    g->verify_count = 0;
+    g->max_distance = max_distance;
+    if (!hashes || !ok || !g->rep || !g->distance || !g->first_member ||
+        !g->next_member || !g->verify) {
+        free(hashes);
+        free(ok);
+        dup_groups_free(g);
+        return false;
+    }
+
+    dedup_hash_files(paths, n, 0, hashes, ok);
+    unsigned int groups = dedup_cluster(hashes, ok, n, max_distance, g->rep, g->distance);
+    free(hashes);
+    free(ok);
+
+    /* Members in list order behind their representative */
+    memset(g->first_member, 0xFF, count * sizeof(unsigned int));
+    for (unsigned int i = n; i-- > 0; )
+    {
+        if (g->rep[i] == i) continue;
+        g->next_member[i] = g->first_member[g->rep[i]];
+        g->first_member[g->rep[i]] = i;
+    }
+    if (verbose)
+        fprintf(stderr, "Dedup: %u images in %u groups (%.2f s)\n",
+                n, groups, now_seconds() - t_start);
+    return true;
+}
+
+/* With --dedup-verify a member is asked itself when the group's answer
+   is unsure: P(yes) near 0.5 when known, else a member in the outer
+   half of the distance limit */
+static bool borderline(const dup_groups *g, const llm_result *r, unsigned int member)
+{
+    if (r->p_yes >= 0) return r->p_yes > 0.2f && r->p_yes < 0.8f;
+    return g->distance[member] * 2 > g->max_distance;
+}
+
+typedef struct {
+    int images, kept, rejected, errors, cached;
+    int duplicates;         /* answered from their group's representative */
+} batch_counts;
+
+static void count_result(batch_counts *c, const llm_result *r)
+{
+    c->images++;
+    if (!r->ok) c->errors++;
+    else if (r->keep) c->kept++;
+    else c->rejected++;
+    if (r->cached) c->cached++;
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = NULL;
+    const char *queries[LLM_MAX_QUERIES];
+    int query_count = 0;
+    const char *out_path = NULL;
+    bool recursive = false;
+    bool verbose = false;
+    int prefilter_keep = 0;
+    int dedup = -1;
+    bool dedup_verify = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--dir") == 0 && has_value)
+            dir = argv[++i];
+        else if ((strcmp(arg, "-q") == 0 || strcmp(arg, "--query") == 0) && has_value)
+        {
+            if (query_count == LLM_MAX_QUERIES) {
+                fprintf(stderr, "At most %d queries per run\n", LLM_MAX_QUERIES);
+                return 1;
+            }
+            if (*argv[i + 1]) queries[query_count++] = argv[i + 1];
+            i++;
+        }
+        else if ((strcmp(arg, "-o") == 0 || strcmp(arg, "--out") == 0) && has_value)
+            out_path = argv[++i];
+        else if (strcmp(arg, "-r") == 0 || strcmp(arg, "--recursive") == 0)
+            recursive = true;
+        else if (strcmp(arg, "-v") == 0 || strcmp(arg, "--verbose") == 0)
+            verbose = true;
+        else if (strcmp(arg, "--prefilter") == 0 && has_value)
+            prefilter_keep = atoi(argv[++i]);
+        else if (strcmp(arg, "--embed-url") == 0 && has_value)
+            llm_opts.embed_url = argv[++i];
+        else if (strcmp(arg, "--embed-model") == 0 && has_value)
+            llm_opts.embed_model = argv[++i];
+        else if (strcmp(arg, "--dedup") == 0 && has_value)
+            dedup = atoi(argv[++i]);
+        else if (strcmp(arg, "--dedup-verify") == 0)
+            dedup_verify = true;
+        else
+        {
+            option_result res = parse_common_option(argc, argv, &i);
+            if (res == OPTION_UNKNOWN) usage(argv[0]);
+            if (res != OPTION_TAKEN) return 1;
+        }
+    }
+    if (!dir || query_count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (dedup > DEDUP_MAX_DISTANCE) {
+        fprintf(stderr, "--dedup takes a distance from 0 to %d\n", DEDUP_MAX_DISTANCE);
+        return 1;
+    }
+    apply_common_options();
+    llm_log_progress = verbose;
+    bool ranked = app_opts.top_k > 0;
+    if (ranked && query_count != 1) {
+        fprintf(stderr, "Ranking (--top-k) takes exactly one --query\n");
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (out_path && !(out = fopen(out_path, "w"))) {
+        fprintf(stderr, "Cannot write %s\n", out_path);
+        return 1;
+    }
+
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    double t_start = now_seconds();
+    file_list files;
+    if (app_opts.use_catalog) {
+        files = catalog_load_files(dir, recursive);
+    } else {
+        files = load_files(dir, recursive);
+        file_list_sort(&files);
+    }
+    double t_loaded = now_seconds();
+
+    /* Everything the exit path below releases, failed start or not */
+    int status = 1;
+    char **todo = files.paths;
+    unsigned int todo_count = files.count;
+    char **candidates = NULL;
+    dup_groups groups = {0};
+    top_k ranking = {0};
+    batch_counts counts = {0};
+
+    if (!llm_pool_start(app_opts.jobs)) {
+        fprintf(stderr, "Failed to start LLM worker pool\n");
+        goto done;
+    }
+
+    /* The images to ask about: all of them, or the prefilter's picks */
+    if (prefilter_keep > 0)
+    {
+        if (!embed_index_open(llm_opts.embed_model) ||
+            !(candidates = prefilter(&files, queries, query_count, prefilter_keep,
+                                     &todo_count, verbose)))
+            goto done;
+        todo = candidates;
+    }
+
+    bool grouped = dedup >= 0 && todo_count > 0;
+    if (grouped && !dup_groups_build(&groups, todo, todo_count, dedup, verbose)) {
+        fprintf(stderr, "Out of memory\n");
+        goto done;
+    }
+
+    /* Keep some prepared images queued behind the ones on the wire */
+    int max_in_flight = app_opts.jobs * 2;
+    unsigned int next = 0;
+    int in_flight = 0;
+    if (ranked && !top_k_init(&ranking, app_opts.top_k)) {
+        fprintf(stderr, "Out of memory\n");
+        goto done;
+    }
+    bool settled = false;   /* --stable reached: stop early */
+    bool cancelled = false; /* Ctrl-C: what is on the wire was aborted */
+
+    for (;;)
+    {
+        while (!stop_requested && !settled && in_flight < max_in_flight)
+        {
+            unsigned int idx;
+            bool verifying = groups.verify_count > 0;
+            if (verifying) idx = groups.verify[--groups.verify_count];
+            else if (next < todo_count) idx = next++;
+            else break;
+            const char *path = todo[idx];
+            if (!has_image_extension(path)) continue;
+            /* Members wait for their representative's answer */
+            if (grouped && groups.rep[idx] != idx && !verifying) continue;
+            /* The batch id carries the index into todo back with the result */
+            bool queued = ranked ? llm_pool_submit_rank(path, queries[0], idx)
+                                 : llm_pool_submit_multi(path, queries, query_count, idx);
+            if (!queued) break;
+            in_flight++;
+        }
+        /* Interrupted: abort the requests instead of waiting them out */
+        if (stop_requested && !cancelled) {
+            cancelled = true;
+            in_flight -= llm_pool_cancel();
+        }
+        if (in_flight == 0) break;
+
+        llm_result r;
+        if (!llm_pool_wait(&r, 200)) continue;
+        in_flight--;
+        if (r.cancelled) {
+            llm_result_free(&r);
+            continue;
+        }
+        count_result(&counts, &r);
+        write_result_line(out, &r, queries, NULL);
+        if (ranked && r.ok && r.score >= 0) top_k_offer(&ranking, r.path, r.score);
+
+        unsigned int idx = r.batch;
+        for (unsigned int m = grouped && groups.rep[idx] == idx ? groups.first_member[idx] : UINT_MAX;
+             m != UINT_MAX; m = groups.next_member[m])
+        {
+            /* A failed or unsure answer is not passed on */
+            if (!r.ok || (dedup_verify && borderline(&groups, &r, m))) {
+                groups.verify[groups.verify_count++] = m;
+                continue;
+            }
+            llm_result copy = r;
+            copy.path = todo[m];
+            copy.cached = false;
+            copy.queue_ms = copy.prep_ms = copy.read_ms = copy.encode_ms = 0;
+            copy.request_ms = copy.wait_ms = copy.connect_ms = copy.upload_ms = 0;
+            copy.first_byte_ms = copy.parse_ms = copy.total_ms = 0;
+            copy.file_bytes = copy.upload_bytes = 0;
+            count_result(&counts, &copy);
+            counts.duplicates++;
+            write_result_line(out, &copy, queries, r.path);
+            if (ranked && copy.score >= 0) top_k_offer(&ranking, copy.path, copy.score);
+        }
+        llm_result_free(&r);
+
+        if (ranked && !settled && app_opts.stable > 0 &&
+            top_k_stable_for(&ranking) >= (unsigned long)app_opts.stable)
+        {
+            /* Queued images are dropped, the ones on the wire aborted */
+            settled = true;
+            in_flight -= llm_pool_cancel();
+            if (verbose)
+                fprintf(stderr, "Top %d unchanged for %d images, stopping\n",
+                        app_opts.top_k, app_opts.stable);
+        }
+    }
+
+    if (ranked) write_ranking(out, &ranking);
+
+    double elapsed = now_seconds() - t_start;
+    fprintf(stderr,
+            "%s%s%d images: %d kept, %d rejected, %d errors, %d cached "
+            "(scan %.2f s, total %.2f s, %.2f images/s)\n",
+            stop_requested ? "Interrupted after " : "",
+            settled ? "Ranking settled after " : "",
+            counts.images, counts.kept, counts.rejected, counts.errors, counts.cached,
+            t_loaded - t_start, elapsed, elapsed > 0 ? counts.images / elapsed : 0.0);
+    if (backend_count() > 1 || verbose)
+        backend_report(stderr);
+    if (verbose)
+        metrics_report(stderr);
+    unsigned long hedges, hedge_wins, retries;
+    llm_pool_tail_stats(&hedges, &hedge_wins, &retries);
+    if (hedges || retries)
+        fprintf(stderr, "Tail: %lu hedged requests (%lu answered first), %lu retries\n",
+                hedges, hedge_wins, retries);
+    if (llm_pool_streams_cut())
+        fprintf(stderr, "Streaming: %lu replies cut short once answered\n", llm_pool_streams_cut());
+    if (grouped)
+        fprintf(stderr, "Dedup saved %d LLM calls (answers copied from near-duplicates)\n",
+                counts.duplicates);
+    status = counts.errors ? 2 : 0;
+
+done:
+    llm_pool_stop();
+    metrics_stop();
+    top_k_free(&ranking);
+    dup_groups_free(&groups);
+    for (unsigned int i = 0; candidates && i < todo_count; ++i) free(candidates[i]);
+    free(candidates);
+    embed_index_close();
+    file_list_free(&files);
+    catalog_close();
+    verdict_cache_close();
+    curl_global_cleanup();
+    if (out != stdout) fclose(out);
+    return status;
+}
@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include "dedup.h"
+#include "image_prep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* -------------------------------------------------
+   dHash: shrink to 9x8 grey, one bit per horizontal neighbour pair
+   (left darker than right). JPEGs are decoded at a reduced DCT scale,
+   so hashing costs a fraction of a full decode.
+   ------------------------------------------------- */
+
+#define DHASH_W 9
+#define DHASH_H 8
+/* Smallest decoded edge worth averaging down from */
+#define DHASH_DECODE_EDGE 64
+
+static uint64_t dhash_pixels(const rgb_image *img)
+{
+    uint32_t sum[DHASH_H][DHASH_W] = {{0}};
+    uint32_t count[DHASH_H][DHASH_W] = {{0}};
+    int w = img->width, h = img->height;
+    uint16_t *luma = malloc(w * sizeof(uint16_t));
+    if (!luma) return 0;
+
+    for (int y = 0; y < h; ++y)
+    {
+        /* BT.601 weights in 8.8 fixed point; a plain loop the compiler vectorises */
+        const unsigned char *row = img->pixels + (size_t)y * w * 3;
+        for (int x = 0; x < w; ++x)
+            luma[x] = (uint16_t)((77 * row[3 * x] + 150 * row[3 * x + 1] + 29 * row[3 * x + 2]) >> 8);
+
+        int cy = (int)((int64_t)y * DHASH_H / h);
+        for (int x = 0; x < w; ++x)
+        {
+            int cx = (int)((int64_t)x * DHASH_W / w);
+            sum[cy][cx] += luma[x];
+            count[cy][cx]++;
+        }
+    }
+    free(luma);
+
+    uint64_t hash = 0;
+    for (int y = 0; y < DHASH_H; ++y)
+        for (int x = 0; x + 1 < DHASH_W; ++x)
+        {
+            /* Compare the averages without dividing: a/ca < b/cb */
+            uint64_t left = (uint64_t)sum[y][x] * (count[y][x + 1] ? count[y][x + 1] : 1);
+            uint64_t right = (uint64_t)sum[y][x + 1] * (count[y][x] ? count[y][x] : 1);
+            hash = hash << 1 | (left < right);
+        }
+    return hash;
+}
+
+bool dedup_hash_file(const char *path, uint64_t *hash)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    rgb_image img;
+    bool ok = image_decode(data, size, DHASH_DECODE_EDGE, &img);
+    munmap(data, size);
+    if (!ok) return false;
+    if (img.width < DHASH_W || img.height < DHASH_H) {
+        rgb_image_free(&img);
+        return false;
+    }
+    *hash = dhash_pixels(&img);
+    rgb_image_free(&img);
+    return true;
+}
+
+typedef struct {
+    char *const *paths;
+    unsigned int n;
+    unsigned int next;      /* atomic: next index to hash */
+    uint64_t *hashes;
+    bool *ok;
+} hash_work;
+
+static void *hash_worker(void *arg)
+{
+    hash_work *work = arg;
+    unsigned int i;
+    while ((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->n)
+        work->ok[i] = dedup_hash_file(work->paths[i], &work->hashes[i]);
+    return NULL;
+}
+
+void dedup_hash_files(char *const *paths, unsigned int n, int threads,
+                      uint64_t *hashes, bool *ok)
+{
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if ((unsigned int)threads > n) threads = n ? (int)n : 1;
+
+    hash_work work = { paths, n, 0, hashes, ok };
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    int started = 0;
+    while (tids && started < threads &&
+           pthread_create(&tids[started], NULL, hash_worker, &work) == 0)
+        started++;
+    /* Whatever no thread picked up runs here */
+    hash_worker(&work);
+    for (int t = 0; t < started; ++t)
+        pthread_join(tids[t], NULL);
+    free(tids);
+}
+
+/* -------------------------------------------------
+   Clustering: leader clustering over a band index. The 64 bits are
+   cut into at least max_distance + 1 bands, so two hashes within
+   max_distance agree exactly on at least one band (pigeonhole). Only
+   representatives sharing a band value are compared, which keeps the
+   work near linear instead of all pairs.
+   ------------------------------------------------- */
+
+unsigned int dedup_cluster(const uint64_t *hashes, const bool *ok, unsigned int n,
+                           int max_distance, unsigned int *rep, unsigned char *distance)
+{
+    if (max_distance < 0) max_distance = 0;
+    if (max_distance > DEDUP_MAX_DISTANCE) max_distance = DEDUP_MAX_DISTANCE;
+    /* At least 4 bands keeps the per-band tables at 2^16 heads */
+    int bands = max_distance + 1 < 4 ? 4 : max_distance + 1;
+    int bits = 64 / bands;
+    size_t heads_per_band = (size_t)1 << bits;
+    uint64_t mask = heads_per_band - 1;
+
+    int *heads = malloc((size_t)bands * heads_per_band * sizeof(int));
+    int *next = malloc((size_t)bands * (n ? n : 1) * sizeof(int));
+    unsigned int groups = 0;
+    if (!heads || !next)
+    {
+        /* No index: every image stands alone */
+        for (unsigned int i = 0; i < n; ++i) {
+            rep[i] = i;
+            distance[i] = 0;
+        }
+        free(heads);
+        free(next);
+        return n;
+    }
+    memset(heads, -1, (size_t)bands * heads_per_band * sizeof(int));
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        rep[i] = i;
+        distance[i] = 0;
+        if (!ok[i]) {
+            groups++;
+            continue;
+        }
+
+        int best = -1, best_distance = max_distance + 1;
+        for (int b = 0; b < bands && best_distance > 0; ++b)
+        {
+            int key = (int)((hashes[i] >> (b * bits)) & mask);
+            for (int r = heads[b * heads_per_band + key]; r != -1; r = next[(size_t)b * n + r])
+            {
+                int d = dedup_distance(hashes[i], hashes[r]);
+                if (d < best_distance) {
+                    best = r;
+                    best_distance = d;
+                }
+            }
+        }
+        if (best >= 0) {
+            rep[i] = (unsigned int)best;
+            distance[i] = (unsigned char)best_distance;
+            continue;
+        }
+
+        /* A new representative: index it under every band */
+        groups++;
+        for (int b = 0; b < bands; ++b)
+        {
+            int key = (int)((hashes[i] >> (b * bits)) & mask);
+            next[(size_t)b * n + i] = heads[b * heads_per_band + key];
+            heads[b * heads_per_band + key] = (int)i;
+        }
+    }
+    free(heads);
+    free(next);
+    return groups;
+}
@@ -0,0 +1,37 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* -------------------------------------------------
+   Near-duplicate detection
+   A 64-bit difference hash (dHash) per image: bursts, re-saves and
+   resized copies land within a few bits of each other, so a batch can
+   ask about one image per group and reuse its verdict for the rest.
+   ------------------------------------------------- */
+
+/* Largest Hamming distance dedup_cluster accepts */
+#define DEDUP_MAX_DISTANCE 15
+
+/* dHash of a JPEG or PNG file; false if it cannot be decoded */
+bool dedup_hash_file(const char *path, uint64_t *hash);
+
+/* Hashes paths[0..n) on `threads` threads (<= 0: one per core);
+   ok[i] tells whether hashes[i] is valid */
+void dedup_hash_files(char *const *paths, unsigned int n, int threads,
+                      uint64_t *hashes, bool *ok);
+
+static inline int dedup_distance(uint64_t a, uint64_t b)
+{
+    return __builtin_popcountll(a ^ b);
+}
+
+/* Groups images within `max_distance` bits of a representative, taken
+   in order: rep[i] is the index of the image's representative (i for
+   representatives and for images without a hash) and distance[i] its
+   distance to it. Returns the number of groups. */
+unsigned int dedup_cluster(const uint64_t *hashes, const bool *ok, unsigned int n,
+                           int max_distance, unsigned int *rep, unsigned char *distance);
+
+#endif
@@ -0,0 +1,342 @@
+#define _GNU_SOURCE
+#include "embed.h"
+#include "cache.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EMBED_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define EMBED_NEON 1
+#endif
+
+/* -------------------------------------------------
+   Dot product: scalar reference and SIMD versions with two
+   accumulators, picked once at runtime
+   ------------------------------------------------- */
+
+static float dot_scalar(const float *a, const float *b, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+#ifdef EMBED_X86
+__attribute__((target("sse2")))
+static float dot_sse2(const float *a, const float *b, int n)
+{
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + dot_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float *a, const float *b, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum) + dot_scalar(a + i, b + i, n - i);
+}
+#endif /* EMBED_X86 */
+
+#ifdef EMBED_NEON
+static float dot_neon(const float *a, const float *b, int n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1)) + dot_scalar(a + i, b + i, n - i);
+}
+#endif /* EMBED_NEON */
+
+typedef float (*dot_fn)(const float *a, const float *b, int n);
+
+static const char *best_name = NULL;
+static dot_fn best_dot = NULL;
+
+static void detect_dot(void)
+{
+    const char *name = "scalar";
+    dot_fn fn = dot_scalar;
+#ifdef EMBED_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) { name = "sse2"; fn = dot_sse2; }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) { name = "avx2"; fn = dot_avx2; }
+#endif
+#ifdef EMBED_NEON
+    name = "neon";
+    fn = dot_neon;
+#endif
+    /* Detection is idempotent, so racing first calls are harmless */
+    __atomic_store_n(&best_name, name, __ATOMIC_RELEASE);
+    __atomic_store_n(&best_dot, fn, __ATOMIC_RELEASE);
+}
+
+float embed_dot(const float *a, const float *b, int n)
+{
+    dot_fn fn = __atomic_load_n(&best_dot, __ATOMIC_ACQUIRE);
+    if (!fn) {
+        detect_dot();
+        fn = best_dot;
+    }
+    return fn(a, b, n);
+}
+
+const char *embed_dot_impl_name(void)
+{
+    if (!__atomic_load_n(&best_dot, __ATOMIC_ACQUIRE)) detect_dot();
+    return best_name;
+}
+
+void embed_normalize(float *vec, int dim)
+{
+    float norm = sqrtf(embed_dot(vec, vec, dim));
+    if (norm <= 0) return;
+    for (int i = 0; i < dim; ++i) vec[i] /= norm;
+}
+
+/* -------------------------------------------------
+   On-disk format: a header, then fixed-size records appended as
+   images are embedded
+       "LISVEC\0\1" <u32 dim> <u32 reserved>
+       <u64 content hash> <f32 x dim> ...
+   The dimension is fixed by the first vector. A record cut short by a
+   crash is dropped on the next open.
+   ------------------------------------------------- */
+
+static const char EMBED_MAGIC[8] = { 'L', 'I', 'S', 'V', 'E', 'C', 0, 1 };
+#define EMBED_HEADER_SIZE 16
+
+static pthread_mutex_t embed_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *embed_fp = NULL;
+static int embed_dim = 0;           /* 0 until the first vector */
+static float *vectors = NULL;       /* rows of embed_dim floats */
+static uint64_t *row_hashes = NULL;
+static unsigned int row_count = 0;
+static unsigned int row_cap = 0;
+static unsigned int *slots = NULL;  /* row + 1, 0 = empty */
+static size_t slot_cap = 0;         /* power of two */
+
+/* Caller holds embed_mutex */
+static long find_row(uint64_t hash)
+{
+    if (!slot_cap) return -1;
+    for (size_t s = hash & (slot_cap - 1); slots[s]; s = (s + 1) & (slot_cap - 1))
+        if (row_hashes[slots[s] - 1] == hash) return (long)slots[s] - 1;
+    return -1;
+}
+
+static bool slots_grow(void)
+{
+    size_t new_cap = slot_cap ? slot_cap * 2 : 1024;
+    unsigned int *grown = calloc(new_cap, sizeof(unsigned int));
+    if (!grown) return false;
+    free(slots);
+    slots = grown;
+    slot_cap = new_cap;
+    for (unsigned int row = 0; row < row_count; ++row)
+    {
+        size_t s = row_hashes[row] & (slot_cap - 1);
+        while (slots[s]) s = (s + 1) & (slot_cap - 1);
+        slots[s] = row + 1;
+    }
+    return true;
+}
+
+/* Caller holds embed_mutex. A hash seen again (re-embedded) keeps its
+   row and takes the new vector, so later records win. */
+static bool put_row(uint64_t hash, const float *vec)
+{
+    long existing = find_row(hash);
+    if (existing >= 0) {
+        memcpy(vectors + (size_t)existing * embed_dim, vec, embed_dim * sizeof(float));
+        return true;
+    }
+    if (row_count == row_cap)
+    {
+        unsigned int new_cap = row_cap ? row_cap * 2 : 1024;
+        float *v = realloc(vectors, (size_t)new_cap * embed_dim * sizeof(float));
+        if (!v) return false;
+        vectors = v;
+        uint64_t *h = realloc(row_hashes, new_cap * sizeof(uint64_t));
+        if (!h) return false;
+        row_hashes = h;
+        row_cap = new_cap;
+    }
+    if ((row_count + 1) * 4 > slot_cap * 3 && !slots_grow()) return false;
+
+    memcpy(vectors + (size_t)row_count * embed_dim, vec, embed_dim * sizeof(float));
+    row_hashes[row_count] = hash;
+    size_t s = hash & (slot_cap - 1);
+    while (slots[s]) s = (s + 1) & (slot_cap - 1);
+    slots[s] = ++row_count;
+    return true;
+}
+
+/* Reads whatever a previous run stored; returns the byte length of
+   the whole records, which is where appending continues */
+static long load_index(FILE *fp)
+{
+    char header[EMBED_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+        memcmp(header, EMBED_MAGIC, sizeof(EMBED_MAGIC)) != 0)
+        return 0;
+    uint32_t dim;
+    memcpy(&dim, header + 8, sizeof(dim));
+    if (dim == 0 || dim > 65536) return 0;
+    embed_dim = (int)dim;
+
+    size_t record = sizeof(uint64_t) + (size_t)embed_dim * sizeof(float);
+    unsigned char *buf = malloc(record);
+    if (!buf) return 0;
+    long end = EMBED_HEADER_SIZE;
+    while (fread(buf, 1, record, fp) == record)
+    {
+        uint64_t hash;
+        memcpy(&hash, buf, sizeof(hash));
+        if (!put_row(hash, (const float *)(buf + sizeof(hash)))) break;
+        end += (long)record;
+    }
+    free(buf);
+    return end;
+}
+
+bool embed_index_open(const char *model)
+{
+    embed_index_close();
+
+    char name[64];
+    snprintf(name, sizeof(name), "embeddings/%016llx.vec",
+             (unsigned long long)hash64(model, strlen(model), 0));
+    char *path = cache_file_path(name);
+    if (!path) return false;
+
+    long end = 0;
+    FILE *in = fopen(path, "rb");
+    if (in) {
+        end = load_index(in);
+        fclose(in);
+    }
+    /* Drop a torn last record, or start over if the header is bad */
+    if (truncate(path, end) == -1 && in)
+        fprintf(stderr, "Failed to trim embedding index %s\n", path);
+    if (end == 0) embed_dim = 0;
+
+    embed_fp = fopen(path, "ab");
+    if (!embed_fp) {
+        fprintf(stderr, "Failed to open embedding index %s\n", path);
+        free(path);
+        embed_index_close();
+        return false;
+    }
+    free(path);
+    return true;
+}
+
+void embed_index_close(void)
+{
+    pthread_mutex_lock(&embed_mutex);
+    if (embed_fp) fclose(embed_fp);
+    embed_fp = NULL;
+    free(vectors);
+    free(row_hashes);
+    free(slots);
+    vectors = NULL;
+    row_hashes = NULL;
+    slots = NULL;
+    row_count = row_cap = 0;
+    slot_cap = 0;
+    embed_dim = 0;
+    pthread_mutex_unlock(&embed_mutex);
+}
+
+bool embed_index_enabled(void)
+{
+    return embed_fp != NULL;
+}
+
+bool embed_index_contains(uint64_t content_hash)
+{
+    pthread_mutex_lock(&embed_mutex);
+    bool found = find_row(content_hash) >= 0;
+    pthread_mutex_unlock(&embed_mutex);
+    return found;
+}
+
+bool embed_index_add(uint64_t content_hash, const float *vec, int dim)
+{
+    if (dim <= 0) return false;
+    float *unit = malloc(dim * sizeof(float));
+    if (!unit) return false;
+    memcpy(unit, vec, dim * sizeof(float));
+    embed_normalize(unit, dim);
+
+    pthread_mutex_lock(&embed_mutex);
+    bool ok = false;
+    if (!embed_fp) goto out;
+    if (embed_dim == 0)
+    {
+        char header[EMBED_HEADER_SIZE] = {0};
+        uint32_t d = (uint32_t)dim;
+        memcpy(header, EMBED_MAGIC, sizeof(EMBED_MAGIC));
+        memcpy(header + 8, &d, sizeof(d));
+        if (fwrite(header, 1, sizeof(header), embed_fp) != sizeof(header)) goto out;
+        embed_dim = dim;
+    }
+    if (dim != embed_dim) {
+        fprintf(stderr, "Embedding has %d dimensions, the index holds %d\n", dim, embed_dim);
+        goto out;
+    }
+    if (!put_row(content_hash, unit)) goto out;
+    fwrite(&content_hash, sizeof(content_hash), 1, embed_fp);
+    fwrite(unit, sizeof(float), dim, embed_fp);
+    fflush(embed_fp);
+    ok = true;
+out:
+    pthread_mutex_unlock(&embed_mutex);
+    free(unit);
+    return ok;
+}
+
+void embed_index_score(const float *query, int dim, const uint64_t *hashes, int n,
+                       float *scores)
+{
+    float *unit = malloc(dim * sizeof(float));
+    if (unit) {
+        memcpy(unit, query, dim * sizeof(float));
+        embed_normalize(unit, dim);
+    }
+    pthread_mutex_lock(&embed_mutex);
+    for (int i = 0; i < n; ++i)
+    {
+        long row = unit && dim == embed_dim ? find_row(hashes[i]) : -1;
+        scores[i] = row < 0 ? -2.0f : embed_dot(unit, vectors + (size_t)row * embed_dim, dim);
+    }
+    pthread_mutex_unlock(&embed_mutex);
+    free(unit);
+}
@@ -0,0 +1,37 @@
+#ifndef EMBED_H
+#define EMBED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* -------------------------------------------------
+   Embedding index for the prefilter stage
+   One unit-length vector per image content hash and embedding model,
+   kept in an append-only file so each image is embedded once. Queries
+   are scored against it with a SIMD dot-product scan.
+   ------------------------------------------------- */
+
+/* Opens (creating if needed) the index for `model` under the cache
+   directory ($XDG_CACHE_HOME/llm_image_search/embeddings/) */
+bool embed_index_open(const char *model);
+void embed_index_close(void);
+bool embed_index_enabled(void);
+
+bool embed_index_contains(uint64_t content_hash);
+/* Normalises and appends `vec`; false if its dimension does not match
+   the vectors already stored */
+bool embed_index_add(uint64_t content_hash, const float *vec, int dim);
+
+/* scores[i] = cosine similarity between `query` and the image with
+   content hash hashes[i], or -2 if that image has no vector */
+void embed_index_score(const float *query, int dim, const uint64_t *hashes, int n,
+                       float *scores);
+
+/* Scales `vec` to unit length (left alone if all zero) */
+void embed_normalize(float *vec, int dim);
+
+/* Dot product with the fastest implementation the CPU supports */
+float embed_dot(const float *a, const float *b, int n);
+const char *embed_dot_impl_name(void);
+
+#endif
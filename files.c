@@ -0,0 +1,892 @@
+#define _GNU_SOURCE
+#include "files.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+bool has_image_extension(const char *filename)
+{
+    const char *ext = strrchr(filename, '.');
+    if (!ext) return false;
+    ext++; // skip dot
+    if (strcasecmp(ext, "png") == 0) return true;
+    if (strcasecmp(ext, "jpg") == 0) return true;
+    if (strcasecmp(ext, "jpeg") == 0) return true;
+    if (strcasecmp(ext, "gif") == 0) return true;
+    if (strcasecmp(ext, "bmp") == 0) return true;
+    if (strcasecmp(ext, "webp") == 0) return true;
+    return false;
+}
+
+/* -------------------------------------------------
+   Path storage: each list owns a chain of blocks its paths are packed
+   into. Blocks double from 4 KB up to 256 KB, so a small list stays
+   small and a million paths take a few hundred allocations. The head
+   block is the one being filled.
+   ------------------------------------------------- */
+
+#define PATH_BLOCK_MIN (4 * 1024)
+#define PATH_BLOCK_MAX (256 * 1024)
+
+struct path_block {
+    path_block *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/* A new head block with room for `bytes` */
+static bool arena_grow(file_list *list, size_t bytes)
+{
+    size_t size = list->blocks ? list->blocks->size * 2 : PATH_BLOCK_MIN;
+    if (size > PATH_BLOCK_MAX) size = PATH_BLOCK_MAX;
+    if (size < bytes) size = bytes;
+    path_block *b = malloc(sizeof(*b) + size);
+    if (!b) return false;
+    b->next = list->blocks;
+    b->used = 0;
+    b->size = size;
+    list->blocks = b;
+    return true;
+}
+
+static char *arena_alloc(file_list *list, size_t len)
+{
+    path_block *b = list->blocks;
+    if ((!b || b->size - b->used < len) && !arena_grow(list, len)) return NULL;
+    b = list->blocks;
+    char *p = b->data + b->used;
+    b->used += len;
+    return p;
+}
+
+static void arena_free(path_block *b)
+{
+    while (b) {
+        path_block *next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+static size_t arena_used(const path_block *b)
+{
+    size_t used = 0;
+    for (; b; b = b->next) used += b->used;
+    return used;
+}
+
+/* Hands src's blocks to dst behind dst's head, which stays the one filled */
+static void arena_take(file_list *dst, file_list *src)
+{
+    if (!src->blocks) return;
+    path_block *tail = src->blocks;
+    while (tail->next) tail = tail->next;
+    if (dst->blocks) {
+        tail->next = dst->blocks->next;
+        dst->blocks->next = src->blocks;
+    } else {
+        dst->blocks = src->blocks;
+    }
+    dst->dead_bytes += src->dead_bytes;
+    src->blocks = NULL;
+    src->dead_bytes = 0;
+}
+
+/* Room for `extra` more paths */
+static bool reserve_slots(file_list *list, unsigned int extra)
+{
+    if (list->count + extra <= list->capacity) return true;
+    unsigned int new_cap = list->capacity ? list->capacity * 2 : 128;
+    if (new_cap < list->count + extra) new_cap = list->count + extra;
+    char **paths = realloc(list->paths, new_cap * sizeof(char *));
+    if (!paths) return false;
+    list->paths = paths;
+    list->capacity = new_cap;
+    return true;
+}
+
+bool file_list_reserve(file_list *list, unsigned int count, size_t bytes)
+{
+    if (!reserve_slots(list, count)) return false;
+    path_block *b = list->blocks;
+    return (b && b->size - b->used >= bytes) || arena_grow(list, bytes);
+}
+
+bool file_list_append(file_list *list, const char *path)
+{
+    size_t len = strlen(path) + 1;
+    if (!reserve_slots(list, 1)) return false;
+    char *copy = arena_alloc(list, len);
+    if (!copy) return false;
+    memcpy(copy, path, len);
+    list->paths[list->count++] = copy;
+    return true;
+}
+
+/* Appends "dir/name" without an intermediate copy */
+static bool file_list_append_joined(file_list *list, const char *dir, size_t dir_len,
+                                    const char *name)
+{
+    size_t name_len = strlen(name);
+    if (!reserve_slots(list, 1)) return false;
+    char *full = arena_alloc(list, dir_len + name_len + 2);
+    if (!full) return false;
+    memcpy(full, dir, dir_len);
+    full[dir_len] = '/';
+    memcpy(full + dir_len + 1, name, name_len + 1);
+    list->paths[list->count++] = full;
+    return true;
+}
+
+bool file_list_splice(file_list *dst, file_list *src)
+{
+    if (src->count == 0) return true;
+    file_list_compact(src);
+    if (!reserve_slots(dst, src->count)) return false;
+    memcpy(dst->paths + dst->count, src->paths, src->count * sizeof(char *));
+    dst->count += src->count;
+    src->count = 0;
+    arena_take(dst, src);
+    return true;
+}
+
+/* Empties the list but keeps its newest block for reuse */
+static void file_list_clear(file_list *list)
+{
+    file_list_compact(list);
+    list->count = 0;
+    list->dead_bytes = 0;
+    if (list->blocks) {
+        arena_free(list->blocks->next);
+        list->blocks->next = NULL;
+        list->blocks->used = 0;
+    }
+}
+
+/* -------------------------------------------------
+   Directory scanner: a small pool of threads walks the tree through a
+   shared queue of directories. Entry types come from d_type; fstatat
+   is only needed when the filesystem does not report it (or for
+   symlinks). Image paths are collected in chunks that the consumer
+   takes while the walk is still running.
+   ------------------------------------------------- */
+
+#define SCAN_LOCAL_BATCH 256
+
+typedef struct scan_dir {
+    char *path;
+    struct scan_dir *next;
+} scan_dir;
+
+struct file_scan {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;       /* directories queued or walk finished */
+    pthread_cond_t found_cond;      /* new paths or walk finished */
+    scan_dir *dirs;                 /* LIFO: keeps the queue short */
+    int busy;                       /* workers inside a directory */
+    bool finished;
+    volatile bool cancelled;
+    bool recursive;
+    file_list found;                /* not yet taken by the consumer */
+    dir_stamp *stamps;              /* every directory read */
+    unsigned int stamp_count;
+    unsigned int stamp_cap;
+    pthread_t *threads;
+    int thread_count;
+};
+
+static char *join_path(const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *full = malloc(dir_len + name_len + 2);
+    if (!full) return NULL;
+    memcpy(full, dir, dir_len);
+    full[dir_len] = '/';
+    memcpy(full + dir_len + 1, name, name_len + 1);
+    return full;
+}
+
+/* Caller holds scan->mutex */
+static void scan_queue_dir(file_scan *scan, char *path)
+{
+    scan_dir *item = malloc(sizeof(*item));
+    if (!item) {
+        free(path);
+        return;
+    }
+    item->path = path;
+    item->next = scan->dirs;
+    scan->dirs = item;
+    pthread_cond_signal(&scan->work_cond);
+}
+
+/* Hands a worker's local batch to the consumer. The paths are copied,
+   so the worker refills the same block instead of leaving the found
+   list a trail of small ones. */
+static void scan_publish(file_scan *scan, file_list *local)
+{
+    if (local->count == 0) return;
+    pthread_mutex_lock(&scan->mutex);
+    for (unsigned int i = 0; i < local->count; ++i)
+        if (!file_list_append(&scan->found, local->paths[i])) break;
+    pthread_cond_signal(&scan->found_cond);
+    pthread_mutex_unlock(&scan->mutex);
+    file_list_clear(local);
+}
+
+/* Stamped before reading, so a change during the walk shows up later */
+static void scan_stamp_dir(file_scan *scan, const char *dir, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1) return;
+    char *path = strdup(dir);
+    if (!path) return;
+
+    pthread_mutex_lock(&scan->mutex);
+    if (scan->stamp_count == scan->stamp_cap)
+    {
+        unsigned int new_cap = scan->stamp_cap ? scan->stamp_cap * 2 : 64;
+        dir_stamp *stamps = realloc(scan->stamps, new_cap * sizeof(dir_stamp));
+        if (!stamps) {
+            pthread_mutex_unlock(&scan->mutex);
+            free(path);
+            return;
+        }
+        scan->stamps = stamps;
+        scan->stamp_cap = new_cap;
+    }
+    scan->stamps[scan->stamp_count++] = (dir_stamp){
+        path, (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec,
+        (unsigned long long)st.st_ino };
+    pthread_mutex_unlock(&scan->mutex);
+}
+
+static void scan_one_dir(file_scan *scan, const char *dir, file_list *local)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return;
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return;
+    }
+    scan_stamp_dir(scan, dir, fd);
+    size_t dir_len = strlen(dir);
+
+    struct dirent *entry;
+    while (!scan->cancelled && (entry = readdir(d)) != NULL)
+    {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK)
+        {
+            /* Follows symlinks, like the stat() this replaces */
+            struct stat st;
+            if (fstatat(fd, name, &st, 0) == -1) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_DIR && scan->recursive)
+        {
+            char *full = join_path(dir, name);
+            if (!full) continue;
+            pthread_mutex_lock(&scan->mutex);
+            scan_queue_dir(scan, full);
+            pthread_mutex_unlock(&scan->mutex);
+        }
+        else if (type == DT_REG && has_image_extension(name))
+        {
+            file_list_append_joined(local, dir, dir_len, name);
+            if (local->count >= SCAN_LOCAL_BATCH) scan_publish(scan, local);
+        }
+    }
+    closedir(d);
+}
+
+static void *scan_worker(void *arg)
+{
+    file_scan *scan = arg;
+    file_list local = {0};
+
+    pthread_mutex_lock(&scan->mutex);
+    for (;;)
+    {
+        while (!scan->dirs && !scan->finished)
+            pthread_cond_wait(&scan->work_cond, &scan->mutex);
+        if (scan->finished) break;
+
+        scan_dir *item = scan->dirs;
+        scan->dirs = item->next;
+        scan->busy++;
+        pthread_mutex_unlock(&scan->mutex);
+
+        scan_one_dir(scan, item->path, &local);
+        scan_publish(scan, &local);
+        free(item->path);
+        free(item);
+
+        pthread_mutex_lock(&scan->mutex);
+        scan->busy--;
+        if (scan->cancelled) {
+            while (scan->dirs) {
+                scan_dir *next = scan->dirs->next;
+                free(scan->dirs->path);
+                free(scan->dirs);
+                scan->dirs = next;
+            }
+        }
+        /* Nothing queued and nobody left to queue more: the walk is over */
+        if (!scan->dirs && scan->busy == 0) {
+            scan->finished = true;
+            pthread_cond_broadcast(&scan->work_cond);
+            pthread_cond_broadcast(&scan->found_cond);
+        }
+    }
+    pthread_mutex_unlock(&scan->mutex);
+    file_list_free(&local);
+    return NULL;
+}
+
+file_scan *file_scan_start(const char *basePath, bool recursive, int threads)
+{
+    if (threads <= 0) {
+        /* Mostly waiting on metadata I/O, so a few more than cores is fine */
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 4;
+        if (threads < 2) threads = 2;
+        if (threads > 8) threads = 8;
+    }
+    if (!recursive) threads = 1;
+
+    file_scan *scan = calloc(1, sizeof(*scan));
+    if (!scan) return NULL;
+    scan->threads = calloc(threads, sizeof(pthread_t));
+    char *root = strdup(basePath);
+    if (!scan->threads || !root) {
+        free(root);
+        free(scan->threads);
+        free(scan);
+        return NULL;
+    }
+    pthread_mutex_init(&scan->mutex, NULL);
+    pthread_cond_init(&scan->work_cond, NULL);
+    pthread_cond_init(&scan->found_cond, NULL);
+    scan->recursive = recursive;
+
+    /* Strip trailing slashes so joined paths look like the old loader's */
+    size_t len = strlen(root);
+    while (len > 1 && root[len - 1] == '/') root[--len] = '\0';
+    scan_queue_dir(scan, root);
+
+    for (int i = 0; i < threads; ++i)
+    {
+        if (pthread_create(&scan->threads[i], NULL, scan_worker, scan) != 0) break;
+        scan->thread_count++;
+    }
+    if (scan->thread_count == 0) {
+        scan->cancelled = true;
+        scan->finished = true;
+        file_scan_free(scan);
+        return NULL;
+    }
+    return scan;
+}
+
+bool file_scan_next(file_scan *scan, file_list *out, int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&scan->mutex);
+    while (scan->found.count == 0 && !scan->finished)
+        if (pthread_cond_timedwait(&scan->found_cond, &scan->mutex, &deadline) != 0) break;
+
+    bool more = scan->found.count > 0 || !scan->finished;
+    if (scan->found.count > 0)
+    {
+        if (out->count == 0) {
+            /* Common case: hand over the whole array */
+            file_list_free(out);
+            *out = scan->found;
+            scan->found = (file_list){0};
+        } else if (!file_list_splice(out, &scan->found)) {
+            file_list_clear(&scan->found);
+        }
+    }
+    pthread_mutex_unlock(&scan->mutex);
+    return more;
+}
+
+dir_stamp *file_scan_take_dirs(file_scan *scan, unsigned int *count)
+{
+    pthread_mutex_lock(&scan->mutex);
+    dir_stamp *stamps = scan->stamps;
+    *count = scan->stamp_count;
+    scan->stamps = NULL;
+    scan->stamp_count = scan->stamp_cap = 0;
+    pthread_mutex_unlock(&scan->mutex);
+    return stamps;
+}
+
+void file_scan_cancel(file_scan *scan)
+{
+    pthread_mutex_lock(&scan->mutex);
+    scan->cancelled = true;
+    pthread_mutex_unlock(&scan->mutex);
+}
+
+void file_scan_free(file_scan *scan)
+{
+    if (!scan) return;
+    file_scan_cancel(scan);
+    for (int i = 0; i < scan->thread_count; ++i)
+        pthread_join(scan->threads[i], NULL);
+    while (scan->dirs) {
+        scan_dir *next = scan->dirs->next;
+        free(scan->dirs->path);
+        free(scan->dirs);
+        scan->dirs = next;
+    }
+    file_list_free(&scan->found);
+    for (unsigned int i = 0; i < scan->stamp_count; ++i)
+        free(scan->stamps[i].path);
+    free(scan->stamps);
+    pthread_cond_destroy(&scan->found_cond);
+    pthread_cond_destroy(&scan->work_cond);
+    pthread_mutex_destroy(&scan->mutex);
+    free(scan->threads);
+    free(scan);
+}
+
+file_list load_files(const char *basePath, bool recursive)
+{
+    file_list list = {0};
+    file_scan *scan = file_scan_start(basePath, recursive, 0);
+    if (!scan) return list;
+    while (file_scan_next(scan, &list, 1000))
+        ;
+    file_scan_free(scan);
+    return list;
+}
+
+void file_list_free(file_list *list)
+{
+    arena_free(list->blocks);
+    free(list->paths);
+    free(list->dead);
+    free(list->live_tree);
+    *list = (file_list){0};
+}
+
+/* -------------------------------------------------
+   Helper: alphanumeric sort for file list
+   ------------------------------------------------- */
+
+/* Custom character ranking:
+      0-9  -> 0-9
+      a/A -> 10,11
+      b/B -> 12,13
+      ...  -> continue */
+static int char_rank(unsigned char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'z')
+        return 10 + (c - 'a') * 2;
+    if (c >= 'A' && c <= 'Z')
+        return 10 + (c - 'A') * 2 + 1;
+    return 1000 + c;  /* fallback for other characters */
+}
+
+/* The ranks of all 256 bytes (the terminator included) are distinct,
+   so their order fits in a byte: collate[c] is c's position in it.
+   Strings then compare by their first differing byte, and a string is
+   its collate bytes followed by collate[0] as far as order goes. */
+static unsigned char collate[256];
+static pthread_once_t collate_once = PTHREAD_ONCE_INIT;
+
+static void collate_init(void)
+{
+    int order[256];
+    for (int c = 0; c < 256; ++c) order[c] = c;
+    /* Insertion sort by rank: runs once */
+    for (int i = 1; i < 256; ++i)
+        for (int j = i; j > 0 && char_rank(order[j]) < char_rank(order[j - 1]); --j) {
+            int t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+    for (int i = 0; i < 256; ++i) collate[order[i]] = (unsigned char)i;
+}
+
+static int collate_cmp(const unsigned char *s1, const unsigned char *s2)
+{
+    while (*s1 && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return collate[*s1] - collate[*s2];
+}
+
+/* Comparator using the custom ranking */
+int cmp_strings(const void *a, const void *b)
+{
+    pthread_once(&collate_once, collate_init);
+    return collate_cmp(*(const unsigned char * const *)a, *(const unsigned char * const *)b);
+}
+
+/* -------------------------------------------------
+   Sorting. Past the prefix every path shares (the folder loaded), each
+   path gets a key of its next 8 collate bytes, terminator included,
+   zero-padded. Keys decide almost every comparison with one integer
+   compare; equal keys without the terminator go on from byte 8. Large
+   lists are sorted in slices on several threads and merged.
+   ------------------------------------------------- */
+
+#define SORT_PARALLEL_MIN 65536
+#define SORT_MAX_THREADS 8
+
+typedef struct {
+    uint64_t key;
+    const unsigned char *tail;  /* the path from the shared prefix on */
+} sort_rec;
+
+static int cmp_recs(const void *a, const void *b)
+{
+    const sort_rec *x = a, *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    /* Only the terminator maps to collate[0]: both strings end here */
+    for (int shift = 0; shift < 64; shift += 8)
+        if ((unsigned char)(x->key >> shift) == collate[0]) return 0;
+    return collate_cmp(x->tail + 8, y->tail + 8);
+}
+
+static void make_recs(sort_rec *recs, char *const *paths, size_t n, size_t skip)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const unsigned char *p = (const unsigned char *)paths[i] + skip;
+        uint64_t key = 0;
+        int len = 0;
+        while (len < 8 && p[len]) key = key << 8 | collate[p[len++]];
+        if (len < 8) {
+            key = key << 8 | collate[0];
+            key <<= 8 * (7 - len);
+        }
+        recs[i] = (sort_rec){ key, p };
+    }
+}
+
+typedef struct {
+    char *const *paths;
+    sort_rec *recs;
+    size_t n;
+    size_t skip;
+} sort_slice;
+
+static void *sort_slice_main(void *arg)
+{
+    sort_slice *s = arg;
+    make_recs(s->recs, s->paths, s->n, s->skip);
+    qsort(s->recs, s->n, sizeof(sort_rec), cmp_recs);
+    return NULL;
+}
+
+typedef struct {
+    const sort_rec *a, *b;
+    size_t na, nb;
+    sort_rec *out;
+} merge_task;
+
+static void *merge_main(void *arg)
+{
+    merge_task *m = arg;
+    size_t i = 0, j = 0, k = 0;
+    while (i < m->na && j < m->nb)
+        m->out[k++] = cmp_recs(&m->b[j], &m->a[i]) < 0 ? m->b[j++] : m->a[i++];
+    memcpy(m->out + k, m->a + i, (m->na - i) * sizeof(sort_rec));
+    k += m->na - i;
+    memcpy(m->out + k, m->b + j, (m->nb - j) * sizeof(sort_rec));
+    return NULL;
+}
+
+/* Runs `fn` over `count` tasks, the first on the calling thread */
+static void run_parallel(void *(*fn)(void *), void *tasks, size_t task_size, int count)
+{
+    pthread_t threads[SORT_MAX_THREADS];
+    bool started[SORT_MAX_THREADS] = { false };
+    for (int t = 1; t < count; ++t)
+        started[t] = pthread_create(&threads[t], NULL, fn, (char *)tasks + t * task_size) == 0;
+    fn(tasks);
+    for (int t = 1; t < count; ++t)
+    {
+        if (started[t]) pthread_join(threads[t], NULL);
+        else fn((char *)tasks + t * task_size);
+    }
+}
+
+/* Sorts paths[0, n) into cmp_strings order with `threads` threads */
+static bool sort_paths(char **paths, size_t n, int threads)
+{
+    if (n < 2) return true;
+    pthread_once(&collate_once, collate_init);
+
+    /* The shared prefix says nothing about the order */
+    size_t skip = strlen(paths[0]);
+    for (size_t i = 1; i < n && skip > 0; ++i)
+    {
+        size_t j = 0;
+        while (j < skip && paths[i][j] == paths[0][j]) j++;
+        skip = j;
+    }
+
+    sort_rec *recs = malloc(n * sizeof(sort_rec));
+    sort_rec *spare = threads > 1 ? malloc(n * sizeof(sort_rec)) : NULL;
+    if (!recs || (threads > 1 && !spare)) {
+        free(recs);
+        free(spare);
+        return false;
+    }
+
+    /* Sorted slices, then rounds of pairwise merges between the buffers */
+    sort_slice slices[SORT_MAX_THREADS];
+    size_t starts[SORT_MAX_THREADS + 1];
+    for (int t = 0; t <= threads; ++t) starts[t] = n * t / threads;
+    for (int t = 0; t < threads; ++t)
+        slices[t] = (sort_slice){ paths + starts[t], recs + starts[t],
+                                  starts[t + 1] - starts[t], skip };
+    run_parallel(sort_slice_main, slices, sizeof(sort_slice), threads);
+
+    int runs = threads;
+    sort_rec *from = recs, *to = spare;
+    while (runs > 1)
+    {
+        merge_task tasks[SORT_MAX_THREADS];
+        int merged = 0;
+        for (int r = 0; r < runs; r += 2)
+        {
+            size_t lo = starts[r], mid = starts[r + 1];
+            size_t hi = r + 1 < runs ? starts[r + 2] : mid;
+            tasks[merged++] = (merge_task){ from + lo, from + mid, mid - lo, hi - mid, to + lo };
+            starts[merged - 1] = lo;
+        }
+        starts[merged] = n;
+        run_parallel(merge_main, tasks, sizeof(merge_task), merged);
+        runs = merged;
+        sort_rec *t = from;
+        from = to;
+        to = t;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        paths[i] = (char *)from[i].tail - skip;
+    free(recs);
+    free(spare);
+    return true;
+}
+
+void file_list_sort(file_list *list)
+{
+    if (list->count < 2) return;
+    int threads = 1;
+    if (list->count >= SORT_PARALLEL_MIN)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > SORT_MAX_THREADS ? SORT_MAX_THREADS : cpus > 1 ? (int)cpus : 1;
+    }
+    if (!sort_paths(list->paths, list->count, threads))
+        qsort(list->paths, list->count, sizeof(char *), cmp_strings);
+}
+
+/* Index of the first element in paths[0, n) that sorts after `path` */
+static unsigned int upper_bound(char **paths, unsigned int n, const char *path)
+{
+    unsigned int lo = 0, hi = n;
+    while (lo < hi)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (cmp_strings(&path, &paths[mid]) < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+bool file_list_merge(file_list *dst, file_list *src)
+{
+    if (src->count == 0) return true;
+    file_list_compact(dst);
+    file_list_compact(src);
+    if (!reserve_slots(dst, src->count)) return false;
+    unsigned int total = dst->count + src->count;
+
+    /* Fill from the back: each src element binary-searches its slot among
+       the dst elements not yet moved, and the run above it moves in one go */
+    unsigned int i = dst->count, j = src->count, k = total;
+    while (j > 0)
+    {
+        char *path = src->paths[--j];
+        unsigned int pos = upper_bound(dst->paths, i, path);
+        unsigned int run = i - pos;
+        k -= run;
+        memmove(&dst->paths[k], &dst->paths[pos], run * sizeof(char *));
+        i = pos;
+        dst->paths[--k] = path;
+    }
+    dst->count = total;
+    src->count = 0;
+    arena_take(dst, src);
+    return true;
+}
+
+int file_list_insert(file_list *list, const char *path)
+{
+    file_list_compact(list);
+    size_t len = strlen(path) + 1;
+    char *copy = reserve_slots(list, 1) ? arena_alloc(list, len) : NULL;
+    if (!copy) return -1;
+    memcpy(copy, path, len);
+    unsigned int idx = upper_bound(list->paths, list->count, copy);
+    memmove(&list->paths[idx + 1], &list->paths[idx], (list->count - idx) * sizeof(char *));
+    list->paths[idx] = copy;
+    list->count++;
+    return (int)idx;
+}
+
+int file_list_find(const file_list *list, const char *path)
+{
+    char **hit = bsearch(&path, list->paths, list->count, sizeof(char *), cmp_strings);
+    return hit ? (int)(hit - list->paths) : -1;
+}
+
+/* -------------------------------------------------
+   Tombstones. The Fenwick tree counts live entries, so mapping a
+   scroll row to an entry and removing one are both O(log n); the
+   pointer array only shifts on compaction.
+   ------------------------------------------------- */
+
+unsigned int file_list_live_count(const file_list *list)
+{
+    return list->dead ? list->live : list->count;
+}
+
+bool file_list_is_live(const file_list *list, unsigned int idx)
+{
+    return idx < list->count && !(list->dead && list->dead[idx]);
+}
+
+/* First removal: every entry starts out live */
+static bool live_tree_build(file_list *list)
+{
+    unsigned int n = list->count;
+    list->dead = calloc(n ? n : 1, 1);
+    list->live_tree = malloc((n + 1) * sizeof(unsigned int));
+    if (!list->dead || !list->live_tree) {
+        free(list->dead);
+        free(list->live_tree);
+        list->dead = NULL;
+        list->live_tree = NULL;
+        return false;
+    }
+    list->live_tree[0] = 0;
+    for (unsigned int i = 1; i <= n; ++i)
+        list->live_tree[i] = 1;
+    for (unsigned int i = 1; i <= n; ++i)
+    {
+        unsigned int parent = i + (i & -i);
+        if (parent <= n) list->live_tree[parent] += list->live_tree[i];
+    }
+    list->live = n;
+    return true;
+}
+
+void file_list_remove(file_list *list, unsigned int idx)
+{
+    if (!file_list_is_live(list, idx)) return;
+    if (!list->dead && !live_tree_build(list)) return;
+    list->dead[idx] = 1;
+    list->live--;
+    for (unsigned int i = idx + 1; i <= list->count; i += i & -i)
+        list->live_tree[i]--;
+}
+
+unsigned int file_list_live_index(const file_list *list, unsigned int row)
+{
+    if (!list->dead) return row;
+
+    unsigned int pos = 0, remaining = row + 1;
+    unsigned int step = 1;
+    while (step * 2 <= list->count) step *= 2;
+    for (; step; step /= 2)
+    {
+        if (pos + step <= list->count && list->live_tree[pos + step] < remaining) {
+            pos += step;
+            remaining -= list->live_tree[pos];
+        }
+    }
+    return pos;
+}
+
+unsigned int file_list_live_rank(const file_list *list, unsigned int idx)
+{
+    if (!list->dead) return idx;
+    unsigned int rank = 0;
+    for (unsigned int i = idx; i > 0; i -= i & -i)
+        rank += list->live_tree[i];
+    return rank;
+}
+
+/* Copies the live paths into fresh blocks once most of the arena is dead */
+static void arena_repack(file_list *list)
+{
+    size_t used = arena_used(list->blocks);
+    if (list->dead_bytes * 2 <= used) return;
+    file_list fresh = {0};
+    if (!arena_grow(&fresh, used - list->dead_bytes)) return;
+    for (unsigned int i = 0; i < list->count; ++i)
+    {
+        size_t len = strlen(list->paths[i]) + 1;
+        char *copy = arena_alloc(&fresh, len);
+        memcpy(copy, list->paths[i], len);
+        list->paths[i] = copy;
+    }
+    arena_free(list->blocks);
+    list->blocks = fresh.blocks;
+    list->dead_bytes = 0;
+}
+
+void file_list_compact(file_list *list)
+{
+    if (!list->dead) return;
+    unsigned int out = 0;
+    for (unsigned int i = 0; i < list->count; ++i)
+    {
+        if (list->dead[i]) list->dead_bytes += strlen(list->paths[i]) + 1;
+        else list->paths[out++] = list->paths[i];
+    }
+    list->count = out;
+    arena_repack(list);
+    free(list->dead);
+    free(list->live_tree);
+    list->dead = NULL;
+    list->live_tree = NULL;
+    list->live = 0;
+}
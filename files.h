@@ -0,0 +1,94 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* -------------------------------------------------
+   Directory listing (no raylib dependency)
+   ------------------------------------------------- */
+
+/* A block of the string arena a list keeps its paths in */
+typedef struct path_block path_block;
+
+typedef struct {
+    unsigned int capacity;
+    unsigned int count;
+    char **paths;           /* point into `blocks` */
+    /* Paths are packed back to back into large blocks rather than
+       allocated one by one. A path stays where it is until the list is
+       compacted (which may repack) or freed. */
+    path_block *blocks;
+    size_t dead_bytes;      /* arena bytes of paths compacted away */
+    /* Removed entries are tombstoned, keeping indexes stable and the
+       paths searchable, until file_list_compact drops them in bulk.
+       Both arrays stay NULL until the first removal. */
+    unsigned char *dead;
+    unsigned int *live_tree;    /* Fenwick tree over the live flags */
+    unsigned int live;
+} file_list;
+
+bool has_image_extension(const char *filename);
+
+/* Image files directly in `basePath`, or in the whole tree when
+   recursive. Blocks until the walk is done; unsorted. */
+file_list load_files(const char *basePath, bool recursive);
+void file_list_free(file_list *list);
+/* Copies `path` to the end (unsorted) */
+bool file_list_append(file_list *list, const char *path);
+/* Room for `count` more paths of `bytes` in total, NULs included */
+bool file_list_reserve(file_list *list, unsigned int count, size_t bytes);
+/* Moves every path of `src` to the end of `dst` (unsorted), leaving src empty */
+bool file_list_splice(file_list *dst, file_list *src);
+
+/* Background walk that hands out image paths while it runs.
+   `threads` <= 0 picks a default. */
+typedef struct file_scan file_scan;
+file_scan *file_scan_start(const char *basePath, bool recursive, int threads);
+/* Waits up to timeout_ms for paths found since the last call and appends
+   them (unsorted) to `out`. Returns false once the walk has finished and
+   everything was handed out. */
+bool file_scan_next(file_scan *scan, file_list *out, int timeout_ms);
+/* A directory as the walk read it: entries can only have come or gone
+   since if its mtime or inode changed */
+typedef struct {
+    char *path;
+    long long mtime_ns;
+    unsigned long long ino;
+} dir_stamp;
+/* Moves the stamps of every directory read so far into a malloc'd
+   array (unsorted); free each path and the array */
+dir_stamp *file_scan_take_dirs(file_scan *scan, unsigned int *count);
+/* Stops queueing more directories; file_scan_next soon returns false */
+void file_scan_cancel(file_scan *scan);
+/* Cancels if still running and joins the walker threads */
+void file_scan_free(file_scan *scan);
+
+/* Alphanumeric order used by the file panel */
+int cmp_strings(const void *a, const void *b);
+/* Same order; sorts on precomputed collation key prefixes, in parallel
+   for large lists */
+void file_list_sort(file_list *list);
+/* Moves the sorted `src` into the sorted `dst`, leaving src empty.
+   Merge and insert compact `dst` first. */
+bool file_list_merge(file_list *dst, file_list *src);
+
+/* Copies `path` in at its sorted position; returns the index, or -1
+   if the list could not grow */
+int file_list_insert(file_list *list, const char *path);
+
+/* Index of `path` in a sorted list, or -1 (may be a tombstone) */
+int file_list_find(const file_list *list, const char *path);
+
+/* Tombstones: O(log n) removal and row <-> index mapping */
+unsigned int file_list_live_count(const file_list *list);
+bool file_list_is_live(const file_list *list, unsigned int idx);
+void file_list_remove(file_list *list, unsigned int idx);
+/* Index of the `row`-th live entry (row < live count) */
+unsigned int file_list_live_index(const file_list *list, unsigned int row);
+/* Live entries before `idx` */
+unsigned int file_list_live_rank(const file_list *list, unsigned int idx);
+/* Frees the tombstoned entries; an entry's new index is its old live rank */
+void file_list_compact(file_list *list);
+
+#endif
@@ -0,0 +1,131 @@
+#include "hash.h"
+#include <string.h>
+
+/* -------------------------------------------------
+   XXH64 (public domain algorithm by Yann Collet)
+   ------------------------------------------------- */
+
+static const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t P3 = 0x165667B19E3779F9ULL;
+static const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v; /* little-endian hosts only, like the rest of the tool */
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+    acc += input * P2;
+    acc = rotl64(acc, 31);
+    return acc * P1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= round64(0, val);
+    return acc * P1 + P4;
+}
+
+static uint64_t finalize(uint64_t h, const unsigned char *p, size_t len)
+{
+    while (len >= 8) {
+        h ^= round64(0, read64(p));
+        h = rotl64(h, 27) * P1 + P4;
+        p += 8; len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)read32(p) * P1;
+        h = rotl64(h, 23) * P2 + P3;
+        p += 4; len -= 4;
+    }
+    while (len > 0) {
+        h ^= (*p) * P5;
+        h = rotl64(h, 11) * P1;
+        p++; len--;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+void hash64_init(hash64_state *st, uint64_t seed)
+{
+    memset(st, 0, sizeof(*st));
+    st->seed = seed;
+    st->v[0] = seed + P1 + P2;
+    st->v[1] = seed + P2;
+    st->v[2] = seed;
+    st->v[3] = seed - P1;
+}
+
+void hash64_update(hash64_state *st, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    st->total_len += len;
+
+    if (st->buf_len + len < 32) {
+        memcpy(st->buf + st->buf_len, p, len);
+        st->buf_len += len;
+        return;
+    }
+    if (st->buf_len) {
+        size_t fill = 32 - st->buf_len;
+        memcpy(st->buf + st->buf_len, p, fill);
+        for (int i = 0; i < 4; ++i)
+            st->v[i] = round64(st->v[i], read64(st->buf + i * 8));
+        p += fill; len -= fill;
+        st->buf_len = 0;
+    }
+    while (len >= 32) {
+        st->v[0] = round64(st->v[0], read64(p));
+        st->v[1] = round64(st->v[1], read64(p + 8));
+        st->v[2] = round64(st->v[2], read64(p + 16));
+        st->v[3] = round64(st->v[3], read64(p + 24));
+        p += 32; len -= 32;
+    }
+    memcpy(st->buf, p, len);
+    st->buf_len = len;
+}
+
+uint64_t hash64_final(const hash64_state *st)
+{
+    uint64_t h;
+    if (st->total_len >= 32) {
+        h = rotl64(st->v[0], 1) + rotl64(st->v[1], 7) +
+            rotl64(st->v[2], 12) + rotl64(st->v[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = merge_round(h, st->v[i]);
+    } else {
+        h = st->seed + P5;
+    }
+    h += st->total_len;
+    return finalize(h, st->buf, st->buf_len);
+}
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed)
+{
+    hash64_state st;
+    hash64_init(&st, seed);
+    hash64_update(&st, data, len);
+    return hash64_final(&st);
+}
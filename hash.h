@@ -0,0 +1,23 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 64-bit non-cryptographic hash (XXH64 algorithm) */
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+/* Incremental form for data that arrives in chunks */
+typedef struct {
+    uint64_t v[4];
+    uint64_t total_len;
+    uint64_t seed;
+    unsigned char buf[32];
+    size_t buf_len;
+} hash64_state;
+
+void hash64_init(hash64_state *st, uint64_t seed);
+void hash64_update(hash64_state *st, const void *data, size_t len);
+uint64_t hash64_final(const hash64_state *st);
+
+#endif
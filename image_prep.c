@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+#include "image_prep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <png.h>
+
+prep_options prep_opts = { 1024, 85 };
+
+const char *image_mime_type(const unsigned char *data, size_t size)
+{
+    if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) return "image/png";
+    if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) return "image/jpeg";
+    if (size >= 6 && (memcmp(data, "GIF87a", 6) == 0 || memcmp(data, "GIF89a", 6) == 0)) return "image/gif";
+    if (size >= 2 && data[0] == 'B' && data[1] == 'M') return "image/bmp";
+    if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0) return "image/webp";
+    return "image/jpeg";
+}
+
+void rgb_image_free(rgb_image *img)
+{
+    free(img->pixels);
+    img->pixels = NULL;
+    img->width = img->height = 0;
+}
+
+/* -------------------------------------------------
+   EXIF orientation (re-encoding drops the tag, so bake it in)
+   ------------------------------------------------- */
+
+static int exif_orientation(const unsigned char *exif, size_t len)
+{
+    if (len < 14 || memcmp(exif, "Exif\0\0", 6) != 0) return 1;
+    const unsigned char *tiff = exif + 6;
+    size_t tlen = len - 6;
+    bool le;
+    if (memcmp(tiff, "II", 2) == 0) le = true;
+    else if (memcmp(tiff, "MM", 2) == 0) le = false;
+    else return 1;
+
+#define RD16(p) (le ? (uint16_t)((p)[0] | (p)[1] << 8) : (uint16_t)((p)[0] << 8 | (p)[1]))
+#define RD32(p) (le ? ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24) \
+                    : ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | (uint32_t)(p)[2] << 8 | (uint32_t)(p)[3]))
+    uint32_t ifd = RD32(tiff + 4);
+    if (ifd > tlen - 2) return 1;     /* tlen >= 8; ifd + 2 could wrap */
+    unsigned count = RD16(tiff + ifd);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        size_t e = ifd + 2 + (size_t)i * 12;
+        if (e + 12 > tlen) break;
+        if (RD16(tiff + e) == 0x0112)
+        {
+            unsigned v = RD16(tiff + e + 8);
+            return (v >= 1 && v <= 8) ? (int)v : 1;
+        }
+    }
+#undef RD16
+#undef RD32
+    return 1;
+}
+
+static bool apply_orientation(rgb_image *img, int orientation)
+{
+    if (orientation <= 1) return true;
+
+    int w = img->width, h = img->height;
+    bool swap = orientation >= 5;
+    int ow = swap ? h : w, oh = swap ? w : h;
+    unsigned char *dst = malloc((size_t)ow * oh * 3);
+    if (!dst) return false;
+
+    for (int y = 0; y < oh; ++y)
+    {
+        for (int x = 0; x < ow; ++x)
+        {
+            int sx, sy;
+            switch (orientation) {
+                case 2: sx = w - 1 - x; sy = y; break;
+                case 3: sx = w - 1 - x; sy = h - 1 - y; break;
+                case 4: sx = x; sy = h - 1 - y; break;
+                case 5: sx = y; sy = x; break;
+                case 6: sx = y; sy = h - 1 - x; break;
+                case 7: sx = w - 1 - y; sy = h - 1 - x; break;
+                default: sx = w - 1 - y; sy = x; break; /* 8 */
+            }
+            memcpy(dst + ((size_t)y * ow + x) * 3, img->pixels + ((size_t)sy * w + sx) * 3, 3);
+        }
+    }
+    free(img->pixels);
+    img->pixels = dst;
+    img->width = ow;
+    img->height = oh;
+    return true;
+}
+
+/* -------------------------------------------------
+   JPEG via libjpeg
+   ------------------------------------------------- */
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} jpeg_error_ctx;
+
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+    jpeg_error_ctx *err = (jpeg_error_ctx *)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+static void jpeg_silent(j_common_ptr cinfo, int level)
+{
+    (void)cinfo; (void)level; /* corrupt-data warnings are not interesting here */
+}
+
+static bool decode_jpeg(const unsigned char *data, size_t size, int min_edge, rgb_image *out)
+{
+    struct jpeg_decompress_struct cinfo;
+    jpeg_error_ctx jerr;
+    unsigned char *volatile pixels = NULL;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    jerr.pub.emit_message = jpeg_silent;
+    if (setjmp(jerr.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        free(pixels);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data, (unsigned long)size);
+    jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    int orientation = 1;
+    for (jpeg_saved_marker_ptr m = cinfo.marker_list; m; m = m->next)
+        if (m->marker == JPEG_APP0 + 1)
+            orientation = exif_orientation(m->data, m->data_length);
+
+    /* Let the IDCT do most of the downscale for free */
+    unsigned int longest = cinfo.image_width > cinfo.image_height ? cinfo.image_width : cinfo.image_height;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    if (min_edge > 0)
+        while (cinfo.scale_denom < 8 && longest / (cinfo.scale_denom * 2) >= (unsigned int)min_edge)
+            cinfo.scale_denom *= 2;
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.dct_method = JDCT_IFAST;
+
+    jpeg_start_decompress(&cinfo);
+    int w = cinfo.output_width, h = cinfo.output_height;
+    pixels = malloc((size_t)w * h * 3);
+    if (!pixels) longjmp(jerr.jump, 1);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = pixels + (size_t)cinfo.output_scanline * w * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    out->pixels = pixels;
+    out->width = w;
+    out->height = h;
+    if (!apply_orientation(out, orientation)) {
+        rgb_image_free(out);
+        return false;
+    }
+    return true;
+}
+
+unsigned char *image_encode_jpeg(const rgb_image *img, int quality, size_t *out_size)
+{
+    struct jpeg_compress_struct cinfo;
+    jpeg_error_ctx jerr;
+    unsigned char *volatile buf = NULL;
+    unsigned long len = 0;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp(jerr.jump))
+    {
+        jpeg_destroy_compress(&cinfo);
+        free(buf);
+        return NULL;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, (unsigned char **)&buf, &len);
+    cinfo.image_width = img->width;
+    cinfo.image_height = img->height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = img->pixels + (size_t)cinfo.next_scanline * img->width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    *out_size = len;
+    return buf;
+}
+
+/* -------------------------------------------------
+   PNG via libpng's simplified API
+   ------------------------------------------------- */
+
+static bool decode_png(const unsigned char *data, size_t size, rgb_image *out)
+{
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&png, data, size)) return false;
+
+    png.format = PNG_FORMAT_RGB;
+    size_t stride = PNG_IMAGE_ROW_STRIDE(png);
+    unsigned char *pixels = malloc(PNG_IMAGE_BUFFER_SIZE(png, stride));
+    if (!pixels) {
+        png_image_free(&png);
+        return false;
+    }
+    /* Transparent areas are composited onto white */
+    png_color white = { 255, 255, 255 };
+    if (!png_image_finish_read(&png, &white, pixels, (png_int_32)stride, NULL))
+    {
+        free(pixels);
+        return false;
+    }
+    out->pixels = pixels;
+    out->width = png.width;
+    out->height = png.height;
+    return true;
+}
+
+bool image_decode(const unsigned char *data, size_t size, int min_edge, rgb_image *out)
+{
+    memset(out, 0, sizeof(*out));
+    const char *mime = image_mime_type(data, size);
+    if (strcmp(mime, "image/jpeg") == 0 && size >= 3 && data[0] == 0xFF)
+        return decode_jpeg(data, size, min_edge, out);
+    if (strcmp(mime, "image/png") == 0)
+        return decode_png(data, size, out);
+    return false; /* GIF/BMP/WebP are sent as-is */
+}
+
+/* -------------------------------------------------
+   Area-average downscale: every source pixel contributes to exactly
+   one output pixel, so the cost is one pass over the source.
+   ------------------------------------------------- */
+
+bool image_resize(const rgb_image *src, int max_edge, rgb_image *out)
+{
+    int w = src->width, h = src->height;
+    int longest = w > h ? w : h;
+    if (max_edge <= 0 || longest <= max_edge) return false;
+
+    int ow = (int)((int64_t)w * max_edge / longest);
+    int oh = (int)((int64_t)h * max_edge / longest);
+    if (ow < 1) ow = 1;
+    if (oh < 1) oh = 1;
+
+    unsigned char *dst = malloc((size_t)ow * oh * 3);
+    uint32_t *acc = malloc((size_t)w * 3 * sizeof(uint32_t));
+    if (!dst || !acc) {
+        free(dst);
+        free(acc);
+        return false;
+    }
+
+    for (int oy = 0; oy < oh; ++oy)
+    {
+        int sy0 = (int)((int64_t)oy * h / oh);
+        int sy1 = (int)((int64_t)(oy + 1) * h / oh);
+        if (sy1 <= sy0) sy1 = sy0 + 1;
+
+        /* Sum the source rows that fall into this output row */
+        memset(acc, 0, (size_t)w * 3 * sizeof(uint32_t));
+        for (int sy = sy0; sy < sy1; ++sy)
+        {
+            const unsigned char *row = src->pixels + (size_t)sy * w * 3;
+            for (int i = 0; i < w * 3; ++i) acc[i] += row[i];
+        }
+
+        unsigned char *drow = dst + (size_t)oy * ow * 3;
+        for (int ox = 0; ox < ow; ++ox)
+        {
+            int sx0 = (int)((int64_t)ox * w / ow);
+            int sx1 = (int)((int64_t)(ox + 1) * w / ow);
+            if (sx1 <= sx0) sx1 = sx0 + 1;
+            uint32_t n = (uint32_t)(sx1 - sx0) * (uint32_t)(sy1 - sy0);
+            uint32_t r = 0, g = 0, b = 0;
+            for (int sx = sx0; sx < sx1; ++sx) {
+                r += acc[sx * 3];
+                g += acc[sx * 3 + 1];
+                b += acc[sx * 3 + 2];
+            }
+            drow[ox * 3] = (unsigned char)((r + n / 2) / n);
+            drow[ox * 3 + 1] = (unsigned char)((g + n / 2) / n);
+            drow[ox * 3 + 2] = (unsigned char)((b + n / 2) / n);
+        }
+    }
+    free(acc);
+
+    out->pixels = dst;
+    out->width = ow;
+    out->height = oh;
+    return true;
+}
+
+unsigned char *image_prepare_upload(const unsigned char *data, size_t size,
+                                    size_t *out_size)
+{
+    if (prep_opts.max_edge <= 0) return NULL;
+
+    rgb_image decoded;
+    if (!image_decode(data, size, prep_opts.max_edge, &decoded)) return NULL;
+
+    /* A small JPEG is already what we would produce */
+    rgb_image resized;
+    bool shrunk = image_resize(&decoded, prep_opts.max_edge, &resized);
+    if (!shrunk && strcmp(image_mime_type(data, size), "image/jpeg") == 0) {
+        rgb_image_free(&decoded);
+        return NULL;
+    }
+
+    const rgb_image *img = shrunk ? &resized : &decoded;
+    unsigned char *jpeg = image_encode_jpeg(img, prep_opts.jpeg_quality, out_size);
+    rgb_image_free(&decoded);
+    if (shrunk) rgb_image_free(&resized);
+
+    if (jpeg && *out_size >= size) {
+        free(jpeg);
+        return NULL;
+    }
+    return jpeg;
+}
@@ -0,0 +1,48 @@
+#ifndef IMAGE_PREP_H
+#define IMAGE_PREP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* -------------------------------------------------
+   Image preprocessing: decode, downscale, re-encode
+   ------------------------------------------------- */
+
+/* 8-bit RGB, tightly packed (3 bytes per pixel) */
+typedef struct {
+    unsigned char *pixels;
+    int width;
+    int height;
+} rgb_image;
+
+typedef struct {
+    int max_edge;       /* longest side after resizing, 0 = send originals */
+    int jpeg_quality;   /* 1-100 */
+} prep_options;
+
+extern prep_options prep_opts;
+
+/* MIME type from the file's magic bytes (image/jpeg if unknown) */
+const char *image_mime_type(const unsigned char *data, size_t size);
+
+/* Decodes JPEG or PNG. `min_edge` lets JPEG decode at a reduced DCT
+   scale as long as the longest side stays >= min_edge (0 = full size).
+   EXIF orientation is applied. */
+bool image_decode(const unsigned char *data, size_t size, int min_edge, rgb_image *out);
+
+/* Box-filter downscale so the longest side is at most max_edge */
+bool image_resize(const rgb_image *src, int max_edge, rgb_image *out);
+
+unsigned char *image_encode_jpeg(const rgb_image *img, int quality, size_t *out_size);
+
+void rgb_image_free(rgb_image *img);
+
+/*
+ * Produces the bytes to upload for one image file. Returns a malloc'd
+ * buffer holding a downscaled JPEG, or NULL when the original should be
+ * sent as-is (unsupported format, already small, or no gain).
+ */
+unsigned char *image_prepare_upload(const unsigned char *data, size_t size,
+                                    size_t *out_size);
+
+#endif
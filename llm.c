@@ -0,0 +1,1780 @@
+#define _GNU_SOURCE
+#include "llm.h"
+#include "backend.h"
+#include "base64.h"
+#include "cache.h"
+#include "catalog.h"
+#include "embed.h"
+#include "hash.h"
+#include "image_prep.h"
+#include "metrics.h"
+#include "net.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <curl/curl.h>
+#include <jansson.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <ctype.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* -------------------------------------------------
+   LLM interaction helpers (generic POST request)
+   ------------------------------------------------- */
+
+const char *LLM_MODEL = "gpt-4-vision-preview";
+const double LLM_TEMPERATURE = 0.0;
+bool llm_log_progress = true;
+llm_options llm_opts = { false, LLM_CONSTRAIN_NONE, NULL,
+                         "http://localhost:9090/v1/embeddings", "clip", 95, 2, false };
+
+/* Transfer deadline: a fixed ceiling until there are latencies to go
+   by, then this multiple of the recent p95, within the bounds */
+#define LLM_TIMEOUT_MS 1800000.0
+#define LLM_DEADLINE_FACTOR 10.0
+#define LLM_DEADLINE_MIN_MS 30000.0
+/* Never hedge sooner than this, however fast the backends are */
+#define LLM_HEDGE_MIN_MS 250.0
+/* Retry n waits about LLM_RETRY_BASE_MS * 2^n, jittered by +-50% */
+#define LLM_RETRY_BASE_MS 250.0
+
+/* Structure to hold response data from libcurl */
+typedef struct {
+    char *data;
+    size_t size;
+    double t_first;     /* net_now_ms() of the first byte; curl's own
+                           start-transfer time marks the upload start */
+} ResponseData;
+
+/* libcurl write callback to accumulate response */
+static size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    size_t total = size * nmemb;
+    ResponseData *resp = (ResponseData *)userdata;
+    if (resp->size == 0) resp->t_first = net_now_ms();
+    char *new_data = realloc(resp->data, resp->size + total + 1);
+    if (!new_data) return 0; /* allocation failed */
+    memcpy(new_data + resp->size, ptr, total);
+    new_data[resp->size + total] = '\0';
+    resp->data = new_data;
+    resp->size += total;
+    return total;
+}
+
+/* -------------------------------------------------
+   Streamed replies (--stream): the answer arrives as server-sent
+   events, one content delta at a time. A verdict only needs the first
+   word, a rating its number, so the transfer is cut as soon as the rest
+   of the answer can no longer change the result; the server stops
+   generating and its slot is free for the next image.
+   ------------------------------------------------- */
+
+typedef enum {
+    STREAM_OFF,
+    STREAM_VERDICT,     /* one yes/no question */
+    STREAM_RATING,      /* a 0-10 number */
+    STREAM_MULTI        /* one answer per question */
+} stream_kind;
+
+typedef struct {
+    stream_kind kind;
+    int questions;          /* STREAM_MULTI */
+    size_t scanned;         /* response bytes already split into events */
+    char *content;          /* the deltas so far */
+    size_t content_len;
+    char *finish_reason;
+    bool events;            /* the server did stream (errors come as plain JSON) */
+    bool decided;           /* the answer settled; the transfer was cut on purpose */
+} stream_state;
+
+/* Drops what an earlier attempt received */
+static void stream_reset(stream_state *s)
+{
+    free(s->content);
+    free(s->finish_reason);
+    s->content = s->finish_reason = NULL;
+    s->content_len = s->scanned = 0;
+    s->events = s->decided = false;
+}
+
+static int yes_no_word(const char *p);
+static float parse_rating(const char *content);
+
+/* Whether the content so far fixes the result; `delta` is its latest part */
+static bool stream_settled(const stream_state *s, const char *delta)
+{
+    const char *p = s->content;
+    switch (s->kind)
+    {
+    case STREAM_VERDICT:
+        /* llm_answer_is_yes reads no further than this */
+        while (isspace((unsigned char)*p)) p++;
+        return strlen(p) >= 3 || strncasecmp(p, "no", 2) == 0;
+    case STREAM_RATING:
+        /* The number is complete once something follows it */
+        p = strpbrk(p, "0123456789");
+        if (!p) return false;
+        while (isdigit((unsigned char)*p) || *p == '.') p++;
+        return *p != '\0' && parse_rating(s->content) >= 0;
+    case STREAM_MULTI:
+    {
+        /* Only at a line or object end: "2. no" may still become "2. not sure" */
+        if (!strpbrk(delta, "\n}]")) return false;
+        signed char verdicts[LLM_MAX_QUERIES];
+        return llm_parse_multi_answer(s->content, s->questions, verdicts) == s->questions;
+    }
+    default:
+        return false;
+    }
+}
+
+/* Splits the complete lines received so far into events and collects
+   choices[0].delta.content */
+static void stream_scan(stream_state *s, const ResponseData *resp)
+{
+    while (!s->decided && s->scanned < resp->size)
+    {
+        const char *line = resp->data + s->scanned;
+        const char *end = memchr(line, '\n', resp->size - s->scanned);
+        if (!end) break;
+        s->scanned = (size_t)(end + 1 - resp->data);
+        if (strncmp(line, "data:", 5) != 0) continue;
+
+        const char *payload = line + 5;
+        while (payload < end && *payload == ' ') payload++;
+        size_t len = (size_t)(end - payload);
+        if (len && payload[len - 1] == '\r') len--;
+        if (len == 6 && memcmp(payload, "[DONE]", 6) == 0) continue;
+
+        json_t *chunk = json_loadb(payload, len, 0, NULL);
+        if (!chunk) continue;
+        s->events = true;
+        json_t *choice = json_array_get(json_object_get(chunk, "choices"), 0);
+        const char *delta = json_string_value(json_object_get(json_object_get(choice, "delta"), "content"));
+        const char *reason = json_string_value(json_object_get(choice, "finish_reason"));
+        if (reason) {
+            free(s->finish_reason);
+            s->finish_reason = strdup(reason);
+        }
+        size_t n = delta ? strlen(delta) : 0;
+        char *grown = n ? realloc(s->content, s->content_len + n + 1) : NULL;
+        if (grown) {
+            memcpy(grown + s->content_len, delta, n + 1);
+            s->content = grown;
+            s->content_len += n;
+            s->decided = stream_settled(s, delta);
+        }
+        json_decref(chunk);
+    }
+}
+
+/* Replaces the event stream in `resp` with the non-streamed response
+   it adds up to, so the rest of the client parses one format */
+static void stream_finish(stream_state *s, ResponseData *resp)
+{
+    json_t *message = json_object();
+    json_object_set_new(message, "role", json_string("assistant"));
+    json_object_set_new(message, "content", json_string(s->content ? s->content : ""));
+    json_t *choice = json_object();
+    json_object_set_new(choice, "index", json_integer(0));
+    json_object_set_new(choice, "message", message);
+    const char *reason = s->decided ? "early_stop" : s->finish_reason;
+    if (reason) json_object_set_new(choice, "finish_reason", json_string(reason));
+    json_t *choices = json_array();
+    json_array_append_new(choices, choice);
+    json_t *root = json_object();
+    json_object_set_new(root, "object", json_string("chat.completion"));
+    json_object_set_new(root, "choices", choices);
+    char *text = json_dumps(root, JSON_COMPACT);
+    json_decref(root);
+    if (!text) return;
+    free(resp->data);
+    resp->data = text;
+    resp->size = strlen(text);
+}
+
+/* -------------------------------------------------
+   Streaming request body: prefix, base64(image), suffix.
+   The encoded image only ever exists one curl buffer at a time.
+   ------------------------------------------------- */
+
+typedef struct {
+    char *prefix;
+    size_t prefix_len;
+    const unsigned char *data;
+    size_t data_len;
+    size_t b64_len;
+    const char *suffix;
+    size_t suffix_len;
+    size_t sent;            /* offset into the virtual body */
+    double t_sent;          /* net_now_ms() when the last byte went out */
+} body_stream;
+
+static size_t body_total(const body_stream *b)
+{
+    return b->prefix_len + b->b64_len + b->suffix_len;
+}
+
+static size_t body_read_callback(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    body_stream *b = (body_stream *)userdata;
+    size_t room = size * nitems;
+    size_t n = 0;
+
+    while (n < room && b->sent < body_total(b))
+    {
+        if (b->sent < b->prefix_len)
+        {
+            size_t chunk = b->prefix_len - b->sent;
+            if (chunk > room - n) chunk = room - n;
+            memcpy(buffer + n, b->prefix + b->sent, chunk);
+            n += chunk;
+            b->sent += chunk;
+        }
+        else if (b->sent < b->prefix_len + b->b64_len)
+        {
+            size_t off = b->sent - b->prefix_len;
+            size_t group = off / 4;
+            if (off % 4 == 0 && room - n >= 4)
+            {
+                /* Whole groups straight into curl's buffer */
+                size_t groups = (room - n) / 4;
+                size_t in_off = group * 3;
+                size_t in_len = groups * 3;
+                if (in_len > b->data_len - in_off) in_len = b->data_len - in_off;
+                size_t written = base64_encode_block(b->data + in_off, in_len, buffer + n);
+                n += written;
+                b->sent += written;
+            }
+            else
+            {
+                /* Buffer edge splits a group: encode it aside, copy a part */
+                char quad[4];
+                size_t in_off = group * 3;
+                size_t in_len = b->data_len - in_off < 3 ? b->data_len - in_off : 3;
+                base64_encode_block(b->data + in_off, in_len, quad);
+                size_t chunk = 4 - off % 4;
+                if (chunk > room - n) chunk = room - n;
+                memcpy(buffer + n, quad + off % 4, chunk);
+                n += chunk;
+                b->sent += chunk;
+            }
+        }
+        else
+        {
+            size_t off = b->sent - b->prefix_len - b->b64_len;
+            size_t chunk = b->suffix_len - off;
+            if (chunk > room - n) chunk = room - n;
+            memcpy(buffer + n, b->suffix + off, chunk);
+            n += chunk;
+            b->sent += chunk;
+        }
+    }
+    if (n && b->sent == body_total(b)) b->t_sent = net_now_ms();
+    return n;
+}
+
+/* Lets curl rewind the body (redirects, auth retries) */
+static int body_seek_callback(void *userdata, curl_off_t offset, int origin)
+{
+    body_stream *b = (body_stream *)userdata;
+    if (origin != SEEK_SET || offset < 0 || (size_t)offset > body_total(b))
+        return CURL_SEEKFUNC_CANTSEEK;
+    b->sent = (size_t)offset;
+    return CURL_SEEKFUNC_OK;
+}
+
+/* JSON string literal (with quotes) for arbitrary text */
+static char *json_quote(const char *text)
+{
+    json_t *str = json_string(text);
+    if (!str) return NULL;
+    char *quoted = json_dumps(str, JSON_ENCODE_ANY);
+    json_decref(str);
+    return quoted;
+}
+
+/* -------------------------------------------------
+   One chat completion request: body, response buffer and ownership of
+   the image bytes the body streams from. Runs on the network engine,
+   or on a plain easy handle when the engine is not started.
+   ------------------------------------------------- */
+
+typedef struct llm_call {
+    net_request net;            /* first member: the engine hands this back */
+    const char *url;
+    body_stream body;
+    /* chat calls: the prefix is rebuilt for the backend's model */
+    char *prompt_json;
+    const char *system_prompt;
+    const char *mime_type;
+    const char *model;          /* the prefix names this one */
+    backend *backend;
+    double t_start;
+    char *suffix;
+    ResponseData resp;
+    stream_state stream;
+    struct curl_slist *headers;
+    CURLcode code;
+    long http_status;
+    /* released together with the call */
+    void *map;
+    size_t map_size;
+    unsigned char *owned;
+    /* completion: a callback on the engine thread, or a blocking waiter */
+    void (*finish)(struct llm_call *call);
+    void *user;
+    /* tail latency, engine thread only: a hedge is a copy of a slow
+       call racing it; whichever answers first finishes, the other is
+       cancelled (`lost`) and owns the image bytes until it is freed */
+    bool hedgeable;
+    bool is_hedge;
+    bool lost;
+    struct llm_call *twin;      /* the other copy while both are running */
+    const backend *avoid;       /* a hedge's first choice is elsewhere */
+    int retries_left;
+    int attempt;
+    /* pool calls are listed so llm_pool_cancel can abort them; one from
+       before the last cancel must not start again (retry, hedge) */
+    bool listed;
+    unsigned int generation;
+    struct llm_call *prev_listed, *next_listed;
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t wait_cond;
+    bool finished;
+} llm_call;
+
+static double llm_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static unsigned long hedges_sent = 0, hedges_won = 0, retries_sent = 0, streams_cut = 0;
+static int hedges_running = 0;      /* engine thread only */
+static int hedges_max = 1;          /* a quarter of the pool's slots */
+
+/* Pool calls handed to the engine. Lock order: calls_mutex, then the
+   engine's own lock (net_submit / net_cancel). */
+static pthread_mutex_t calls_mutex = PTHREAD_MUTEX_INITIALIZER;
+static llm_call *calls_head = NULL;
+static unsigned int pool_generation = 0;   /* bumped by llm_pool_cancel */
+
+/* Caller holds calls_mutex */
+static void list_call(llm_call *call, unsigned int generation)
+{
+    call->generation = generation;
+    call->listed = true;
+    call->prev_listed = NULL;
+    call->next_listed = calls_head;
+    if (calls_head) calls_head->prev_listed = call;
+    calls_head = call;
+}
+
+static void unlist_call(llm_call *call)
+{
+    pthread_mutex_lock(&calls_mutex);
+    if (call->prev_listed) call->prev_listed->next_listed = call->next_listed;
+    else calls_head = call->next_listed;
+    if (call->next_listed) call->next_listed->prev_listed = call->prev_listed;
+    call->listed = false;
+    pthread_mutex_unlock(&calls_mutex);
+}
+
+/* Submits a listed call again unless the pool was cancelled since it
+   was first queued (checked under the lock, so a cancel cannot slip
+   in between and be undone by the submit) */
+static bool resubmit_call(llm_call *call, bool first)
+{
+    pthread_mutex_lock(&calls_mutex);
+    bool ok = call->generation == pool_generation &&
+              (first ? net_submit_first(&call->net) : net_submit(&call->net));
+    pthread_mutex_unlock(&calls_mutex);
+    return ok;
+}
+
+/* Everything before the image for a chat call, naming b's model */
+static bool build_chat_prefix(llm_call *call, const backend *b)
+{
+    char *prefix = NULL;
+    int len = asprintf(&prefix,
+             "{\"model\": %s, \"messages\": [{\"role\": \"system\", \"content\": \"%s\"}, {\"role\": \"user\", \"content\": [{\"type\": \"text\", \"text\": %s}, {\"type\": \"image_url\", \"image_url\": {\"url\": \"data:%s;base64,",
+             backend_model_json(b), call->system_prompt, call->prompt_json, call->mime_type);
+    if (len == -1) return false;
+    free(call->body.prefix);
+    call->body.prefix = prefix;
+    call->body.prefix_len = (size_t)len;
+    call->model = backend_model(b);
+    return true;
+}
+
+/* Streamed calls: stops the transfer (CURLE_WRITE_ERROR) once the answer settled */
+static size_t stream_write_callback(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    llm_call *call = (llm_call *)userdata;
+    size_t total = write_callback(ptr, size, nmemb, &call->resp);
+    if (total != size * nmemb) return total;
+    stream_scan(&call->stream, &call->resp);
+    return call->stream.decided ? 0 : total;
+}
+
+/* Runs when the transfer starts: a chat call is bound to a backend now,
+   so the choice sees the load of that moment */
+static void llm_call_setup(net_request *req, CURL *curl)
+{
+    llm_call *call = (llm_call *)req;
+    call->body.sent = 0;
+    call->body.t_sent = 0;
+    stream_reset(&call->stream);
+    if (call->prompt_json && (call->backend = backend_acquire(call->avoid)))
+    {
+        call->url = backend_url(call->backend);
+        /* Backends are fixed before the first request, so the name stays valid */
+        if (strcmp(backend_model(call->backend), call->model) != 0)
+            build_chat_prefix(call, call->backend);
+    }
+    call->t_start = llm_now_ms();
+
+    /* A wedged connection should not hold a slot for half an hour once
+       it is clear what normal looks like */
+    double p95 = backend_recent_latency(0.95);
+    double timeout = LLM_TIMEOUT_MS;
+    if (p95 > 0) {
+        timeout = p95 * LLM_DEADLINE_FACTOR;
+        if (timeout < LLM_DEADLINE_MIN_MS) timeout = LLM_DEADLINE_MIN_MS;
+        if (timeout > LLM_TIMEOUT_MS) timeout = LLM_TIMEOUT_MS;
+    }
+    call->net.wake_ms = 0;
+    if (call->hedgeable && !call->is_hedge && llm_opts.hedge_percentile > 0)
+    {
+        double after = backend_recent_latency(llm_opts.hedge_percentile / 100.0);
+        if (after > 0)
+            call->net.wake_ms = call->t_start + (after > LLM_HEDGE_MIN_MS ? after : LLM_HEDGE_MIN_MS);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, call->url);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, body_read_callback);
+    curl_easy_setopt(curl, CURLOPT_READDATA, &call->body);
+    curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, body_seek_callback);
+    curl_easy_setopt(curl, CURLOPT_SEEKDATA, &call->body);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body_total(&call->body));
+    if (call->stream.kind != STREAM_OFF) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, stream_write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, call);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &call->resp);
+    }
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    /* Optional: disable SSL verification if using self‑signed certs */
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, call->headers);
+}
+
+static void llm_call_free(llm_call *call);
+static llm_call *llm_call_clone(const llm_call *call);
+
+/* The image bytes stay with whichever copy is freed last */
+static void hand_over_image(llm_call *from, llm_call *to)
+{
+    if (!from->map && !from->owned) return;
+    to->map = from->map;
+    to->map_size = from->map_size;
+    to->owned = from->owned;
+    from->map = NULL;
+    from->owned = NULL;
+}
+
+/* Engine timer: the call is slower than most, race a copy against it */
+static void hedge_timer(net_request *req)
+{
+    llm_call *call = (llm_call *)req;
+    if (call->twin) return;
+    if (hedges_running >= hedges_max) {
+        /* Look again once a running hedge may have settled */
+        call->net.wake_ms = net_now_ms() + LLM_HEDGE_MIN_MS;
+        return;
+    }
+
+    llm_call *hedge = llm_call_clone(call);
+    if (!hedge) return;
+    hedge->is_hedge = true;
+    hedge->avoid = call->backend;
+    hedge->finish = call->finish;
+    hedge->user = call->user;
+    hedge->twin = call;
+    call->twin = hedge;
+    pthread_mutex_lock(&calls_mutex);
+    list_call(hedge, call->generation);
+    pthread_mutex_unlock(&calls_mutex);
+    /* Ahead of the queue: this is the request everyone is waiting on */
+    if (!resubmit_call(hedge, true)) {
+        call->twin = NULL;
+        llm_call_free(hedge);
+        return;
+    }
+    hedges_running++;
+    __atomic_fetch_add(&hedges_sent, 1, __ATOMIC_RELAXED);
+}
+
+static void llm_call_done(net_request *req, CURLcode code, long http_status)
+{
+    llm_call *call = (llm_call *)req;
+    if (call->stream.events)
+    {
+        /* Cut short on purpose: that is the answer, not a failed transfer */
+        if (call->stream.decided && code == CURLE_WRITE_ERROR) {
+            code = CURLE_OK;
+            __atomic_fetch_add(&streams_cut, 1, __ATOMIC_RELAXED);
+        }
+        if (code == CURLE_OK) stream_finish(&call->stream, &call->resp);
+    }
+    call->code = code;
+    call->http_status = http_status;
+    /* Overload and server errors count against the backend, bad requests do not */
+    bool healthy = code == CURLE_OK && http_status < 500 && http_status != 429;
+    bool aborted = code == CURLE_ABORTED_BY_CALLBACK;
+    if (call->backend) {
+        if (aborted)
+            backend_cancel(call->backend);
+        else
+            backend_release(call->backend, healthy, llm_now_ms() - call->t_start);
+        call->backend = NULL;
+    }
+    if (call->is_hedge) hedges_running--;
+    if (call->lost) {
+        llm_call_free(call);
+        return;
+    }
+
+    llm_call *twin = call->twin;
+    if (twin)
+    {
+        call->twin = twin->twin = NULL;
+        if (!healthy && !aborted) {
+            /* The other copy may still make it */
+            hand_over_image(call, twin);
+            llm_call_free(call);
+            return;
+        }
+        twin->lost = true;
+        hand_over_image(call, twin);
+        net_cancel(&twin->net);
+        if (call->is_hedge) __atomic_fetch_add(&hedges_won, 1, __ATOMIC_RELAXED);
+    }
+    else if (!healthy && !aborted && call->retries_left > 0 && net_running())
+    {
+        double jitter = 0.5 + random() / (double)RAND_MAX;
+        call->net.not_before_ms = net_now_ms() + LLM_RETRY_BASE_MS * (1 << call->attempt) * jitter;
+        call->retries_left--;
+        call->attempt++;
+        free(call->resp.data);
+        call->resp.data = NULL;
+        call->resp.size = 0;
+        call->resp.t_first = 0;
+        if (call->listed ? resubmit_call(call, false) : net_submit(&call->net)) {
+            __atomic_fetch_add(&retries_sent, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    call->finish(call);
+}
+
+typedef enum {
+    REPLY_TEXT,
+    REPLY_VERDICT,      /* --fast-verdict: one yes/no token */
+    REPLY_RATING        /* ranking: a 0-10 number */
+} reply_kind;
+
+/* Everything after the image. A fast verdict is one token, restricted
+   to yes / no where the server supports it, with its logprobs. */
+static char *request_suffix(double temperature, reply_kind reply, bool stream, size_t *len)
+{
+    char *suffix = NULL;
+    FILE *fp = open_memstream(&suffix, len);
+    if (!fp) return NULL;
+    fprintf(fp, "\"}}]}], \"temperature\": %f", temperature);
+    if (stream)
+        fputs(", \"stream\": true", fp);
+    if (reply == REPLY_RATING)
+        fputs(", \"max_tokens\": 4", fp);
+    if (reply == REPLY_VERDICT)
+    {
+        fputs(", \"max_tokens\": 1, \"logprobs\": true, \"top_logprobs\": 5", fp);
+        if (llm_opts.constraint == LLM_CONSTRAIN_GRAMMAR)
+            fputs(", \"grammar\": \"root ::= \\\"yes\\\" | \\\"no\\\" | \\\"Yes\\\" | \\\"No\\\"\"", fp);
+        else if (llm_opts.constraint == LLM_CONSTRAIN_CHOICE)
+            fputs(", \"guided_choice\": [\"yes\", \"no\"]", fp);
+        if (llm_opts.bias_tokens)
+        {
+            /* Token ids depend on the model's tokenizer, so they come from the user */
+            const char *p = llm_opts.bias_tokens;
+            bool first = true;
+            fputs(", \"logit_bias\": {", fp);
+            while (*p)
+            {
+                char *end;
+                long id = strtol(p, &end, 10);
+                if (end != p && id >= 0) {
+                    fprintf(fp, "%s\"%ld\": 100", first ? "" : ", ", id);
+                    first = false;
+                }
+                p = *end ? end + 1 : end;
+            }
+            fputc('}', fp);
+        }
+    }
+    fputc('}', fp);
+    if (fclose(fp) != 0) {
+        free(suffix);
+        return NULL;
+    }
+    return suffix;
+}
+
+/* Image, headers and engine hooks shared by every kind of call */
+static void llm_call_init(llm_call *call, const char *url, const unsigned char *image,
+                          size_t image_size)
+{
+    call->url = url;
+    call->body.data = image;
+    call->body.data_len = image_size;
+    call->body.b64_len = 4 * ((image_size + 2) / 3);
+    call->body.suffix = call->suffix;
+
+    /* Disable Expect: 100‑continue to avoid server rejecting large payloads */
+    call->headers = curl_slist_append(call->headers, "Content-Type: application/json");
+    call->headers = curl_slist_append(call->headers, "Expect:");
+
+    call->net.setup = llm_call_setup;
+    call->net.done = llm_call_done;
+    call->net.timer = hedge_timer;
+    call->retries_left = llm_opts.retries;
+}
+
+static llm_call *llm_call_new(const char *prompt, const unsigned char *image, size_t image_size,
+                              const char *mime_type, double temperature, reply_kind reply,
+                              stream_kind stream)
+{
+    llm_call *call = calloc(1, sizeof(*call));
+    if (!call) return NULL;
+
+    /* Build JSON payload around the image data */
+    call->prompt_json = json_quote(prompt);
+    call->system_prompt =
+        reply == REPLY_VERDICT ? "You are a helpful assistant. Answer with only yes or no."
+        : reply == REPLY_RATING ? "You are a helpful assistant. Answer with only a number."
+        : "You are a helpful assistant.";
+    call->mime_type = mime_type;
+    const backend *primary = backend_primary();
+    bool built = call->prompt_json && primary && build_chat_prefix(call, primary);
+    size_t suffix_len = 0;
+    if (built) call->suffix = request_suffix(temperature, reply, stream != STREAM_OFF, &suffix_len);
+    if (!built || !call->suffix) {
+        fprintf(stderr, "Failed to allocate payload string\n");
+        free(call->body.prefix);
+        free(call->prompt_json);
+        free(call);
+        return NULL;
+    }
+
+    call->body.suffix_len = suffix_len;
+    call->stream.kind = stream;
+    llm_call_init(call, NULL, image, image_size);
+    return call;
+}
+
+/* An embeddings request: the image as a data URI, or plain text when
+   `image` is NULL */
+static llm_call *embed_call_new(const char *text, const unsigned char *image, size_t image_size,
+                                const char *mime_type)
+{
+    llm_call *call = calloc(1, sizeof(*call));
+    if (!call) return NULL;
+
+    char *text_json = text ? json_quote(text) : NULL;
+    int prefix_len = -1;
+    if (image)
+        prefix_len = asprintf(&call->body.prefix, "{\"model\": \"%s\", \"input\": \"data:%s;base64,",
+                              llm_opts.embed_model, mime_type);
+    else if (text_json)
+        prefix_len = asprintf(&call->body.prefix, "{\"model\": \"%s\", \"input\": %s}",
+                              llm_opts.embed_model, text_json);
+    free(text_json);
+    call->suffix = strdup(image ? "\"}" : "");
+    if (prefix_len == -1 || !call->suffix) {
+        fprintf(stderr, "Failed to allocate payload string\n");
+        if (prefix_len != -1) free(call->body.prefix);
+        free(call->suffix);
+        free(call);
+        return NULL;
+    }
+
+    call->body.prefix_len = (size_t)prefix_len;
+    call->body.suffix_len = strlen(call->suffix);
+    llm_call_init(call, llm_opts.embed_url, image, image_size);
+    return call;
+}
+
+/* A second copy of a call, streaming from the same image bytes */
+static llm_call *llm_call_clone(const llm_call *call)
+{
+    llm_call *copy = calloc(1, sizeof(*copy));
+    if (!copy) return NULL;
+    copy->body.prefix = malloc(call->body.prefix_len + 1);
+    copy->prompt_json = call->prompt_json ? strdup(call->prompt_json) : NULL;
+    copy->suffix = strdup(call->suffix);
+    if (!copy->body.prefix || !copy->suffix || (call->prompt_json && !copy->prompt_json)) {
+        llm_call_free(copy);
+        return NULL;
+    }
+    memcpy(copy->body.prefix, call->body.prefix, call->body.prefix_len + 1);
+    copy->body.prefix_len = call->body.prefix_len;
+    copy->body.suffix_len = call->body.suffix_len;
+    copy->system_prompt = call->system_prompt;
+    copy->mime_type = call->mime_type;
+    copy->model = call->model;
+    copy->stream.kind = call->stream.kind;
+    copy->stream.questions = call->stream.questions;
+    llm_call_init(copy, call->url, call->body.data, call->body.data_len);
+    copy->retries_left = 0;
+    return copy;
+}
+
+static void llm_call_free(llm_call *call)
+{
+    if (call->listed) unlist_call(call);
+    free(call->body.prefix);
+    free(call->prompt_json);
+    free(call->suffix);
+    free(call->resp.data);
+    stream_reset(&call->stream);
+    if (call->headers) curl_slist_free_all(call->headers);
+    if (call->map) munmap(call->map, call->map_size);
+    free(call->owned);
+    free(call);
+}
+
+/* Hands over the response body, or NULL if the transfer failed */
+static char *llm_call_take_response(llm_call *call)
+{
+    if (call->code != CURLE_OK) {
+        /* Aborted on purpose: cancelled or shutting down */
+        if (call->code != CURLE_ABORTED_BY_CALLBACK)
+            fprintf(stderr, "LLM request failed: %s\n", curl_easy_strerror(call->code));
+        return NULL;
+    }
+    char *data = call->resp.data;
+    call->resp.data = NULL;
+    return data;
+}
+
+static void wake_waiter(llm_call *call)
+{
+    pthread_mutex_lock(&call->wait_mutex);
+    call->finished = true;
+    pthread_cond_signal(&call->wait_cond);
+    pthread_mutex_unlock(&call->wait_mutex);
+}
+
+static void finish_nothing(llm_call *call)
+{
+    (void)call;
+}
+
+/* Runs the call to completion on the calling thread and hands over
+   the response body, or NULL; frees the call */
+static char *llm_call_run(llm_call *call)
+{
+    if (net_running())
+    {
+        pthread_mutex_init(&call->wait_mutex, NULL);
+        pthread_cond_init(&call->wait_cond, NULL);
+        call->finish = wake_waiter;
+        if (net_submit(&call->net))
+        {
+            pthread_mutex_lock(&call->wait_mutex);
+            while (!call->finished)
+                pthread_cond_wait(&call->wait_cond, &call->wait_mutex);
+            pthread_mutex_unlock(&call->wait_mutex);
+        }
+        else
+        {
+            call->code = CURLE_ABORTED_BY_CALLBACK;
+        }
+        pthread_cond_destroy(&call->wait_cond);
+        pthread_mutex_destroy(&call->wait_mutex);
+    }
+    else
+    {
+        CURL *curl = curl_easy_init();
+        if (!curl) {
+            fprintf(stderr, "curl_easy_init() failed\n");
+            llm_call_free(call);
+            return NULL;
+        }
+        llm_call_setup(&call->net, curl);
+        CURLcode code = curl_easy_perform(curl);
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        net_read_timings(curl, &call->net.timings);
+        curl_easy_cleanup(curl);
+        call->finish = finish_nothing;
+        llm_call_done(&call->net, code, status);
+    }
+
+    char *response = llm_call_take_response(call);
+    llm_call_free(call);
+    return response;
+}
+
+/*
+ * Sends a chat completion request to the LLM backend.
+ * `prompt` – the user message to send.
+ * `image` / `image_size` – raw image bytes; base64 is produced while
+ *   the body is uploaded, so no encoded copy is ever held in memory.
+ * `mime_type` – type of the image data (e.g., "image/jpeg").
+ * `temperature` – sampling temperature (e.g., 0.7).
+ * Blocks until done; uses the network engine's connections when it is
+ * running (must then not be called from the engine thread).
+ * Returns a newly allocated string containing the raw JSON response,
+ * or NULL on failure. Caller must free() the returned pointer.
+ */
+char *getLLMResponse(const char *prompt, const unsigned char *image, size_t image_size,
+                     const char *mime_type, double temperature)
+{
+    llm_call *call = llm_call_new(prompt, image, image_size, mime_type, temperature, REPLY_TEXT,
+                                  STREAM_OFF);
+    if (!call) return NULL;
+    return llm_call_run(call);   /* Caller must free */
+}
+
+/* data[0].embedding of an embeddings response, malloc'd, or NULL */
+static float *parse_embedding(const char *response, int *dim)
+{
+    *dim = 0;
+    json_t *root = response ? json_loads(response, 0, NULL) : NULL;
+    json_t *values = json_object_get(json_array_get(json_object_get(root, "data"), 0), "embedding");
+    size_t n = json_array_size(values);
+    float *vec = n ? malloc(n * sizeof(float)) : NULL;
+    for (size_t i = 0; vec && i < n; ++i)
+    {
+        json_t *v = json_array_get(values, i);
+        if (!json_is_number(v)) {
+            free(vec);
+            vec = NULL;
+            break;
+        }
+        vec[i] = (float)json_number_value(v);
+    }
+    if (vec) *dim = (int)n;
+    else if (root) fprintf(stderr, "Unexpected embeddings response\n");
+    json_decref(root);
+    return vec;
+}
+
+float *llm_embed_text(const char *text, int *dim)
+{
+    *dim = 0;
+    llm_call *call = embed_call_new(text, NULL, 0, NULL);
+    if (!call) return NULL;
+    char *response = llm_call_run(call);
+    float *vec = parse_embedding(response, dim);
+    free(response);
+    return vec;
+}
+
+json_t *llm_parse_response(const char *response, const char **content,
+                           const char **finish_reason)
+{
+    *content = NULL;
+    *finish_reason = NULL;
+    if (!response) return NULL;
+
+    json_error_t error;
+    json_t *root = json_loads(response, 0, &error);
+    if (!root)
+    {
+        fprintf(stderr, "JSON parse error: %s\n", error.text);
+        return NULL;
+    }
+
+    json_t *choices = json_object_get(root, "choices");
+    if (!json_is_array(choices) || json_array_size(choices) == 0)
+    {
+        fprintf(stderr, "Unexpected JSON structure: missing choices array\n");
+        json_decref(root);
+        return NULL;
+    }
+
+    json_t *first = json_array_get(choices, 0);
+    json_t *message = json_object_get(first, "message");
+    *finish_reason = json_string_value(json_object_get(first, "finish_reason"));
+    if (json_is_object(message))
+        *content = json_string_value(json_object_get(message, "content"));
+    return root;
+}
+
+bool llm_answer_is_yes(const char *content)
+{
+    /* Determine keep/remove based on first word */
+    bool keep = true;
+    if (content) {
+        const char *p = content;
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (strncasecmp(p, "yes", 3) == 0) {
+            keep = true;
+        } else if (strncasecmp(p, "no", 2) == 0) {
+            keep = false;
+        }
+    }
+    return keep;
+}
+
+/* 1 / 0 for a yes / no word at the start of `p`, -1 otherwise */
+static int yes_no_word(const char *p)
+{
+    if (strncasecmp(p, "yes", 3) == 0 && !isalpha((unsigned char)p[3])) return 1;
+    if (strncasecmp(p, "no", 2) == 0 && !isalpha((unsigned char)p[2])) return 0;
+    return -1;
+}
+
+/* P(yes) against P(no) over the first token's alternatives, or -1
+   when the server sent no logprobs */
+static double first_token_p_yes(json_t *choice)
+{
+    json_t *content = json_object_get(json_object_get(choice, "logprobs"), "content");
+    json_t *first = json_array_get(content, 0);
+    if (!json_is_object(first)) return -1;
+
+    json_t *top = json_object_get(first, "top_logprobs");
+    size_t n = json_array_size(top);
+    double p_yes = 0, p_no = 0;
+    for (size_t i = 0; i < (n ? n : 1); ++i)
+    {
+        json_t *alt = n ? json_array_get(top, i) : first;
+        const char *token = json_string_value(json_object_get(alt, "token"));
+        json_t *logprob = json_object_get(alt, "logprob");
+        if (!token || !json_is_number(logprob)) continue;
+        while (isspace((unsigned char)*token)) token++;
+        int v = yes_no_word(token);
+        if (v == 1) p_yes += exp(json_number_value(logprob));
+        else if (v == 0) p_no += exp(json_number_value(logprob));
+    }
+    if (p_yes + p_no <= 0) return -1;
+    return p_yes / (p_yes + p_no);
+}
+
+/* First number in a 0-10 rating reply, scaled to 0..1, or -1 */
+static float parse_rating(const char *content)
+{
+    const char *p = content ? strpbrk(content, "0123456789") : NULL;
+    if (!p) return -1;
+    double v = strtod(p, NULL);
+    if (v < 0 || v > 10) return -1;
+    return (float)(v / 10.0);
+}
+
+static int json_yes_no(json_t *value)
+{
+    if (json_is_boolean(value)) return json_is_true(value) ? 1 : 0;
+    const char *text = json_string_value(value);
+    if (!text) return -1;
+    while (isspace((unsigned char)*text)) text++;
+    return yes_no_word(text);
+}
+
+/* {"1": "yes", ...} or ["yes", ...]; the object may sit inside prose or a code fence */
+static int parse_multi_json(const char *content, int count, signed char *verdicts)
+{
+    const char *open = strpbrk(content, "{[");
+    if (!open) return 0;
+    const char *close = strrchr(content, *open == '{' ? '}' : ']');
+    if (!close || close < open) return 0;
+
+    json_t *root = json_loadb(open, (size_t)(close - open + 1), 0, NULL);
+    if (!root) return 0;
+
+    int answered = 0;
+    if (json_is_object(root))
+    {
+        const char *key;
+        json_t *value;
+        json_object_foreach(root, key, value)
+        {
+            int idx = atoi(key) - 1;
+            int v = json_yes_no(value);
+            if (idx < 0 || idx >= count || v < 0) continue;
+            if (verdicts[idx] < 0) answered++;
+            verdicts[idx] = (signed char)v;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < json_array_size(root) && (int)i < count; ++i)
+        {
+            int v = json_yes_no(json_array_get(root, i));
+            if (v < 0) continue;
+            verdicts[i] = (signed char)v;
+            answered++;
+        }
+    }
+    json_decref(root);
+    return answered;
+}
+
+/* One answer per line, "2. yes" / "- No" / "3) Does it contain X? Yes" */
+static int parse_multi_lines(const char *content, int count, signed char *verdicts)
+{
+    int answered = 0;
+    int next = 0;
+    const char *line = content;
+    while (*line)
+    {
+        const char *end = strchr(line, '\n');
+        if (!end) end = line + strlen(line);
+
+        const char *p = line;
+        while (p < end && (isspace((unsigned char)*p) || *p == '-' || *p == '*')) p++;
+        int idx = next;
+        if (p < end && isdigit((unsigned char)*p)) {
+            idx = (int)strtol(p, (char **)&p, 10) - 1;
+            while (p < end && (*p == '.' || *p == ')' || *p == ':' || isspace((unsigned char)*p))) p++;
+        }
+
+        /* The answer follows any echoed question: take the last yes/no word */
+        int v = -1;
+        for (const char *q = p; q < end; ++q)
+            if ((q == p || !isalpha((unsigned char)q[-1])) && yes_no_word(q) >= 0)
+                v = yes_no_word(q);
+
+        if (v >= 0 && idx >= 0 && idx < count) {
+            if (verdicts[idx] < 0) answered++;
+            verdicts[idx] = (signed char)v;
+            next = idx + 1;
+        }
+        line = *end ? end + 1 : end;
+    }
+    return answered;
+}
+
+int llm_parse_multi_answer(const char *content, int count, signed char *verdicts)
+{
+    for (int i = 0; i < count; ++i) verdicts[i] = -1;
+    if (!content) return 0;
+    int answered = parse_multi_json(content, count, verdicts);
+    if (answered == 0)
+        answered = parse_multi_lines(content, count, verdicts);
+    return answered;
+}
+
+/* -------------------------------------------------
+   Worker pool: prep threads read, hash and downscale images, then hand
+   the request to the network engine, which keeps up to `jobs` of them
+   in flight on reused connections. Per-file results are queued for
+   the main loop to consume.
+
+   A job asks about one or more phrases. Each phrase is cached on its
+   own (under the single-question prompt), so only the phrases missing
+   from the cache go out, all of them in one request.
+   ------------------------------------------------- */
+
+typedef struct llm_job {
+    char *path;
+    char *phrases[LLM_MAX_QUERIES];
+    int phrase_count;
+    bool rank;              /* score the image instead of a verdict */
+    bool embed;             /* store its embedding instead of asking */
+    unsigned int batch;
+    unsigned int generation;    /* pool_generation when queued */
+    uint64_t content_hash;
+    char *questions[LLM_MAX_QUERIES];   /* cache key text, NULL = not cached */
+    signed char verdicts[LLM_MAX_QUERIES];
+    int asked[LLM_MAX_QUERIES];     /* phrase indexes sent in the request */
+    int asked_count;
+    size_t file_bytes;
+    size_t upload_bytes;
+    double t_submit;        /* llm_now_ms() stamps */
+    double t_prep_start;
+    double t_read_end;
+    double t_prep_end;
+    double t_net_start;     /* the answering transfer */
+    net_timings net;
+    double upload_ms;
+    double first_byte_ms;
+    double parse_ms;
+    struct llm_job *next;
+} llm_job;
+
+typedef struct llm_done {
+    llm_result result;
+    struct llm_done *next;
+} llm_done;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static llm_job *job_head = NULL, *job_tail = NULL;
+static llm_done *done_head = NULL, *done_tail = NULL;
+static pthread_t *pool_threads = NULL;
+static int pool_size = 0;
+static int pool_jobs = 0;
+static bool pool_shutdown = false;
+
+static void job_free(llm_job *job)
+{
+    free(job->path);
+    for (int i = 0; i < job->phrase_count; ++i) {
+        free(job->phrases[i]);
+        free(job->questions[i]);
+    }
+    free(job);
+}
+
+/* Opens a non-empty file and stats it, or -1 */
+static int open_file(const char *filepath, struct stat *st)
+{
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open image file: %s\n", filepath);
+        return -1;
+    }
+    if (fstat(fd, st) == -1 || st->st_size <= 0) {
+        fprintf(stderr, "Failed to read file %s\n", filepath);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Maps the whole file read-only, or NULL; release with munmap */
+static unsigned char *map_file(int fd, const char *filepath, size_t size)
+{
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map file %s\n", filepath);
+        return NULL;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    return map;
+}
+
+/* Fills in answer / verdict from a raw chat completion body */
+static void set_result_from_response(llm_result *r, const char *response)
+{
+    const char *content = NULL;
+    const char *finish_reason = NULL;
+    r->p_yes = -1;
+    r->score = -1;
+    json_t *root = llm_parse_response(response, &content, &finish_reason);
+    if (!root) return;
+
+    r->ok = true;
+    r->answer = content ? strdup(content) : NULL;
+    r->finish_reason = finish_reason ? strdup(finish_reason) : NULL;
+    r->keep = llm_answer_is_yes(content);
+    r->p_yes = (float)first_token_p_yes(json_array_get(json_object_get(root, "choices"), 0));
+
+    /* A truncated or odd first token: let the probabilities decide */
+    const char *p = content ? content : "";
+    while (isspace((unsigned char)*p)) p++;
+    if (r->p_yes >= 0 && yes_no_word(p) < 0) r->keep = r->p_yes >= 0.5f;
+    json_decref(root);
+}
+
+/* Queues a finished result; takes ownership of the job */
+static void push_result(llm_job *job, llm_done *done)
+{
+    llm_result *r = &done->result;
+    double now = llm_now_ms();
+    if (job->t_prep_end == 0) job->t_prep_end = now;
+    r->path = job->path;
+    r->batch = job->batch;
+    r->content_hash = job->content_hash;
+    r->queue_ms = job->t_prep_start - job->t_submit;
+    r->prep_ms = job->t_prep_end - job->t_prep_start;
+    r->read_ms = (job->t_read_end ? job->t_read_end : job->t_prep_end) - job->t_prep_start;
+    r->encode_ms = r->prep_ms - r->read_ms;
+    r->request_ms = r->cached ? 0 : now - job->t_prep_end;
+    if (job->t_net_start > 0) {
+        r->wait_ms = job->t_net_start - job->t_prep_end;
+        r->connect_ms = job->net.connect_ms;
+        r->upload_ms = job->upload_ms;
+        r->first_byte_ms = job->first_byte_ms;
+    }
+    r->parse_ms = job->parse_ms;
+    r->total_ms = now - job->t_submit;
+    r->file_bytes = job->file_bytes;
+    r->upload_bytes = job->upload_bytes;
+    r->query_count = job->phrase_count;
+    memcpy(r->verdicts, job->verdicts, sizeof(r->verdicts));
+    if (r->ok) {
+        /* Unclear answers keep the file, as for a single question */
+        r->keep = true;
+        for (int i = 0; i < job->phrase_count; ++i)
+            if (job->verdicts[i] == 0) r->keep = false;
+    }
+    done->next = NULL;
+    job->path = NULL;
+    job_free(job);
+    if (!r->cancelled) metrics_record(r);
+
+    pthread_mutex_lock(&pool_mutex);
+    if (done_tail) done_tail->next = done;
+    else done_head = done;
+    done_tail = done;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+/* Files the answer to question `idx` under the model that gave it */
+static void job_cache_store(const llm_job *job, int idx, const char *model, bool keep,
+                            const char *answer)
+{
+    if (!job->questions[idx] || !model || !verdict_cache_enabled()) return;
+    uint64_t key = verdict_cache_request_key(job->questions[idx], model, LLM_TEMPERATURE);
+    verdict_cache_store(job->content_hash, key, keep, answer);
+}
+
+/* Engine thread: the upload for one job finished (or was aborted) */
+static void pool_call_finished(llm_call *call)
+{
+    llm_job *job = call->user;
+    const char *model = call->model;    /* owned by its backend */
+    bool cancelled = call->code == CURLE_ABORTED_BY_CALLBACK;
+    char *response = llm_call_take_response(call);
+    if (call->t_start > 0 && call->code != CURLE_ABORTED_BY_CALLBACK)
+    {
+        job->t_net_start = call->t_start;
+        job->net = call->net.timings;
+        /* Sending starts at pretransfer and ends with the last body byte */
+        double sending_from = call->t_start + job->net.pretransfer_ms;
+        if (call->body.t_sent > sending_from) job->upload_ms = call->body.t_sent - sending_from;
+        if (call->resp.t_first > 0) job->first_byte_ms = call->resp.t_first - call->t_start;
+    }
+    llm_call_free(call);
+    double t_parse = llm_now_ms();
+
+    llm_done *done = calloc(1, sizeof(*done));
+    if (!done) {
+        free(response);
+        job_free(job);
+        return;
+    }
+    llm_result *r = &done->result;
+    r->cancelled = cancelled;
+    if (job->embed)
+    {
+        int dim;
+        float *vec = parse_embedding(response, &dim);
+        free(response);
+        job->parse_ms = llm_now_ms() - t_parse;
+        r->p_yes = r->score = -1;
+        r->ok = vec && embed_index_add(job->content_hash, vec, dim);
+        free(vec);
+        push_result(job, done);
+        return;
+    }
+    set_result_from_response(r, response);
+    free(response);
+    job->parse_ms = llm_now_ms() - t_parse;
+    if (!r->ok) {
+        push_result(job, done);
+        return;
+    }
+
+    if (job->rank)
+    {
+        /* Fast verdicts score by P(yes), else by the clear yes/no */
+        r->score = !llm_opts.fast_verdict ? parse_rating(r->answer)
+                 : r->p_yes >= 0 ? r->p_yes : r->keep ? 1.0f : 0.0f;
+        job->verdicts[0] = r->score < 0 ? -1 : r->score >= 0.5f;
+        if (r->score >= 0) {
+            char text[16];
+            snprintf(text, sizeof(text), "%.4f", r->score);
+            job_cache_store(job, 0, model, r->score >= 0.5f, text);
+        }
+    }
+    else if (job->asked_count == 1)
+    {
+        int idx = job->asked[0];
+        job->verdicts[idx] = r->keep;
+        job_cache_store(job, idx, model, r->keep, r->answer);
+    }
+    else
+    {
+        signed char answers[LLM_MAX_QUERIES];
+        llm_parse_multi_answer(r->answer, job->asked_count, answers);
+        for (int i = 0; i < job->asked_count; ++i)
+        {
+            int idx = job->asked[i];
+            job->verdicts[idx] = answers[i];
+            if (answers[i] >= 0)
+                job_cache_store(job, idx, model, answers[i] == 1, answers[i] ? "yes" : "no");
+        }
+    }
+    push_result(job, done);
+}
+
+static char *single_prompt(const char *phrase)
+{
+    char *prompt = NULL;
+    if (asprintf(&prompt, "Does the image contain %s?", phrase) == -1) return NULL;
+    return prompt;
+}
+
+/* Ranking needs a score: a 0-10 rating, or the yes/no question whose
+   logprobs give P(yes) in fast verdict mode */
+static char *rank_prompt(const char *phrase)
+{
+    if (llm_opts.fast_verdict) return single_prompt(phrase);
+    char *prompt = NULL;
+    if (asprintf(&prompt, "How well does the image show %s? Rate it from 0 (not at all) "
+                 "to 10 (perfectly) and reply with only the number.", phrase) == -1)
+        return NULL;
+    return prompt;
+}
+
+/* Scores are cached apart from verdicts to the same question */
+static char *rank_cache_text(const char *phrase)
+{
+    char *prompt = rank_prompt(phrase);
+    char *text = NULL;
+    if (prompt && asprintf(&text, "%s\n[score]", prompt) == -1) text = NULL;
+    free(prompt);
+    return text;
+}
+
+/* Numbered questions for the phrases in job->asked, answered as JSON */
+static char *multi_prompt(const llm_job *job)
+{
+    char *prompt = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&prompt, &len);
+    if (!fp) return NULL;
+    fputs("Answer each question about the image with yes or no.\n", fp);
+    for (int i = 0; i < job->asked_count; ++i)
+        fprintf(fp, "%d. Does the image contain %s?\n", i + 1, job->phrases[job->asked[i]]);
+    fputs("Reply with only a JSON object that maps each question number to \"yes\" or \"no\", "
+          "for example {\"1\": \"yes\", \"2\": \"no\"}.", fp);
+    if (fclose(fp) != 0) {
+        free(prompt);
+        return NULL;
+    }
+    return prompt;
+}
+
+/* Prep thread: resolves the job from the cache or submits its upload */
+static void run_job(llm_job *job)
+{
+    llm_done *done = calloc(1, sizeof(*done));
+    if (!done) {
+        job_free(job);
+        return;
+    }
+    done->result.p_yes = -1;
+    done->result.score = -1;
+
+    struct stat st;
+    int fd = open_file(job->path, &st);
+    if (fd == -1) {
+        push_result(job, done);
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    job->file_bytes = size;
+
+    /* Same bytes, same question, same model: reuse the old verdicts.
+       A file the catalog has hashed at this size, mtime and inode is
+       not read at all unless something has to be asked. */
+    llm_result *r = &done->result;
+    bool use_cache = verdict_cache_enabled();
+    unsigned char *map = NULL;
+    if ((use_cache || job->embed) && !catalog_lookup_hash(job->path, &st, &job->content_hash))
+    {
+        map = map_file(fd, job->path, size);
+        if (!map) {
+            close(fd);
+            push_result(job, done);
+            return;
+        }
+        job->content_hash = hash64(map, size, 0);
+        catalog_store_hash(job->path, &st, job->content_hash);
+    }
+    /* Any configured model's answer will do; the first backend's wins */
+    const char *models[16];
+    int model_count = use_cache ? backend_models(models, 16) : 0;
+    for (int i = 0; i < job->phrase_count; ++i)
+    {
+        if (use_cache)
+        {
+            char *question = job->rank ? rank_cache_text(job->phrases[i])
+                                       : single_prompt(job->phrases[i]);
+            if (!question) continue;
+            free(job->questions[i]);
+            job->questions[i] = question;
+            bool keep, hit = false;
+            for (int m = 0; m < model_count && !hit; ++m)
+            {
+                uint64_t key = verdict_cache_request_key(question, models[m], LLM_TEMPERATURE);
+                hit = verdict_cache_lookup(job->content_hash, key, &keep,
+                                           job->phrase_count == 1 ? &r->answer : NULL);
+            }
+            if (hit) {
+                job->verdicts[i] = keep;
+                continue;
+            }
+        }
+        job->asked[job->asked_count++] = i;
+    }
+    job->t_read_end = llm_now_ms();
+    if (job->embed && !embed_index_contains(job->content_hash))
+        job->asked_count = 1;
+    if (job->asked_count == 0)
+    {
+        r->ok = true;
+        r->cached = true;
+        if (job->rank && r->answer) r->score = strtof(r->answer, NULL);
+        if (map) munmap(map, size);
+        close(fd);
+        push_result(job, done);
+        return;
+    }
+    if (!map) map = map_file(fd, job->path, size);
+    close(fd);
+    if (!map) {
+        push_result(job, done);
+        return;
+    }
+
+    /* Multi-question answers need more than one token */
+    reply_kind reply = job->rank && !llm_opts.fast_verdict ? REPLY_RATING
+                     : llm_opts.fast_verdict && job->asked_count == 1 ? REPLY_VERDICT
+                     : REPLY_TEXT;
+    /* Streaming pays off where the reply runs on past the part that
+       decides; a fast verdict is a single token anyway */
+    stream_kind stream = !llm_opts.stream || job->embed || reply == REPLY_VERDICT ? STREAM_OFF
+                       : reply == REPLY_RATING ? STREAM_RATING
+                       : job->asked_count == 1 ? STREAM_VERDICT
+                       : STREAM_MULTI;
+    char *prompt = job->embed ? NULL
+                 : job->rank ? rank_prompt(job->phrases[0])
+                 : job->asked_count == 1 ? single_prompt(job->phrases[job->asked[0]])
+                 : multi_prompt(job);
+    if (!prompt && !job->embed) {
+        munmap(map, size);
+        push_result(job, done);
+        return;
+    }
+
+    /* Cancelled while this one was being read: spare the encode */
+    if (job->generation != __atomic_load_n(&pool_generation, __ATOMIC_ACQUIRE)) {
+        munmap(map, size);
+        free(prompt);
+        r->cancelled = true;
+        push_result(job, done);
+        return;
+    }
+
+    /* Downscale to what the vision encoder will use anyway */
+    size_t prepared_size = 0;
+    unsigned char *prepared = image_prepare_upload(map, size, &prepared_size);
+    llm_call *call;
+    if (prepared) {
+        if (llm_log_progress)
+            printf("Processing image: %s (%zu -> %zu bytes, saved %zu)\n",
+                   job->path, size, prepared_size, size - prepared_size);
+        munmap(map, size);
+        call = job->embed ? embed_call_new(NULL, prepared, prepared_size, "image/jpeg")
+             : llm_call_new(prompt, prepared, prepared_size, "image/jpeg", LLM_TEMPERATURE, reply, stream);
+        if (call) call->owned = prepared;
+        else free(prepared);
+    } else {
+        if (llm_log_progress)
+            printf("Processing image: %s (%zu bytes, sent as-is)\n", job->path, size);
+        const char *mime = image_mime_type(map, size);
+        call = job->embed ? embed_call_new(NULL, map, size, mime)
+             : llm_call_new(prompt, map, size, mime, LLM_TEMPERATURE, reply, stream);
+        if (call) {
+            call->map = map;
+            call->map_size = size;
+        } else {
+            munmap(map, size);
+        }
+    }
+    free(prompt);
+    if (!call) {
+        push_result(job, done);
+        return;
+    }
+
+    free(done); /* the engine callback allocates the real one */
+    job->upload_bytes = call->body.data_len;
+    job->t_prep_end = llm_now_ms();
+    call->finish = pool_call_finished;
+    call->user = job;
+    call->hedgeable = true;
+    call->stream.questions = job->asked_count;
+
+    /* Listed and submitted in one go, unless a cancel came during prep */
+    pthread_mutex_lock(&calls_mutex);
+    bool current = job->generation == pool_generation;
+    if (current) list_call(call, job->generation);
+    bool submitted = current && net_submit(&call->net);
+    pthread_mutex_unlock(&calls_mutex);
+    if (!submitted)
+        llm_call_done(&call->net, CURLE_ABORTED_BY_CALLBACK, 0);
+}
+
+static void *pool_worker(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&pool_mutex);
+        while (!job_head && !pool_shutdown)
+            pthread_cond_wait(&pool_cond, &pool_mutex);
+        if (pool_shutdown) {
+            pthread_mutex_unlock(&pool_mutex);
+            break;
+        }
+        llm_job *job = job_head;
+        job_head = job->next;
+        if (!job_head) job_tail = NULL;
+        pthread_mutex_unlock(&pool_mutex);
+
+        job->t_prep_start = llm_now_ms();
+        run_job(job);
+    }
+    return NULL;
+}
+
+bool llm_pool_start(int jobs)
+{
+    if (pool_threads) return true;
+    if (jobs < 1) jobs = 1;
+
+    if (!net_start(jobs, true)) {
+        fprintf(stderr, "Failed to start network engine\n");
+        return false;
+    }
+
+    /* Prep is CPU-bound: no point in more threads than cores */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = jobs;
+    if (cpus > 0 && workers > cpus) workers = (int)cpus;
+
+    pool_threads = calloc(workers, sizeof(pthread_t));
+    if (!pool_threads) {
+        net_stop();
+        return false;
+    }
+    pool_shutdown = false;
+    for (int i = 0; i < workers; ++i)
+    {
+        if (pthread_create(&pool_threads[i], NULL, pool_worker, NULL) != 0)
+        {
+            fprintf(stderr, "Failed to start prep worker %d\n", i);
+            break;
+        }
+        pool_size++;
+    }
+    pool_jobs = jobs;
+    hedges_max = jobs / 4 > 1 ? jobs / 4 : 1;
+    return pool_size > 0;
+}
+
+void llm_pool_stop(void)
+{
+    if (!pool_threads) return;
+
+    /* Free the backends' slots first; the prep threads may take a moment */
+    llm_pool_cancel();
+    pthread_mutex_lock(&pool_mutex);
+    pool_shutdown = true;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (int i = 0; i < pool_size; ++i)
+        pthread_join(pool_threads[i], NULL);
+    free(pool_threads);
+    pool_threads = NULL;
+    pool_size = 0;
+    pool_jobs = 0;
+
+    /* Aborts uploads still in flight; their results land in the queue */
+    net_stop();
+
+    llm_pool_cancel_pending();
+    llm_result r;
+    while (llm_pool_poll(&r)) llm_result_free(&r);
+}
+
+int llm_pool_workers(void)
+{
+    return pool_jobs;
+}
+
+void llm_pool_tail_stats(unsigned long *hedges, unsigned long *hedge_wins,
+                         unsigned long *retries)
+{
+    *hedges = __atomic_load_n(&hedges_sent, __ATOMIC_RELAXED);
+    *hedge_wins = __atomic_load_n(&hedges_won, __ATOMIC_RELAXED);
+    *retries = __atomic_load_n(&retries_sent, __ATOMIC_RELAXED);
+}
+
+unsigned long llm_pool_streams_cut(void)
+{
+    return __atomic_load_n(&streams_cut, __ATOMIC_RELAXED);
+}
+
+bool llm_pool_submit(const char *filepath, const char *search_phrase, unsigned int batch)
+{
+    return llm_pool_submit_multi(filepath, &search_phrase, 1, batch);
+}
+
+static llm_job *job_new(const char *filepath, const char *const *phrases, int count,
+                        unsigned int batch)
+{
+    if (count < 1 || count > LLM_MAX_QUERIES) return NULL;
+    llm_job *job = calloc(1, sizeof(*job));
+    if (!job) return NULL;
+    job->path = strdup(filepath);
+    job->batch = batch;
+    job->t_submit = llm_now_ms();
+    memset(job->verdicts, -1, sizeof(job->verdicts));
+    for (int i = 0; i < count; ++i)
+        if ((job->phrases[job->phrase_count] = strdup(phrases[i])))
+            job->phrase_count++;
+    if (!job->path || job->phrase_count != count) {
+        job_free(job);
+        return NULL;
+    }
+    return job;
+}
+
+static void job_enqueue(llm_job *job)
+{
+    job->generation = __atomic_load_n(&pool_generation, __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&pool_mutex);
+    if (job_tail) job_tail->next = job;
+    else job_head = job;
+    job_tail = job;
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+bool llm_pool_submit_multi(const char *filepath, const char *const *phrases, int count,
+                           unsigned int batch)
+{
+    llm_job *job = job_new(filepath, phrases, count, batch);
+    if (!job) return false;
+    job_enqueue(job);
+    return true;
+}
+
+bool llm_pool_submit_rank(const char *filepath, const char *phrase, unsigned int batch)
+{
+    llm_job *job = job_new(filepath, &phrase, 1, batch);
+    if (!job) return false;
+    job->rank = true;
+    job_enqueue(job);
+    return true;
+}
+
+bool llm_pool_submit_embed(const char *filepath, unsigned int batch)
+{
+    llm_job *job = calloc(1, sizeof(*job));
+    if (!job || !(job->path = strdup(filepath))) {
+        free(job);
+        return false;
+    }
+    job->embed = true;
+    job->batch = batch;
+    job->t_submit = llm_now_ms();
+    memset(job->verdicts, -1, sizeof(job->verdicts));
+    job_enqueue(job);
+    return true;
+}
+
+int llm_pool_cancel_pending(void)
+{
+    pthread_mutex_lock(&pool_mutex);
+    llm_job *job = job_head;
+    job_head = job_tail = NULL;
+    pthread_mutex_unlock(&pool_mutex);
+
+    int dropped = 0;
+    while (job) {
+        llm_job *next = job->next;
+        job_free(job);
+        job = next;
+        dropped++;
+    }
+    return dropped;
+}
+
+int llm_pool_cancel(void)
+{
+    pthread_mutex_lock(&calls_mutex);
+    __atomic_store_n(&pool_generation, pool_generation + 1, __ATOMIC_RELEASE);
+    for (llm_call *call = calls_head; call; call = call->next_listed)
+        net_cancel(&call->net);
+    pthread_mutex_unlock(&calls_mutex);
+    return llm_pool_cancel_pending();
+}
+
+bool llm_pool_poll(llm_result *out)
+{
+    pthread_mutex_lock(&pool_mutex);
+    llm_done *done = done_head;
+    if (done) {
+        done_head = done->next;
+        if (!done_head) done_tail = NULL;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (!done) return false;
+    *out = done->result;
+    free(done);
+    return true;
+}
+
+bool llm_pool_wait(llm_result *out, int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    while (!done_head)
+        if (pthread_cond_timedwait(&done_cond, &pool_mutex, &deadline) != 0) break;
+    pthread_mutex_unlock(&pool_mutex);
+    return llm_pool_poll(out);
+}
+
+void llm_result_free(llm_result *r)
+{
+    free(r->path);
+    free(r->answer);
+    free(r->finish_reason);
+    r->path = NULL;
+    r->answer = NULL;
+    r->finish_reason = NULL;
+}
@@ -0,0 +1,153 @@
+#ifndef LLM_H
+#define LLM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <jansson.h>
+
+/* -------------------------------------------------
+   LLM client and worker pool
+   ------------------------------------------------- */
+
+/* Phrases one request can ask about (multi-query mode) */
+#define LLM_MAX_QUERIES 16
+
+/* Result of one finished request, delivered per file */
+typedef struct {
+    char *path;             /* image the request was made for */
+    char *answer;           /* assistant text, NULL on failure */
+    char *finish_reason;
+    bool ok;                /* false if the request or parse failed */
+    bool keep;              /* no phrase was answered "no" */
+    bool cached;            /* answered from the verdict cache */
+    bool cancelled;         /* aborted by llm_pool_cancel / llm_pool_stop: no answer */
+    int query_count;        /* phrases asked about */
+    signed char verdicts[LLM_MAX_QUERIES]; /* per phrase: 1 yes, 0 no, -1 unanswered */
+    float p_yes;            /* P(yes) from the answer's logprobs, -1 if unknown */
+    float score;            /* llm_pool_submit_rank: 0..1, -1 if unscored */
+    unsigned int batch;     /* batch id passed to llm_pool_submit */
+    uint64_t content_hash;  /* hash of the file's bytes, 0 if not taken */
+    /* timings in milliseconds */
+    double queue_ms;        /* submitted until a prep thread picked it up */
+    double prep_ms;         /* read, hash, cache lookup, downscale */
+    double read_ms;         /*   the open / map / hash / cache lookup part */
+    double encode_ms;       /*   the downscale / re-encode / request body part */
+    double request_ms;      /* handed to the network engine until answered */
+    double wait_ms;         /*   queued in the engine, retry backoffs included */
+    double connect_ms;      /*   new connection set up, 0 when one was reused */
+    double upload_ms;       /*   request body sent */
+    double first_byte_ms;   /*   transfer start until the first response byte */
+    double parse_ms;        /* response JSON parsed */
+    double total_ms;
+    size_t file_bytes;      /* size of the file on disk */
+    size_t upload_bytes;    /* image bytes sent, 0 when cached */
+} llm_result;
+
+/* Model name and sampling temperature sent with every request */
+extern const char *LLM_MODEL;
+extern const double LLM_TEMPERATURE;
+
+/* Print a "Processing image" line per upload to stdout */
+extern bool llm_log_progress;
+
+typedef enum {
+    LLM_CONSTRAIN_NONE,
+    LLM_CONSTRAIN_GRAMMAR,  /* GBNF "grammar" field (llama.cpp server) */
+    LLM_CONSTRAIN_CHOICE    /* "guided_choice" field (vLLM) */
+} llm_constraint;
+
+typedef struct {
+    /* Single-question requests ask for one token with its logprobs, so a
+       request costs about the prefill and yields a probability */
+    bool fast_verdict;
+    llm_constraint constraint;
+    const char *bias_tokens;    /* "id,id,...": logit_bias +100 (OpenAI-style) */
+    /* OpenAI-compatible /v1/embeddings endpoint for the prefilter */
+    const char *embed_url;
+    const char *embed_model;
+    /* A batch request still running at this percentile of recent
+       latencies gets a duplicate, preferably on another backend; the
+       first answer wins. 0 = never. */
+    int hedge_percentile;
+    /* Failed transfers, 429 and 5xx are tried again this many times */
+    int retries;
+    /* Batch requests ask for a streamed reply and stop reading it once
+       the verdict, rating or every answer is known */
+    bool stream;
+} llm_options;
+
+extern llm_options llm_opts;
+
+/*
+ * Sends a chat completion request to the LLM backend. The image bytes
+ * are base64-encoded while the body streams out.
+ * Returns a newly allocated string containing the raw JSON response,
+ * or NULL on failure. Caller must free() the returned pointer.
+ */
+char *getLLMResponse(const char *prompt, const unsigned char *image, size_t image_size,
+                     const char *mime_type, double temperature);
+
+/*
+ * Extracts the assistant text from a chat completion response.
+ * Returns the parsed root (caller must json_decref) and stores the
+ * content / finish_reason pointers, which live as long as the root.
+ */
+json_t *llm_parse_response(const char *response, const char **content,
+                           const char **finish_reason);
+
+/* true if the answer starts with "yes" (or is not a clear "no") */
+bool llm_answer_is_yes(const char *content);
+
+/*
+ * Parses the reply to a multi-question prompt, either a JSON object
+ * {"1": "yes", "2": "no"} (or an array in question order) or one
+ * "<n>. yes|no" line per question. Fills verdicts[0..count) with
+ * 1 / 0 / -1 (unanswered) and returns how many were answered.
+ */
+int llm_parse_multi_answer(const char *content, int count, signed char *verdicts);
+
+/* Embeds `text` through llm_opts.embed_url; blocks. Returns a
+   malloc'd vector of *dim floats, or NULL. */
+float *llm_embed_text(const char *text, int *dim);
+
+/* Starts the network engine with `jobs` requests in flight and up to
+   that many (bounded by CPU count) image prep threads. */
+bool llm_pool_start(int jobs);
+/* Cancels everything (llm_pool_cancel), joins the prep threads and
+   stops the network engine. */
+void llm_pool_stop(void);
+int llm_pool_workers(void);
+/* Tail-latency counters since start: duplicates sent, duplicates that
+   answered first, retries */
+void llm_pool_tail_stats(unsigned long *hedges, unsigned long *hedge_wins,
+                         unsigned long *retries);
+/* Streamed replies cut short once their answer was known */
+unsigned long llm_pool_streams_cut(void);
+
+/* Queues one image; the prompt is built from `search_phrase`. */
+bool llm_pool_submit(const char *filepath, const char *search_phrase, unsigned int batch);
+/* Queues one image asked about up to LLM_MAX_QUERIES phrases in a single
+   upload; phrases already in the verdict cache are not asked again. */
+bool llm_pool_submit_multi(const char *filepath, const char *const *phrases, int count,
+                           unsigned int batch);
+/* Queues one image to be scored for `phrase` (result.score): by P(yes)
+   in fast verdict mode, else by a 0-10 rating prompt. */
+bool llm_pool_submit_rank(const char *filepath, const char *phrase, unsigned int batch);
+/* Queues one image to be embedded into the embedding index (see
+   embed.h); images already in it are not sent again. result.ok tells
+   whether a vector is stored for result.content_hash. */
+bool llm_pool_submit_embed(const char *filepath, unsigned int batch);
+/* Discards queued (not yet started) jobs; returns how many were dropped. */
+int llm_pool_cancel_pending(void);
+/* Also aborts the jobs being prepared or on the wire, freeing their
+   backend slots at once; each still delivers a result, with `cancelled`
+   set. Returns how many queued jobs were dropped (no result). */
+int llm_pool_cancel(void);
+/* Non-blocking: pops one finished result, returns false if none. */
+bool llm_pool_poll(llm_result *out);
+/* Like llm_pool_poll but waits up to timeout_ms for a result. */
+bool llm_pool_wait(llm_result *out, int timeout_ms);
+void llm_result_free(llm_result *r);
+
+#endif
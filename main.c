@@ -11,115 +11,67 @@
 #include <pthread.h>
 #include <signal.h>
 #include <ctype.h>
-#include <dirent.h>
-#include <sys/stat.h>
+#include <time.h>
+#include "llm.h"
+#include "files.h"
+#include "options.h"
+#include "cache.h"
+#include "catalog.h"
+#include "watch.h"
+#include "thumbs.h"
+#include "rank.h"
+#include "backend.h"
+#include "metrics.h"
 
 static bool filesLoaded = false;
-static FilePathList files = {0};
+static file_list files = {0};
 static int selectedIndex = -1;
 static Texture2D image = {0};
 static int leftPanelWidth = 500; // mutable width, can be resized by user
 static int scrollOffset = 0; // vertical scroll offset for file list
+static bool gridView = false; // thumbnails instead of file names
+#define GRID_CELL (THUMB_SIZE + 8)
 static bool resizingPanel = false;
 static int resizeStartX = 0;
 static int originalPanelWidth = 0;
 
-static bool has_image_extension(const char *filename)
-{
-    const char *ext = strrchr(filename, '.');
-    if (!ext) return false;
-    ext++; // skip dot
-    if (strcasecmp(ext, "png") == 0) return true;
-    if (strcasecmp(ext, "jpg") == 0) return true;
-    if (strcasecmp(ext, "jpeg") == 0) return true;
-    if (strcasecmp(ext, "gif") == 0) return true;
-    if (strcasecmp(ext, "bmp") == 0) return true;
-    if (strcasecmp(ext, "webp") == 0) return true;
-    return false;
-}
-
-/* -------------------------------------------------
-   Recursive directory loader (replaces LoadDirectoryFilesEx)
-   ------------------------------------------------- */
-static FilePathList load_files_recursive(const char *basePath)
-{
-    FilePathList list = {0};
-    size_t capacity = 0;
-
-    /* Helper to add a path to the list */
-    void add_path(const char *path)
-    {
-        if (list.count >= capacity)
-        {
-            capacity = capacity ? capacity * 2 : 128;
-            list.paths = realloc(list.paths, capacity * sizeof(char *));
-        }
-        list.paths[list.count++] = strdup(path);
-    }
-
-    /* Recursive scan */
-    void scan_dir(const char *dir)
-    {
-        DIR *d = opendir(dir);
-        if (!d) return;
-        struct dirent *entry;
-        while ((entry = readdir(d)) != NULL)
-        {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-                continue;
-
-            char *full = NULL;
-            if (asprintf(&full, "%s/%s", dir, entry->d_name) == -1) continue;
-
-            struct stat st;
-            if (stat(full, &st) == -1) { free(full); continue; }
-
-            if (S_ISDIR(st.st_mode))
-            {
-                scan_dir(full);
-                free(full);
-            }
-            else
-            {
-                add_path(full);
-                free(full);
-            }
-        }
-        closedir(d);
-    }
-
-    scan_dir(basePath);
-    return list;
-}
-
-/* -------------------------------------------------
-   LLM interaction helpers (generic POST request)
-   ------------------------------------------------- */
-
-static const char *LLM_SERVER_URL = "http://localhost:9090/v1/chat/completions";
-
-/* Structure to hold response data from libcurl */
-typedef struct {
-    char *data;
-    size_t size;
-} ResponseData;
-
-typedef struct {
-    char *prompt;
-    char *b64;
-    double temperature;
-} llm_task;
-
-static pthread_mutex_t llm_mutex = PTHREAD_MUTEX_INITIALIZER;
-static char *llm_response = NULL;
-static bool llm_response_ready = false;
 static volatile sig_atomic_t keep_running = 1;
 static bool batch_search_active = false;
-static int batch_search_index = 0;
+static int batch_search_index = 0;   /* next file to dispatch */
+static int batch_in_flight = 0;      /* requests submitted but not yet consumed */
+static unsigned int batch_id = 0;    /* results from older batches are discarded */
 static bool stop_requested = false;
-static bool loading = false;
+static char batch_query[256];        /* search phrases, split in place on ';' */
+/* Search pressed during a scan: starts with this query once the list is complete */
+static bool search_queued = false;
+static char queued_query[256];
+static const char *batch_phrases[LLM_MAX_QUERIES];
+static int batch_phrase_count = 0;
 static pthread_t loader_thread;
+/* Loader -> main thread handoff; `files` itself is only touched by main */
 static pthread_mutex_t files_mutex = PTHREAD_MUTEX_INITIALIZER;
+static file_list pending_files = {0};     /* sorted, not yet merged */
+static unsigned int load_generation = 0;  /* bumped by Load; older loaders quit */
+static int loaders_running = 0;           /* joined at exit through loaders_done */
+static pthread_cond_t loaders_done = PTHREAD_COND_INITIALIZER;
+static bool loading = false;
+/* --watch: follow changes to the loaded folder instead of rescanning */
+static bool watch_requested = false;
+static dir_watch *watch = NULL;
+static char loaded_dir[256];
+static bool loaded_recursive = false;
+static file_list batch_arrivals = {0};   /* new files behind the dispatch cursor */
+/* Ranked search (--top-k / the Rank checkbox): score instead of removing */
+static bool rank_mode = false;
+static bool batch_ranked = false;       /* the running batch scores */
+static char rank_phrase[256];           /* the whole query, asked as one */
+static top_k ranking = {0};
+static rank_entry *rank_rows = NULL;    /* best first, refreshed on change */
+static int rank_row_count = 0;
+static bool rank_view = false;          /* the panel shows rank_rows */
+
+/* F3: request stats over the bottom right corner */
+static bool stats_overlay = false;
 
 static void handle_sigint(int sig)
 {
@@ -127,20 +79,6 @@ static void handle_sigint(int sig)
     keep_running = 0;
 }
 
-/* libcurl write callback to accumulate response */
-static size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdata)
-{
-    size_t total = size * nmemb;
-    ResponseData *resp = (ResponseData *)userdata;
-    char *new_data = realloc(resp->data, resp->size + total + 1);
-    if (!new_data) return 0; /* allocation failed */
-    memcpy(new_data + resp->size, ptr, total);
-    new_data[resp->size + total] = '\0';
-    resp->data = new_data;
-    resp->size += total;
-    return total;
-}
-
 /* -------------------------------------------------
    Backspace handling helpers with repeat logic
    ------------------------------------------------- */
@@ -164,203 +102,233 @@ static void handle_backspace(char *buffer)
     }
 }
 
+/* Search phrase backspace handling */
+
+/* Entries per panel row: 1 in the list, as many thumbnails as fit in the grid */
+static int panel_columns(float panelWidth)
+{
+    if (!gridView) return 1;
+    int columns = (int)((panelWidth - 24) / GRID_CELL); // leave room for the scrollbar
+    return columns > 0 ? columns : 1;
+}
+
 /* -------------------------------------------------
-   Helper: alphanumeric sort for file list
+   Panel rows: live files in name order, or the top-K best first
+   after a ranked search
    ------------------------------------------------- */
 
-/* Custom character ranking:
-      0-9  -> 0-9
-      a/A -> 10,11
-      b/B -> 12,13
-      ...  -> continue */
-static int char_rank(unsigned char c)
+static int panel_row_count(void)
 {
-    if (c >= '0' && c <= '9')
-        return c - '0';
-    if (c >= 'a' && c <= 'z')
-        return 10 + (c - 'a') * 2;
-    if (c >= 'A' && c <= 'Z')
-        return 10 + (c - 'A') * 2 + 1;
-    return 1000 + c;  /* fallback for other characters */
+    return rank_view ? rank_row_count : (int)file_list_live_count(&files);
 }
 
-/* Comparator using the custom ranking */
-static int cmp_strings(const void *a, const void *b)
+/* Index into `files` for a row, -1 if the ranked file has gone */
+static int panel_row_file(int row)
 {
-    const char * const *sa = (const char * const *)a;
-    const char * const *sb = (const char * const *)b;
-    const unsigned char *s1 = (const unsigned char *)*sa;
-    const unsigned char *s2 = (const unsigned char *)*sb;
-
-    while (*s1 && *s2) {
-        int r1 = char_rank(*s1);
-        int r2 = char_rank(*s2);
-        if (r1 != r2) return r1 - r2;
-        s1++; s2++;
-    }
-    return char_rank(*s1) - char_rank(*s2);
+    if (!rank_view) return (int)file_list_live_index(&files, row);
+    int idx = file_list_find(&files, rank_rows[row].path);
+    return idx >= 0 && file_list_is_live(&files, idx) ? idx : -1;
 }
 
-/* Search phrase backspace handling */
-
-/* -------------------------------------------------
-   Simple Base64 encoder (no line breaks)
-   ------------------------------------------------- */
-static const char b64_encoding_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static const int b64_mod_table[] = {0, 2, 1};
-
-static char *base64_encode(const unsigned char *data, size_t input_length)
+static int panel_row_of(int idx)
 {
-    size_t output_length = 4 * ((input_length + 2) / 3);
-    char *encoded_data = malloc(output_length + 1);
-    if (encoded_data == NULL) return NULL;
-
-    for (size_t i = 0, j = 0; i < input_length;) {
-        uint32_t octet_a = i < input_length ? data[i++] : 0;
-        uint32_t octet_b = i < input_length ? data[i++] : 0;
-        uint32_t octet_c = i < input_length ? data[i++] : 0;
+    if (idx < 0) return -1;
+    if (!rank_view) return (int)file_list_live_rank(&files, idx);
+    for (int row = 0; row < rank_row_count; ++row)
+        if (strcmp(rank_rows[row].path, files.paths[idx]) == 0) return row;
+    return -1;
+}
 
-        uint32_t triple = (octet_a << 16) | (octet_b << 8) | octet_c;
+static void rank_reset(void)
+{
+    top_k_free(&ranking);
+    free(rank_rows);
+    rank_rows = NULL;
+    rank_row_count = 0;
+    rank_view = false;
+}
 
-        encoded_data[j++] = b64_encoding_table[(triple >> 18) & 0x3F];
-        encoded_data[j++] = b64_encoding_table[(triple >> 12) & 0x3F];
-        encoded_data[j++] = b64_encoding_table[(triple >> 6) & 0x3F];
-        encoded_data[j++] = b64_encoding_table[triple & 0x3F];
+/* Fresh top-K for a ranked batch; false leaves the batch unranked */
+static bool rank_begin(const char *query)
+{
+    rank_reset();
+    int k = app_opts.top_k > 0 ? app_opts.top_k : 50;
+    rank_rows = malloc(k * sizeof(rank_entry));
+    if (!rank_rows || !top_k_init(&ranking, k)) {
+        rank_reset();
+        return false;
     }
+    /* "cat; outdoor" is rated as a whole */
+    strncpy(rank_phrase, query, sizeof(rank_phrase) - 1);
+    rank_phrase[sizeof(rank_phrase) - 1] = '\0';
+    for (char *p = rank_phrase; *p; ++p)
+        if (*p == ';') *p = ',';
+    rank_view = true;
+    return true;
+}
 
-    for (int i = 0; i < b64_mod_table[input_length % 3]; i++)
-        encoded_data[output_length - 1 - i] = '=';
+/* -------------------------------------------------
+   Batch search helpers (results arrive out of order)
+   ------------------------------------------------- */
 
-    encoded_data[output_length] = '\0';
-    return encoded_data;
+static bool batch_submit(const char *path)
+{
+    if (batch_ranked) return llm_pool_submit_rank(path, rank_phrase, batch_id);
+    return llm_pool_submit_multi(path, batch_phrases, batch_phrase_count, batch_id);
 }
 
-/*
- * Sends a chat completion request to the LLM backend.
- * `prompt` – the user message to send.
- * `temperature` – sampling temperature (e.g., 0.7).
- * Returns a newly allocated string containing the raw JSON response,
- * or NULL on failure. Caller must free() the returned pointer.
- */
-static char *getLLMResponse(const char *prompt, const char *base64_image, double temperature)
+/* "cat; outdoor" asks both questions in one upload per image and keeps
+   the files where no answer was "no". Returns false if nothing to ask. */
+static bool batch_set_query(const char *text)
 {
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        fprintf(stderr, "curl_easy_init() failed\n");
-        return NULL;
+    strncpy(batch_query, text, sizeof(batch_query) - 1);
+    batch_query[sizeof(batch_query) - 1] = '\0';
+    batch_phrase_count = 0;
+
+    char *save = NULL;
+    for (char *tok = strtok_r(batch_query, ";", &save);
+         tok && batch_phrase_count < LLM_MAX_QUERIES;
+         tok = strtok_r(NULL, ";", &save))
+    {
+        while (isspace((unsigned char)*tok)) tok++;
+        char *end = tok + strlen(tok);
+        while (end > tok && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (*tok) batch_phrases[batch_phrase_count++] = tok;
     }
+    return batch_phrase_count > 0;
+}
 
-    /* Build JSON payload */
-    char *payload = NULL;
-    if (asprintf(&payload,
-                 "{\"model\": \"gpt-4-vision-preview\", \"messages\": [{\"role\": \"system\", \"content\": \"You are a helpful assistant.\"}, {\"role\": \"user\", \"content\": [{\"type\": \"text\", \"text\": \"%s\"}, {\"type\": \"image_url\", \"image_url\": {\"url\": \"data:image/jpeg;base64,%s\"}}]}], \"temperature\": %f}",
-                 prompt, base64_image, temperature) == -1) {
-        fprintf(stderr, "Failed to allocate payload string\n");
-        curl_easy_cleanup(curl);
-        return NULL;
+/* Keeps up to --jobs requests in flight over the file list; files that
+   arrived (watch mode) behind the cursor go first */
+static void batch_dispatch(void)
+{
+    while (!stop_requested && batch_in_flight < app_opts.jobs && batch_arrivals.count > 0)
+    {
+        if (!batch_submit(batch_arrivals.paths[--batch_arrivals.count])) break;
+        batch_in_flight++;
     }
-
-    ResponseData resp = {NULL, 0};
-
-    curl_easy_setopt(curl, CURLOPT_URL, LLM_SERVER_URL);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 1800L);
-    /* Optional: disable SSL verification if using self‑signed certs */
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-    /* Disable Expect: 100‑continue to avoid server rejecting large payloads */
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, "Expect:");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        free(payload);
-        curl_easy_cleanup(curl);
-        if (resp.data) free(resp.data);
-        if (headers) curl_slist_free_all(headers);
-        return NULL;
+    while (!stop_requested && batch_in_flight < app_opts.jobs &&
+           batch_search_index < (int)files.count)
+    {
+        unsigned int idx = batch_search_index++;
+        if (!file_list_is_live(&files, idx)) continue;
+        if (!batch_submit(files.paths[idx])) break;
+        batch_in_flight++;
+    }
+    if (batch_in_flight == 0 &&
+        (stop_requested || (batch_search_index >= (int)files.count && batch_arrivals.count == 0)))
+    {
+        batch_search_active = false;
+        if (backend_count() > 1) backend_report(stdout);
     }
-
-    free(payload);
-    curl_easy_cleanup(curl);
-    if (headers) curl_slist_free_all(headers);
-    return resp.data;   /* Caller must free */
 }
 
-/* -------------------------------------------------
-   Thread worker for LLM request
-   ------------------------------------------------- */
-static void *llm_thread_func(void *arg)
+/* Starts a batch search over every listed image */
+static void batch_start(const char *query)
 {
-    llm_task *task = (llm_task *)arg;
-    char *response = getLLMResponse(task->prompt, task->b64, task->temperature);
-    free(task->prompt);
-    free(task->b64);
+    if (!batch_set_query(query)) return;
+    batch_search_active = true;
+    stop_requested = false;
+    batch_search_index = 0;
+    batch_in_flight = 0;
+    batch_id++;
+    batch_ranked = rank_mode && rank_begin(query);
+    scrollOffset = 0;
+    batch_dispatch(); /* clears batch_search_active if no images */
+}
 
-    pthread_mutex_lock(&llm_mutex);
-    if (llm_response) free(llm_response);
-    llm_response = response;
-    llm_response_ready = true;
-    pthread_mutex_unlock(&llm_mutex);
+/* A search is running or waits for the scan: the Stop button shows */
+static bool search_busy(void)
+{
+    return batch_search_active || search_queued;
+}
 
-    free(task);
-    return NULL;
+/* Ends the running batch: requests already out are aborted, which frees
+   their backend slots; their results carry the old batch id and are ignored */
+static void batch_cancel(void)
+{
+    llm_pool_cancel();
+    batch_id++;
+    batch_in_flight = 0;
+    batch_search_active = false;
+    file_list_free(&batch_arrivals);
 }
 
-/* Helper to start an LLM request for a given image file */
-static void start_llm_task_for_file(const char *filepath, const char *search_phrase)
+/* Throughput and per-stage percentiles; summarizing sorts the sample
+   windows, so it is redone twice a second rather than every frame */
+static void draw_stats_overlay(void)
 {
-    FILE *fp = fopen(filepath, "rb");
-    if (!fp) {
-        fprintf(stderr, "Failed to open image file: %s\n", filepath);
-        return;
-    }
-    printf("Processing image: %s\n", filepath);
-    fseek(fp, 0, SEEK_END);
-    long fsize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    unsigned char *buf = malloc(fsize);
-    if (!buf) {
-        fclose(fp);
-        return;
-    }
-    size_t read_bytes = fread(buf, 1, fsize, fp);
-    fclose(fp);
-    if (read_bytes != (size_t)fsize) {
-        fprintf(stderr, "Failed to read file %s\n", filepath);
-        free(buf);
-        return;
+    static metrics_summary m;
+    static double refreshed = -1;
+    if (refreshed < 0 || GetTime() - refreshed >= 0.5) {
+        metrics_summarize(&m);
+        refreshed = GetTime();
     }
 
-    char *b64 = base64_encode(buf, fsize);
-    free(buf);
-    if (!b64) return;
-
-    char *prompt = NULL;
-    if (asprintf(&prompt, "Does the image contain %s?", search_phrase) == -1) {
-        free(b64);
-        return;
+    const int line = 18, width = 400;
+    int rows = 4;
+    for (int s = 0; s < METRIC_STAGES; ++s)
+        if (m.p50[s] >= 0) rows++;
+    int x = GetScreenWidth() - width - 10;
+    int y = GetScreenHeight() - rows * line - 20;
+    DrawRectangle(x, y, width, rows * line + 10, Fade(BLACK, 0.75f));
+    x += 8;
+    y += 5;
+    DrawText(TextFormat("%lu done, %lu errors, %lu cached", m.results, m.errors, m.cached),
+             x, y, 16, WHITE);
+    y += line;
+    DrawText(TextFormat("%.2f images/s, %.1f KB/s up", m.per_second, m.upload_bytes_per_second / 1024),
+             x, y, 16, WHITE);
+    y += line + line / 2;
+    const char *headers[] = { "stage (ms)", "p50", "p95", "p99" };
+    for (int c = 0; c < 4; ++c)
+        DrawText(headers[c], x + (c ? 60 + 80 * c : 0), y, 16, LIGHTGRAY);
+    y += line;
+    for (int s = 0; s < METRIC_STAGES; ++s)
+    {
+        if (m.p50[s] < 0) continue;
+        DrawText(metrics_stage_name(s), x, y, 16, WHITE);
+        DrawText(TextFormat("%.1f", m.p50[s]), x + 140, y, 16, WHITE);
+        DrawText(TextFormat("%.1f", m.p95[s]), x + 220, y, 16, WHITE);
+        DrawText(TextFormat("%.1f", m.p99[s]), x + 300, y, 16, WHITE);
+        y += line;
     }
+}
 
-    llm_task *task = malloc(sizeof(llm_task));
-    if (!task) {
-        free(prompt);
-        free(b64);
-        return;
+/* Tombstones the entry; indexes (selection, dispatch cursor) stay valid */
+static void remove_file_at(int idx)
+{
+    file_list_remove(&files, idx);
+    if (selectedIndex == idx) {
+        selectedIndex = -1;
+        if (image.id != 0) { UnloadTexture(image); image.id = 0; }
     }
-    task->prompt = prompt;
-    task->b64 = b64;
-    task->temperature = 0.0;
+}
+
+/* Files queued behind the cursor that are gone need not be asked about */
+static void batch_forget_arrival(const char *path)
+{
+    int idx = file_list_find(&batch_arrivals, path);
+    if (idx < 0) return;
+    file_list_remove(&batch_arrivals, idx);
+    file_list_compact(&batch_arrivals);
+}
+
+/* Removes a rejected or deleted file; the list is sorted, so look it up by path */
+static void batch_remove_file(const char *path)
+{
+    batch_forget_arrival(path);
+    int idx = file_list_find(&files, path);
+    if (idx >= 0 && file_list_is_live(&files, idx)) remove_file_at(idx);
+}
 
-    pthread_t tid;
-    pthread_create(&tid, NULL, llm_thread_func, task);
-    pthread_detach(tid);
+/* Drops the tombstones in one pass and remaps indexes into the list */
+static void files_compact(void)
+{
+    if (!files.dead) return;
+    if (selectedIndex >= 0) selectedIndex = (int)file_list_live_rank(&files, selectedIndex);
+    batch_search_index = (int)file_list_live_rank(&files, batch_search_index);
+    file_list_compact(&files);
 }
 
 /* -------------------------------------------------
@@ -369,35 +337,274 @@ static void start_llm_task_for_file(const char *filepath, const char *search_phr
 struct load_task {
     char dir[256];
     bool recursive;
+    unsigned int generation;
 };
 
+/* Sorted chunks are published at most this often while the walk runs */
+#define LOAD_PUBLISH_MS 100
+
+static double monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void loader_exit(void)
+{
+    pthread_mutex_lock(&files_mutex);
+    if (--loaders_running == 0) pthread_cond_broadcast(&loaders_done);
+    pthread_mutex_unlock(&files_mutex);
+}
+
 static void *load_files_thread(void *arg)
 {
     struct load_task *task = (struct load_task *)arg;
-    FilePathList newlist = {0};
+    file_list chunk = {0};
 
-    if (task->recursive)
-        newlist = load_files_recursive(task->dir);
-    else
-        newlist = LoadDirectoryFiles(task->dir);
+    /* Known folder: the catalog hands over the whole sorted list */
+    if (app_opts.use_catalog && catalog_load(task->dir, task->recursive, &chunk))
+    {
+        pthread_mutex_lock(&files_mutex);
+        if (task->generation == load_generation) {
+            file_list_merge(&pending_files, &chunk);
+            loading = false;
+        }
+        pthread_mutex_unlock(&files_mutex);
+        loader_exit();
+        file_list_free(&chunk);
+        free(task);
+        return NULL;
+    }
+
+    file_scan *scan = file_scan_start(task->dir, task->recursive, 0);
+    catalog_build *build = app_opts.use_catalog && scan ?
+                           catalog_build_begin(task->dir, task->recursive) : NULL;
+    double last_publish = 0;
+    bool more = scan != NULL;
+    bool stale = false;
 
-    if (newlist.count > 1)
-        qsort(newlist.paths, newlist.count, sizeof(char *), cmp_strings);
+    while (more)
+    {
+        more = file_scan_next(scan, &chunk, LOAD_PUBLISH_MS);
+        double now = monotonic_ms();
+        if (more && (chunk.count == 0 || now - last_publish < LOAD_PUBLISH_MS))
+            continue;
+        last_publish = now;
+
+        /* Sort off the main thread; it only has to merge */
+        file_list_sort(&chunk);
+        catalog_build_add(build, &chunk);
+        pthread_mutex_lock(&files_mutex);
+        stale = task->generation != load_generation;
+        if (!stale) file_list_merge(&pending_files, &chunk);
+        pthread_mutex_unlock(&files_mutex);
+        if (stale) break;
+    }
+    /* Only a complete walk is worth recording */
+    if (stale) catalog_build_abort(build);
+    else catalog_build_finish(build, scan);
+    file_scan_free(scan);
+    file_list_free(&chunk);
 
     pthread_mutex_lock(&files_mutex);
-    if (filesLoaded)
-        UnloadDirectoryFiles(files);
-    files = newlist;
-    filesLoaded = true;
-    loading = false;
+    if (task->generation == load_generation) loading = false;
     pthread_mutex_unlock(&files_mutex);
+    loader_exit();
 
     free(task);
     return NULL;
 }
 
-int main(void)
+/* Makes every loader stale and waits for them; they check at least
+   every LOAD_PUBLISH_MS */
+static void stop_loaders(void)
+{
+    pthread_mutex_lock(&files_mutex);
+    load_generation++;
+    while (loaders_running > 0)
+        pthread_cond_wait(&loaders_done, &files_mutex);
+    pthread_mutex_unlock(&files_mutex);
+}
+
+/* Main thread: merges what the loader published; returns true while it runs */
+static bool take_loaded_files(void)
+{
+    pthread_mutex_lock(&files_mutex);
+    bool still_loading = loading;
+    if (pending_files.count > 0)
+    {
+        /* Keep the selection on the same file as entries slide in */
+        files_compact();
+        const char *selected = selectedIndex >= 0 ? files.paths[selectedIndex] : NULL;
+        if (file_list_merge(&files, &pending_files)) {
+            filesLoaded = true;
+            if (selected) selectedIndex = file_list_find(&files, selected);
+        }
+    }
+    pthread_mutex_unlock(&files_mutex);
+    return still_loading;
+}
+
+/* Drops the current list and starts scanning `dir` in the background */
+static void start_load(const char *dir, bool recursive)
+{
+    /* The list is going away; drop the running batch */
+    if (batch_search_active) batch_cancel();
+
+    /* A load still running for the old list stops at its next publish */
+    pthread_mutex_lock(&files_mutex);
+    load_generation++;
+    file_list_free(&pending_files);
+    loading = true;
+    unsigned int generation = load_generation;
+    pthread_mutex_unlock(&files_mutex);
+    if (filesLoaded)
+    {
+        file_list_free(&files);
+        filesLoaded = false;
+    }
+    selectedIndex = -1;
+    if (image.id != 0) { UnloadTexture(image); image.id = 0; }
+    rank_reset();
+
+    strncpy(loaded_dir, dir, sizeof(loaded_dir) - 1);
+    loaded_dir[sizeof(loaded_dir) - 1] = '\0';
+    loaded_recursive = recursive;
+
+    /* Watch before scanning: anything that changes during the scan is
+       caught by one or the other, and duplicates are skipped on apply */
+    dir_watch_stop(watch);
+    watch = watch_requested ? dir_watch_start(dir, recursive) : NULL;
+
+    struct load_task *task = malloc(sizeof(*task));
+    if (!task) {
+        loading = false;
+        return;
+    }
+    memcpy(task->dir, loaded_dir, sizeof(task->dir));
+    task->recursive = recursive;
+    task->generation = generation;
+    pthread_mutex_lock(&files_mutex);
+    loaders_running++;
+    pthread_mutex_unlock(&files_mutex);
+    if (pthread_create(&loader_thread, NULL, load_files_thread, task) == 0) {
+        pthread_detach(loader_thread);
+    } else {
+        loader_exit();
+        free(task);
+    }
+}
+
+/* -------------------------------------------------
+   Watch mode: apply filesystem changes to the sorted list in place
+   ------------------------------------------------- */
+
+/* A new file, or one rewritten in place */
+static void watch_add_file(const char *path)
+{
+    files_compact();
+    int idx = file_list_find(&files, path);
+    bool behind = false;
+    if (idx >= 0) {
+        behind = idx < batch_search_index;
+    } else {
+        idx = file_list_insert(&files, path);
+        if (idx < 0) return;
+        filesLoaded = true;
+        if (selectedIndex >= idx) selectedIndex++;
+        if (idx < batch_search_index) {
+            batch_search_index++;
+            behind = true;
+        }
+    }
+
+    /* Ahead of the cursor the running batch reaches it anyway; behind
+       it, new files and rewritten ones are queued to be asked about */
+    if (behind && batch_search_active && !stop_requested &&
+        file_list_find(&batch_arrivals, path) < 0)
+        file_list_insert(&batch_arrivals, path);
+}
+
+/* Everything under `dir`/ left the tree */
+static void watch_remove_tree(const char *dir)
+{
+    size_t len = strlen(dir);
+    bool queued = false;
+    for (unsigned int i = 0; i < batch_arrivals.count; ++i)
+    {
+        if (strncmp(batch_arrivals.paths[i], dir, len) == 0 && batch_arrivals.paths[i][len] == '/') {
+            file_list_remove(&batch_arrivals, i);
+            queued = true;
+        }
+    }
+    if (queued) file_list_compact(&batch_arrivals);
+    for (unsigned int i = 0; i < files.count; ++i)
+        if (file_list_is_live(&files, i) &&
+            strncmp(files.paths[i], dir, len) == 0 && files.paths[i][len] == '/')
+            remove_file_at(i);
+}
+
+static void apply_watch_events(void)
 {
+    watch_event events[256];
+    int n;
+    while (watch && (n = dir_watch_poll(watch, events, 256)) > 0)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            watch_event *ev = &events[i];
+            switch (ev->kind)
+            {
+            case WATCH_ADDED:
+                thumbs_forget(ev->path);
+                watch_add_file(ev->path);
+                break;
+            case WATCH_REMOVED:
+                thumbs_forget(ev->path);
+                batch_remove_file(ev->path);
+                break;
+            case WATCH_REMOVED_TREE:
+                watch_remove_tree(ev->path);
+                break;
+            case WATCH_OVERFLOW:
+                fprintf(stderr, "Too many changes at once; reloading %s\n", loaded_dir);
+                for (int j = i + 1; j < n; ++j) free(events[j].path);
+                start_load(loaded_dir, loaded_recursive);
+                return;
+            }
+            free(ev->path);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // Command line options
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--watch") == 0)
+            watch_requested = true;
+        else
+        {
+            option_result res = parse_common_option(argc, argv, &i);
+            if (res == OPTION_UNKNOWN) {
+                fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+                fprintf(stderr, "  --watch               follow changes to the loaded folder\n");
+                print_common_usage();
+            }
+            if (res != OPTION_TAKEN) return 1;
+        }
+    }
+    apply_common_options();
+    rank_mode = app_opts.top_k > 0;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (!llm_pool_start(app_opts.jobs)) {
+        fprintf(stderr, "Failed to start LLM worker pool\n");
+        return 1;
+    }
+
     // Initialization
     const int screenWidth = 800;
     const int screenHeight = 450;
@@ -406,6 +613,7 @@ int main(void)
     InitWindow(screenWidth, screenHeight, "LLM Image Search");
 
     SetTargetFPS(60);
+    thumbs_init(0, 1024);
 
     // -------------------------------------------------
     // UI state variables
@@ -433,6 +641,17 @@ int main(void)
     // Main game loop
     while (!WindowShouldClose() && keep_running)
     {
+        bool scanning = take_loaded_files();
+        /* Events queue up until the scan is done, then apply in place */
+        if (!scanning) apply_watch_events();
+        if (search_queued && !scanning) {
+            search_queued = false;
+            batch_start(queued_query);
+        }
+        /* Thumbnails decoded since the last frame; bounded so scrolling stays smooth */
+        thumbs_begin_frame();
+        thumbs_upload(4.0);
+
         // -------------------------------------------------
         // Input handling
         // -------------------------------------------------
@@ -452,36 +671,30 @@ int main(void)
              if (CheckCollisionPointRec(mouse, loadBtn))
              {
                  /* Cancel any previous load and start a new background load */
-                 if (filesLoaded)
-                 {
-                     UnloadDirectoryFiles(files);
-                     filesLoaded = false;
-                 }
-                 if (!loading)
-                 {
-                     loading = true;
-                     struct load_task *task = malloc(sizeof(*task));
-                     strncpy(task->dir, dirPath, sizeof(task->dir) - 1);
-                     task->dir[sizeof(task->dir) - 1] = '\0';
-                     task->recursive = recursive;
-                     pthread_create(&loader_thread, NULL, load_files_thread, task);
-                     pthread_detach(loader_thread);
-                 }
-
-                 selectedIndex = -1;
-                 if (image.id != 0) { UnloadTexture(image); image.id = 0; }
+                 start_load(dirPath, recursive);
+                 scanning = true;
              }
 
             // Recursive checkbox
             checkBox = (Rectangle){10, inputBox.y + inputBox.height + 10, (float)checkboxSize, (float)checkboxSize};
             if (CheckCollisionPointRec(mouse, checkBox))
                 recursive = !recursive;
+            Rectangle gridBox = {checkBox.x + 130, checkBox.y, (float)checkboxSize, (float)checkboxSize};
+            if (CheckCollisionPointRec(mouse, gridBox))
+                gridView = !gridView;
+            Rectangle rankBox = {gridBox.x + 90, checkBox.y, (float)checkboxSize, (float)checkboxSize};
+            if (CheckCollisionPointRec(mouse, rankBox)) {
+                rank_mode = !rank_mode;
+                /* Back to the full list; a finished ranking shows again when ticked */
+                rank_view = rank_mode && ranking.heap != NULL;
+                scrollOffset = 0;
+            }
 
             // Search bar input handling (right justified)
             int stopBtnWidth = 80;
             int spacing = 10;
             int effectiveSearchBarWidth = searchBarWidth;
-            if (batch_search_active) {
+            if (search_busy()) {
                 effectiveSearchBarWidth = searchBarWidth - (stopBtnWidth + spacing);
                 if (effectiveSearchBarWidth < 50) effectiveSearchBarWidth = 50;
             }
@@ -493,30 +706,26 @@ int main(void)
             else if (editingSearch && !CheckCollisionPointRec(mouse, searchBox))
                 editingSearch = false;
 
-            // Search button (placeholder)
-            if (CheckCollisionPointRec(mouse, searchBtn))
+            // Search button
+            if (CheckCollisionPointRec(mouse, searchBtn) && !batch_search_active)
             {
-                if (!batch_search_active) {
-                    /* Start batch search over all image files */
-                    batch_search_active = true;
-                    stop_requested = false;
-                    batch_search_index = 0;
-                    /* Find first image file */
-                    while (batch_search_index < (int)files.count &&
-                           !has_image_extension(files.paths[batch_search_index])) {
-                        batch_search_index++;
-                    }
-                    if (batch_search_index < (int)files.count) {
-                        start_llm_task_for_file(files.paths[batch_search_index], searchPhrase);
-                    } else {
-                        batch_search_active = false; /* no images */
-                    }
+                /* Entries still slide in while scanning, so wait for the full list */
+                if (scanning) {
+                    strncpy(queued_query, searchPhrase, sizeof(queued_query) - 1);
+                    queued_query[sizeof(queued_query) - 1] = '\0';
+                    search_queued = true;
+                } else {
+                    batch_start(searchPhrase);
                 }
             }
             /* Stop button handling */
-            if (batch_search_active && CheckCollisionPointRec(mouse, stopBtn)) {
-                stop_requested = true;
-                batch_search_active = false;
+            if (search_busy() && CheckCollisionPointRec(mouse, stopBtn)) {
+                if (search_queued) {
+                    search_queued = false;
+                } else {
+                    stop_requested = true;
+                    batch_cancel();
+                }
             }
         }
 
@@ -547,7 +756,7 @@ int main(void)
             int stopBtnWidth = 80;
             int spacing = 10;
             int effectiveSearchBarWidth = searchBarWidth;
-            if (batch_search_active) {
+            if (search_busy()) {
                 effectiveSearchBarWidth = searchBarWidth - (stopBtnWidth + spacing);
                 if (effectiveSearchBarWidth < 50) effectiveSearchBarWidth = 50;
             }
@@ -564,7 +773,7 @@ int main(void)
         }
         // Scroll handling for file list (mouse wheel)
         inputBox = (Rectangle){10, 10, (float)(GetScreenWidth() - 20 - buttonWidth - 10), (float)inputBoxHeight};
-        if (filesLoaded && files.count > 0)
+        if (filesLoaded && file_list_live_count(&files) > 0)
         {
             Rectangle panel = {0, (float)(inputBox.y + inputBox.height + 50), (float)leftPanelWidth, (float)(GetScreenHeight() - (inputBox.y + inputBox.height + 50))};
             if (CheckCollisionPointRec(GetMousePosition(), panel))
@@ -572,8 +781,8 @@ int main(void)
                 float wheel = GetMouseWheelMove();
                 if (wheel != 0)
                 {
-                    // Adjust scroll offset (3 items per wheel step)
-                    scrollOffset -= (int)wheel * 3;
+                    // Adjust scroll offset (3 items per wheel step, one row in the grid)
+                    scrollOffset -= (int)wheel * (gridView ? panel_columns(panel.width) : 3);
                     if (scrollOffset < 0) scrollOffset = 0;
                 }
             }
@@ -647,25 +856,20 @@ int main(void)
         // Drawing
         // -------------------------------------------------
         // Keyboard navigation for file list
-        if (filesLoaded && files.count > 0) {
-            if (IsKeyPressed(KEY_DOWN)) {
-                int i = selectedIndex + 1;
-                while (i < (int)files.count && !has_image_extension(files.paths[i])) i++;
-                if (i < (int)files.count) {
-                    selectedIndex = i;
-                    if (image.id != 0) UnloadTexture(image);
-                    image = LoadTexture(files.paths[i]);
-                }
-            } else if (IsKeyPressed(KEY_UP)) {
-                int i = selectedIndex - 1;
-                while (i >= 0 && !has_image_extension(files.paths[i])) i--;
-                if (i >= 0) {
-                    selectedIndex = i;
-                    if (image.id != 0) UnloadTexture(image);
-                    image = LoadTexture(files.paths[i]);
-                }
+        if (filesLoaded && file_list_live_count(&files) > 0) {
+            /* Step through live rows; the selection itself is always live */
+            int row = panel_row_of(selectedIndex);
+            int target = -1;
+            if (IsKeyPressed(KEY_DOWN)) target = row + 1;
+            else if (IsKeyPressed(KEY_UP) && row > 0) target = row - 1;
+            int i = target >= 0 && target < panel_row_count() ? panel_row_file(target) : -1;
+            if (i >= 0) {
+                selectedIndex = i;
+                if (image.id != 0) UnloadTexture(image);
+                image = LoadTexture(files.paths[i]);
             }
         }
+        if (IsKeyPressed(KEY_F3)) stats_overlay = !stats_overlay;
         BeginDrawing();
         ClearBackground(RAYWHITE);
         // Update cursor blink timer (toggle every 0.5 seconds)
@@ -701,11 +905,29 @@ int main(void)
         if (recursive) DrawText("X", (int)checkBox.x + 4, (int)checkBox.y + 2, 20, BLACK);
         DrawText("Recursive", (int)checkBox.x + checkboxSize + 5, (int)checkBox.y, 20, BLACK);
 
+        // UI: Grid checkbox
+        Rectangle gridBox = {checkBox.x + 130, checkBox.y, (float)checkboxSize, (float)checkboxSize};
+        DrawRectangleRec(gridBox, LIGHTGRAY);
+        DrawRectangleLinesEx(gridBox, 2, DARKGRAY);
+        if (gridView) DrawText("X", (int)gridBox.x + 4, (int)gridBox.y + 2, 20, BLACK);
+        DrawText("Grid", (int)gridBox.x + checkboxSize + 5, (int)gridBox.y, 20, BLACK);
+
+        // UI: Rank checkbox
+        Rectangle rankBox = {gridBox.x + 90, checkBox.y, (float)checkboxSize, (float)checkboxSize};
+        DrawRectangleRec(rankBox, LIGHTGRAY);
+        DrawRectangleLinesEx(rankBox, 2, DARKGRAY);
+        if (rank_mode) DrawText("X", (int)rankBox.x + 4, (int)rankBox.y + 2, 20, BLACK);
+        DrawText("Rank", (int)rankBox.x + checkboxSize + 5, (int)rankBox.y, 20, BLACK);
+        if (scanning)
+            DrawText(TextFormat(search_queued ? "Scanning... %u images, then searching"
+                                              : "Scanning... %u images", files.count),
+                     (int)rankBox.x + checkboxSize + 70, (int)checkBox.y, 20, DARKGRAY);
+
         // UI: Search bar (right justified)
         int stopBtnWidth = 80;
         int spacing = 10;
         int effectiveSearchBarWidth = searchBarWidth;
-        if (batch_search_active) {
+        if (search_busy()) {
             effectiveSearchBarWidth = searchBarWidth - (stopBtnWidth + spacing);
             if (effectiveSearchBarWidth < 50) effectiveSearchBarWidth = 50;
         }
@@ -726,56 +948,73 @@ int main(void)
         // UI: Search button
         DrawRectangleRec(searchBtn, GRAY);
         DrawRectangleLinesEx(searchBtn, 2, DARKGRAY);
-        DrawText("Search", (int)searchBtn.x + 10, (int)searchBtn.y + 5, 20, WHITE);
+        DrawText(search_queued ? "Queued" : "Search", (int)searchBtn.x + 10, (int)searchBtn.y + 5, 20, WHITE);
 
-        /* Stop button (visible during batch search) */
-        if (batch_search_active) {
-            DrawRectangleRec(stopBtn, RED);
-            DrawRectangleLinesEx(stopBtn, 2, DARKGRAY);
-            DrawText("Stop", (int)stopBtn.x + 10, (int)stopBtn.y + 5, 20, WHITE);
-        }
-
-        /* Stop button (visible during batch search) */
-        if (batch_search_active) {
+        /* Stop button (visible during batch search, or while one is queued) */
+        if (search_busy()) {
             DrawRectangleRec(stopBtn, RED);
             DrawRectangleLinesEx(stopBtn, 2, DARKGRAY);
             DrawText("Stop", (int)stopBtn.x + 10, (int)stopBtn.y + 5, 20, WHITE);
         }
 
         // UI: File list panel (scrollable and resizable)
-        if (filesLoaded && files.count > 0)
+        if (filesLoaded && file_list_live_count(&files) > 0)
         {
             Rectangle panel = {0, (float)(inputBox.y + inputBox.height + 50), (float)leftPanelWidth, (float)(GetScreenHeight() - (inputBox.y + inputBox.height + 50))};
             DrawRectangleRec(panel, LIGHTGRAY);
             DrawRectangleLinesEx(panel, 2, DARKGRAY);
             BeginScissorMode((int)panel.x, (int)panel.y, (int)panel.width, (int)panel.height);
 
-            int maxVisible = (int)((panel.height - 10) / 25);
-            int filteredIdx = -1;
-            int totalFiltered = 0;
+            int columns = panel_columns(panel.width);
+            int rowHeight = gridView ? GRID_CELL : 25;
+            int maxVisible = (int)((panel.height - 10) / rowHeight);   // full rows
+            // The list only holds images; rows map to live entries (or ranked ones)
+            int totalFiltered = panel_row_count();
+            int totalRows = (totalFiltered + columns - 1) / columns;
 
-            // Count how many image files we have
-            for (unsigned int i = 0; i < files.count; ++i)
-            {
-                if (has_image_extension(files.paths[i])) totalFiltered++;
-            }
-
-            // Clamp scroll offset to valid range
-            if (scrollOffset > totalFiltered - maxVisible) scrollOffset = totalFiltered - maxVisible;
-            if (scrollOffset < 0) scrollOffset = 0;
+            // Clamp scroll offset to valid range (whole rows in the grid)
+            int firstRow = scrollOffset / columns;
+            if (firstRow > totalRows - maxVisible) firstRow = totalRows - maxVisible;
+            if (firstRow < 0) firstRow = 0;
+            scrollOffset = firstRow * columns;
 
             int startY = (int)panel.y + 5;
-            for (unsigned int i = 0; i < files.count; ++i)
+            int drawCount = (maxVisible + 1) * columns;   // plus the partly visible row
+            for (int drawIdx = 0; drawIdx < drawCount && scrollOffset + drawIdx < totalFiltered; ++drawIdx)
             {
-                if (!has_image_extension(files.paths[i])) continue;
-                filteredIdx++;
-
-                if (filteredIdx < scrollOffset) continue;
-                if (filteredIdx >= scrollOffset + maxVisible) break;
-
-                int drawIdx = filteredIdx - scrollOffset;
-                Rectangle itemRect = {panel.x + 5, (float)(startY + drawIdx * 25), panel.width - 10, 24};
-                if ((int)i == selectedIndex) DrawRectangleRec(itemRect, SKYBLUE);
+                int i = panel_row_file(scrollOffset + drawIdx);
+                if (i < 0) continue;
+                int row = drawIdx / columns;
+                int col = drawIdx % columns;
+                Rectangle itemRect = {panel.x + 5, (float)(startY + row * 25), panel.width - 10, 24};
+                if (gridView)
+                    itemRect = (Rectangle){panel.x + 5 + col * GRID_CELL, (float)(startY + row * GRID_CELL),
+                                           GRID_CELL - 4, GRID_CELL - 4};
+                if (i == selectedIndex) DrawRectangleRec(itemRect, SKYBLUE);
+                if (gridView)
+                {
+                    // Thumbnail fitted into the cell; placeholder until it is decoded
+                    Texture2D thumb = thumbs_get(files.paths[i]);
+                    if (thumb.id != 0)
+                    {
+                        float scale = fmin((itemRect.width - 4) / thumb.width, (itemRect.height - 4) / thumb.height);
+                        float drawW = thumb.width * scale;
+                        float drawH = thumb.height * scale;
+                        Rectangle src = {0, 0, (float)thumb.width, (float)thumb.height};
+                        Rectangle dst = {itemRect.x + (itemRect.width - drawW) / 2.0f,
+                                         itemRect.y + (itemRect.height - drawH) / 2.0f,
+                                         drawW, drawH};
+                        DrawTexturePro(thumb, src, dst, (Vector2){0,0}, 0.0f, WHITE);
+                    }
+                    else
+                    {
+                        DrawRectangleLinesEx(itemRect, 1, GRAY);
+                    }
+                    if (rank_view)
+                        DrawText(TextFormat("%.2f", rank_rows[scrollOffset + drawIdx].score),
+                                 (int)itemRect.x + 3, (int)itemRect.y + 3, 10, DARKBLUE);
+                }
+                else
                 {
                     const char *displayName = files.paths[i];
                     size_t dirLen = strlen(dirPath);
@@ -784,6 +1023,8 @@ int main(void)
                         if (*p == '/' || *p == '\\') p++;
                         displayName = p;
                     }
+                    if (rank_view)
+                        displayName = TextFormat("%.2f  %s", rank_rows[scrollOffset + drawIdx].score, displayName);
                     DrawText(displayName, (int)itemRect.x + 2, (int)itemRect.y + 4, 20, BLACK);
                 }
 
@@ -793,7 +1034,7 @@ int main(void)
                     Vector2 mouse = GetMousePosition();
                     if (CheckCollisionPointRec(mouse, itemRect))
                     {
-                        if (selectedIndex != (int)i)
+                        if (selectedIndex != i)
                         {
                             if (image.id != 0) UnloadTexture(image);
                             image = LoadTexture(files.paths[i]);
@@ -814,18 +1055,18 @@ int main(void)
 
             EndScissorMode();
             // Draw scrollbar if needed
-            if (totalFiltered > maxVisible)
+            if (totalRows > maxVisible)
             {
                 const int sbWidth = 12;
                 // Scrollbar background
                 Rectangle sbBg = { panel.x + panel.width - sbWidth - 2, panel.y + 5, (float)sbWidth, panel.height - 10 };
                 DrawRectangleRec(sbBg, LIGHTGRAY);
                 // Compute thumb size and position
-                float thumbHeight = ((float)maxVisible / totalFiltered) * (panel.height - 10);
+                float thumbHeight = ((float)maxVisible / totalRows) * (panel.height - 10);
                 if (thumbHeight < 20) thumbHeight = 20;
                 float thumbPos = 0.0f;
-                if (totalFiltered - maxVisible > 0)
-                    thumbPos = ((float)scrollOffset / (totalFiltered - maxVisible)) * ((panel.height - 10) - thumbHeight);
+                if (totalRows - maxVisible > 0)
+                    thumbPos = ((float)firstRow / (totalRows - maxVisible)) * ((panel.height - 10) - thumbHeight);
                 Rectangle thumb = { sbBg.x, sbBg.y + thumbPos, (float)sbWidth, thumbHeight };
                 DrawRectangleRec(thumb, DARKGRAY);
             }
@@ -849,107 +1090,84 @@ int main(void)
                 DrawTexturePro(image, src, dst, (Vector2){0,0}, 0.0f, WHITE);
             }
         }
+        if (stats_overlay) draw_stats_overlay();
 
         EndDrawing();
 
         /* -------------------------------------------------
-           Process LLM response (if ready) on the main thread
+           Process finished LLM requests on the main thread
            ------------------------------------------------- */
-        pthread_mutex_lock(&llm_mutex);
-        if (llm_response_ready)
+        llm_result result;
+        while (llm_pool_poll(&result))
         {
-            json_error_t error;
-            json_t *root = json_loads(llm_response, 0, &error);
-            if (!root)
+            if (result.batch != batch_id)
             {
-                fprintf(stderr, "JSON parse error: %s\n", error.text);
+                /* Left over from a stopped or replaced batch */
+                llm_result_free(&result);
+                continue;
             }
-            else
+            batch_in_flight--;
+
+            if (result.ok)
             {
-                json_t *choices = json_object_get(root, "choices");
-                if (json_is_array(choices) && json_array_size(choices) > 0)
+                if (result.cached)
+                    printf("Cached: %s\n", result.path);
+                else
+                    printf("Finish reason: %s\n", result.finish_reason ? result.finish_reason : "N/A");
+                printf("Assistant: %s\n", result.answer ? result.answer : "N/A");
+                if (result.p_yes >= 0)
+                    printf("P(yes): %.3f\n", result.p_yes);
+                if (result.score >= 0)
+                    printf("Score: %.2f\n", result.score);
+                for (int q = 0; result.query_count > 1 && q < result.query_count; ++q)
+                    printf("  %s: %s\n", batch_phrases[q],
+                           result.verdicts[q] > 0 ? "yes" : result.verdicts[q] == 0 ? "no" : "?");
+
+                if (batch_ranked)
                 {
-                    json_t *first = json_array_get(choices, 0);
-                    json_t *finish = json_object_get(first, "finish_reason");
-                    json_t *message = json_object_get(first, "message");
-                    const char *finish_reason = json_string_value(finish);
-                    const char *content = NULL;
-                    if (json_is_object(message))
+                    /* Ranked: nothing is removed, the panel re-sorts instead */
+                    if (result.score >= 0 && top_k_offer(&ranking, result.path, result.score))
+                        rank_row_count = top_k_sorted(&ranking, rank_rows);
+                    if (batch_search_active && app_opts.stable > 0 &&
+                        top_k_stable_for(&ranking) >= (unsigned long)app_opts.stable)
                     {
-                        json_t *content_obj = json_object_get(message, "content");
-                        content = json_string_value(content_obj);
+                        printf("Top %d unchanged for %d images, stopping\n", ranking.k, app_opts.stable);
+                        stop_requested = true;
+                        batch_cancel();
                     }
-                    printf("Finish reason: %s\n", finish_reason ? finish_reason : "N/A");
-                    printf("Assistant: %s\n", content ? content : "N/A");
-
-                    /* Batch search handling */
-                    if (batch_search_active) {
-                        /* Determine keep/remove based on first word */
-                        bool keep = true;
-                        if (content) {
-                            const char *p = content;
-                            while (*p && isspace((unsigned char)*p)) p++;
-                            if (strncasecmp(p, "yes", 3) == 0) {
-                                keep = true;
-                            } else if (strncasecmp(p, "no", 2) == 0) {
-                                keep = false;
-                            }
-                        }
-
-                        if (!keep && batch_search_index < (int)files.count) {
-                            /* Remove current file */
-                            free(files.paths[batch_search_index]);
-                            for (int j = batch_search_index; j < (int)files.count - 1; ++j) {
-                                files.paths[j] = files.paths[j + 1];
-                            }
-                            files.count--;
-                            if (selectedIndex == batch_search_index) {
-                                selectedIndex = -1;
-                                if (image.id != 0) { UnloadTexture(image); image.id = 0; }
-                            } else if (selectedIndex > batch_search_index) {
-                                selectedIndex--;
-                            }
-                        }
-
-                        /* Advance to next image */
-                        if (keep) {
-                            /* If we kept the file, move to the next index */
-                            batch_search_index++;
-                        }
-                        /* If we removed the file, batch_search_index already points to the next item
-                           because the list shifted left, so we do NOT increment. */
-
-                        while (batch_search_index < (int)files.count &&
-                               !has_image_extension(files.paths[batch_search_index])) {
-                            batch_search_index++;
-                        }
-
-                        if (stop_requested || batch_search_index >= (int)files.count) {
-                            batch_search_active = false;
-                        } else {
-                            /* Start next request */
-                            start_llm_task_for_file(files.paths[batch_search_index], searchPhrase);
-                        }
-                    }
-                }
-                else
-                {
-                    fprintf(stderr, "Unexpected JSON structure: missing choices array\n");
                 }
-                json_decref(root);
+                /* Batch search handling: drop the file wherever it sits now */
+                else if (batch_search_active && !result.keep)
+                    batch_remove_file(result.path);
             }
-            free(llm_response);
-            llm_response = NULL;
-            llm_response_ready = false;
+            llm_result_free(&result);
         }
-        pthread_mutex_unlock(&llm_mutex);
+        if (batch_search_active)
+            batch_dispatch();
+        /* Compact in bulk: once tombstones outnumber live rows, or when
+           the batch is over, so each removal costs O(1) amortized */
+        if (files.dead && (!batch_search_active || files.count - files.live > files.live))
+            files_compact();
 
     } // end while loop
 
     // De-Initialization
+    /* Abort what is on the wire before anything else, so the backends
+       get their slots back even if the rest of shutdown takes a while */
+    if (batch_search_active) batch_cancel();
+    stop_loaders();
+    dir_watch_stop(watch);
+    thumbs_shutdown();
+    rank_reset();
+    file_list_free(&batch_arrivals);
+    llm_pool_stop();
+    metrics_stop();
     if (image.id != 0) UnloadTexture(image);
-    if (filesLoaded) UnloadDirectoryFiles(files);
+    if (filesLoaded) file_list_free(&files);
     CloseWindow();
+    catalog_close();
+    verdict_cache_close();
+    curl_global_cleanup();
 
     return 0;
 }
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/* Samples per stage (and completions) the percentiles and rates cover */
+#define METRICS_WINDOW 1024
+
+static const char *STAGE_NAMES[METRIC_STAGES] = {
+    "queue", "read", "encode", "wait", "connect", "upload", "first_byte",
+    "request", "parse", "total"
+};
+
+typedef struct {
+    double samples[METRICS_WINDOW];
+    unsigned long count;        /* all time; the ring holds the last ones */
+    double sum_ms;
+} stage_ring;
+
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stage_ring stages[METRIC_STAGES];
+static double done_at[METRICS_WINDOW];          /* completion times, s */
+static size_t done_upload[METRICS_WINDOW];
+static double first_done = 0;
+static unsigned long results, errors, cached, yes, no;
+static unsigned long long file_bytes, upload_bytes;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+const char *metrics_stage_name(metric_stage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+/* Caller holds metrics_mutex */
+static void add_sample(metric_stage stage, double ms)
+{
+    stage_ring *ring = &stages[stage];
+    ring->samples[ring->count % METRICS_WINDOW] = ms;
+    ring->count++;
+    ring->sum_ms += ms;
+}
+
+void metrics_record(const llm_result *r)
+{
+    double now = now_seconds();
+    pthread_mutex_lock(&metrics_mutex);
+    if (first_done == 0) first_done = now;
+    done_at[results % METRICS_WINDOW] = now;
+    done_upload[results % METRICS_WINDOW] = r->upload_bytes;
+    results++;
+    if (!r->ok) errors++;
+    else if (r->keep) yes++;
+    else no++;
+    if (r->cached) cached++;
+    file_bytes += r->file_bytes;
+    upload_bytes += r->upload_bytes;
+
+    /* Stages a result never went through are left out, not counted as 0 */
+    add_sample(METRIC_QUEUE, r->queue_ms);
+    add_sample(METRIC_READ, r->read_ms);
+    add_sample(METRIC_TOTAL, r->total_ms);
+    if (!r->cached && r->upload_bytes)
+    {
+        add_sample(METRIC_ENCODE, r->encode_ms);
+        add_sample(METRIC_REQUEST, r->request_ms);
+        add_sample(METRIC_PARSE, r->parse_ms);
+    }
+    if (r->first_byte_ms > 0)
+    {
+        add_sample(METRIC_WAIT, r->wait_ms);
+        add_sample(METRIC_UPLOAD, r->upload_ms);
+        add_sample(METRIC_FIRST_BYTE, r->first_byte_ms);
+        if (r->connect_ms > 0) add_sample(METRIC_CONNECT, r->connect_ms);
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void metrics_summarize(metrics_summary *out)
+{
+    static double sorted[METRICS_WINDOW];
+    static pthread_mutex_t sort_mutex = PTHREAD_MUTEX_INITIALIZER;
+    memset(out, 0, sizeof(*out));
+    double now = now_seconds();
+
+    pthread_mutex_lock(&sort_mutex);
+    pthread_mutex_lock(&metrics_mutex);
+    out->elapsed_s = first_done ? now - first_done : 0;
+    out->results = results;
+    out->errors = errors;
+    out->cached = cached;
+    out->yes = yes;
+    out->no = no;
+    out->file_bytes = file_bytes;
+    out->upload_bytes = upload_bytes;
+
+    /* Rates over the window: from the oldest completion it holds to now */
+    unsigned long window = results < METRICS_WINDOW ? results : METRICS_WINDOW;
+    if (window > 0)
+    {
+        double oldest = done_at[(results - window) % METRICS_WINDOW];
+        unsigned long long bytes = 0;
+        for (unsigned long i = 0; i < window; ++i) bytes += done_upload[i];
+        double span = now - oldest;
+        if (span > 0) {
+            out->per_second = window / span;
+            out->upload_bytes_per_second = bytes / span;
+        }
+    }
+
+    for (int s = 0; s < METRIC_STAGES; ++s)
+    {
+        const stage_ring *ring = &stages[s];
+        int n = ring->count < METRICS_WINDOW ? (int)ring->count : METRICS_WINDOW;
+        out->stage_count[s] = ring->count;
+        out->stage_sum_ms[s] = ring->sum_ms;
+        out->p50[s] = out->p95[s] = out->p99[s] = -1;
+        if (n == 0) continue;
+        memcpy(sorted, ring->samples, n * sizeof(double));
+        pthread_mutex_unlock(&metrics_mutex);
+        qsort(sorted, n, sizeof(double), compare_double);
+        out->p50[s] = sorted[(int)(0.50 * (n - 1))];
+        out->p95[s] = sorted[(int)(0.95 * (n - 1))];
+        out->p99[s] = sorted[(int)(0.99 * (n - 1))];
+        pthread_mutex_lock(&metrics_mutex);
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+    pthread_mutex_unlock(&sort_mutex);
+}
+
+void metrics_report(FILE *fp)
+{
+    metrics_summary m;
+    metrics_summarize(&m);
+    fprintf(fp, "Metrics: %lu results, %lu errors, %lu cached, %.2f images/s, "
+            "%.1f KB/s uploaded (recent)\n",
+            m.results, m.errors, m.cached, m.per_second, m.upload_bytes_per_second / 1024);
+    for (int s = 0; s < METRIC_STAGES; ++s)
+        if (m.p50[s] >= 0)
+            fprintf(fp, "  %-10s p50 %8.1f ms  p95 %8.1f ms  p99 %8.1f ms  (%lu)\n",
+                    STAGE_NAMES[s], m.p50[s], m.p95[s], m.p99[s], m.stage_count[s]);
+}
+
+/* -------------------------------------------------
+   Export
+   ------------------------------------------------- */
+
+static char *export_path = NULL;
+static double export_interval_s = 10;
+static bool export_csv = false;
+static pthread_t export_thread;
+static bool export_running = false;
+static bool export_quit = false;
+static pthread_mutex_t export_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t export_cond = PTHREAD_COND_INITIALIZER;
+
+#define PROM_PREFIX "llm_image_search_"
+
+static void write_prometheus(FILE *fp, const metrics_summary *m)
+{
+    unsigned long hedges, hedge_wins, retries;
+    llm_pool_tail_stats(&hedges, &hedge_wins, &retries);
+
+    fputs("# HELP " PROM_PREFIX "results_total Images answered, by outcome.\n"
+          "# TYPE " PROM_PREFIX "results_total counter\n", fp);
+    fprintf(fp, PROM_PREFIX "results_total{outcome=\"yes\"} %lu\n", m->yes);
+    fprintf(fp, PROM_PREFIX "results_total{outcome=\"no\"} %lu\n", m->no);
+    fprintf(fp, PROM_PREFIX "results_total{outcome=\"error\"} %lu\n", m->errors);
+    fputs("# HELP " PROM_PREFIX "cached_total Images answered from the verdict cache.\n"
+          "# TYPE " PROM_PREFIX "cached_total counter\n", fp);
+    fprintf(fp, PROM_PREFIX "cached_total %lu\n", m->cached);
+    fputs("# HELP " PROM_PREFIX "bytes_total Image bytes read from disk and uploaded.\n"
+          "# TYPE " PROM_PREFIX "bytes_total counter\n", fp);
+    fprintf(fp, PROM_PREFIX "bytes_total{kind=\"file\"} %llu\n", m->file_bytes);
+    fprintf(fp, PROM_PREFIX "bytes_total{kind=\"upload\"} %llu\n", m->upload_bytes);
+    fputs("# HELP " PROM_PREFIX "hedges_total Duplicate requests sent for slow ones.\n"
+          "# TYPE " PROM_PREFIX "hedges_total counter\n", fp);
+    fprintf(fp, PROM_PREFIX "hedges_total %lu\n", hedges);
+    fputs("# HELP " PROM_PREFIX "hedge_wins_total Duplicates that answered first.\n"
+          "# TYPE " PROM_PREFIX "hedge_wins_total counter\n", fp);
+    fprintf(fp, PROM_PREFIX "hedge_wins_total %lu\n", hedge_wins);
+    fputs("# HELP " PROM_PREFIX "retries_total Failed requests sent again.\n"
+          "# TYPE " PROM_PREFIX "retries_total counter\n", fp);
+    fprintf(fp, PROM_PREFIX "retries_total %lu\n", retries);
+    fputs("# HELP " PROM_PREFIX "throughput Images per second over recent results.\n"
+          "# TYPE " PROM_PREFIX "throughput gauge\n", fp);
+    fprintf(fp, PROM_PREFIX "throughput %.3f\n", m->per_second);
+    fputs("# HELP " PROM_PREFIX "upload_bytes_per_second Upload rate over recent results.\n"
+          "# TYPE " PROM_PREFIX "upload_bytes_per_second gauge\n", fp);
+    fprintf(fp, PROM_PREFIX "upload_bytes_per_second %.0f\n", m->upload_bytes_per_second);
+
+    fputs("# HELP " PROM_PREFIX "stage_seconds Time per request stage, quantiles over recent samples.\n"
+          "# TYPE " PROM_PREFIX "stage_seconds summary\n", fp);
+    for (int s = 0; s < METRIC_STAGES; ++s)
+    {
+        const char *name = STAGE_NAMES[s];
+        if (m->p50[s] >= 0) {
+            fprintf(fp, PROM_PREFIX "stage_seconds{stage=\"%s\",quantile=\"0.5\"} %.6f\n", name, m->p50[s] / 1000);
+            fprintf(fp, PROM_PREFIX "stage_seconds{stage=\"%s\",quantile=\"0.95\"} %.6f\n", name, m->p95[s] / 1000);
+            fprintf(fp, PROM_PREFIX "stage_seconds{stage=\"%s\",quantile=\"0.99\"} %.6f\n", name, m->p99[s] / 1000);
+        }
+        fprintf(fp, PROM_PREFIX "stage_seconds_sum{stage=\"%s\"} %.6f\n", name, m->stage_sum_ms[s] / 1000);
+        fprintf(fp, PROM_PREFIX "stage_seconds_count{stage=\"%s\"} %lu\n", name, m->stage_count[s]);
+    }
+}
+
+static void write_csv_row(FILE *fp, const metrics_summary *m)
+{
+    fprintf(fp, "%ld,%lu,%lu,%lu,%lu,%lu,%llu,%llu,%.3f,%.0f",
+            (long)time(NULL), m->results, m->errors, m->cached, m->yes, m->no,
+            m->file_bytes, m->upload_bytes, m->per_second, m->upload_bytes_per_second);
+    for (int s = 0; s < METRIC_STAGES; ++s)
+        fprintf(fp, ",%.3f,%.3f,%.3f", m->p50[s], m->p95[s], m->p99[s]);
+    fputc('\n', fp);
+}
+
+static void write_csv_header(FILE *fp)
+{
+    fputs("time,results,errors,cached,yes,no,file_bytes,upload_bytes,per_second,"
+          "upload_bytes_per_second", fp);
+    for (int s = 0; s < METRIC_STAGES; ++s)
+        fprintf(fp, ",%s_p50_ms,%s_p95_ms,%s_p99_ms", STAGE_NAMES[s], STAGE_NAMES[s], STAGE_NAMES[s]);
+    fputc('\n', fp);
+}
+
+static void export_once(void)
+{
+    metrics_summary m;
+    metrics_summarize(&m);
+
+    if (export_csv)
+    {
+        struct stat st;
+        bool fresh = stat(export_path, &st) != 0 || st.st_size == 0;
+        FILE *fp = fopen(export_path, "a");
+        if (!fp) {
+            fprintf(stderr, "Cannot write metrics to %s\n", export_path);
+            return;
+        }
+        if (fresh) write_csv_header(fp);
+        write_csv_row(fp, &m);
+        fclose(fp);
+        return;
+    }
+
+    /* Scrapers must never see half a file: write aside, then rename */
+    char *tmp = NULL;
+    if (asprintf(&tmp, "%s.tmp", export_path) == -1) return;
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        fprintf(stderr, "Cannot write metrics to %s\n", tmp);
+        free(tmp);
+        return;
+    }
+    write_prometheus(fp, &m);
+    if (fclose(fp) != 0 || rename(tmp, export_path) != 0)
+        fprintf(stderr, "Cannot write metrics to %s\n", export_path);
+    free(tmp);
+}
+
+static void *export_main(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&export_mutex);
+    while (!export_quit)
+    {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        double whole = (double)(long)export_interval_s;
+        until.tv_sec += (time_t)whole;
+        until.tv_nsec += (long)((export_interval_s - whole) * 1e9);
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        while (!export_quit && pthread_cond_timedwait(&export_cond, &export_mutex, &until) == 0)
+            ;
+        pthread_mutex_unlock(&export_mutex);
+        export_once();
+        pthread_mutex_lock(&export_mutex);
+    }
+    pthread_mutex_unlock(&export_mutex);
+    return NULL;
+}
+
+bool metrics_start(const char *path, double interval_s)
+{
+    if (export_running || !path) return export_running;
+    export_path = strdup(path);
+    if (!export_path) return false;
+    size_t len = strlen(path);
+    export_csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+    export_interval_s = interval_s > 0 ? interval_s : 10;
+    export_quit = false;
+    if (pthread_create(&export_thread, NULL, export_main, NULL) != 0) {
+        fprintf(stderr, "Failed to start metrics writer\n");
+        free(export_path);
+        export_path = NULL;
+        return false;
+    }
+    export_running = true;
+    return true;
+}
+
+void metrics_stop(void)
+{
+    if (!export_running) return;
+    pthread_mutex_lock(&export_mutex);
+    export_quit = true;
+    pthread_cond_signal(&export_cond);
+    pthread_mutex_unlock(&export_mutex);
+    /* The thread writes once more on its way out */
+    pthread_join(export_thread, NULL);
+    export_running = false;
+    free(export_path);
+    export_path = NULL;
+}
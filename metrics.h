@@ -0,0 +1,65 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "llm.h"
+
+/* -------------------------------------------------
+   Request metrics
+   Every result from the worker pool is recorded: outcome, bytes and
+   the time spent in each stage. Summaries feed the GUI's stats overlay
+   and a file that monitoring scrapes, rewritten periodically in
+   Prometheus text format, or appended to as CSV.
+   ------------------------------------------------- */
+
+typedef enum {
+    METRIC_QUEUE,       /* waiting for a prep thread */
+    METRIC_READ,        /* open, map, hash, cache lookup */
+    METRIC_ENCODE,      /* downscale, re-encode */
+    METRIC_WAIT,        /* queued in the network engine */
+    METRIC_CONNECT,     /* new connections only */
+    METRIC_UPLOAD,
+    METRIC_FIRST_BYTE,  /* transfer start to first response byte */
+    METRIC_REQUEST,     /* engine hand-off to answer */
+    METRIC_PARSE,
+    METRIC_TOTAL,
+    METRIC_STAGES
+} metric_stage;
+
+typedef struct {
+    double elapsed_s;           /* since the first result */
+    unsigned long results;
+    unsigned long errors;
+    unsigned long cached;
+    unsigned long yes, no;
+    unsigned long long file_bytes;
+    unsigned long long upload_bytes;
+    /* over the most recent results */
+    double per_second;
+    double upload_bytes_per_second;
+    /* milliseconds over the most recent samples of each stage, -1 if none */
+    double p50[METRIC_STAGES];
+    double p95[METRIC_STAGES];
+    double p99[METRIC_STAGES];
+    /* all time */
+    unsigned long stage_count[METRIC_STAGES];
+    double stage_sum_ms[METRIC_STAGES];
+} metrics_summary;
+
+/* Thread-safe; called for every result the pool delivers */
+void metrics_record(const llm_result *r);
+void metrics_summarize(metrics_summary *out);
+/* "queue", "read", ... as used in the exported names */
+const char *metrics_stage_name(metric_stage stage);
+/* Totals, rates and one p50 / p95 / p99 line per stage */
+void metrics_report(FILE *fp);
+
+/* Rewrites `path` every `interval_s` seconds from a background thread:
+   Prometheus text format, or one CSV row per interval if the name ends
+   in ".csv". */
+bool metrics_start(const char *path, double interval_s);
+/* Writes a last time and stops the thread */
+void metrics_stop(void);
+
+#endif
@@ -0,0 +1,331 @@
+#define _GNU_SOURCE
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+static CURLM *multi = NULL;
+static pthread_mutex_t net_mutex = PTHREAD_MUTEX_INITIALIZER;
+static net_request *pending_head = NULL, *pending_tail = NULL;
+static net_request *active_head = NULL;     /* only touched by the driving thread */
+static int pending_count = 0;
+static int active_count = 0;
+static int max_active = 1;
+
+/* Recycled easy handles (only touched by the driving thread) */
+static CURL **free_handles = NULL;
+static int free_count = 0;
+
+static pthread_t io_thread;
+static bool has_io_thread = false;
+static volatile bool net_quit = false;
+
+double net_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static CURL *take_handle(void)
+{
+    if (free_count > 0) {
+        CURL *easy = free_handles[--free_count];
+        curl_easy_reset(easy);
+        return easy;
+    }
+    return curl_easy_init();
+}
+
+static void return_handle(CURL *easy)
+{
+    /* At most max_active handles are ever out at once */
+    if (free_count < max_active) free_handles[free_count++] = easy;
+    else curl_easy_cleanup(easy);
+}
+
+/* Caller holds net_mutex: unlinks the first request that may start
+   (cancelled ones first, so they finish without taking a slot) */
+static net_request *take_pending(double now)
+{
+    net_request *prev = NULL;
+    for (net_request *req = pending_head; req; prev = req, req = req->next)
+    {
+        if (!req->cancelled && (active_count >= max_active || req->not_before_ms > now))
+            continue;
+        if (prev) prev->next = req->next;
+        else pending_head = req->next;
+        if (pending_tail == req) pending_tail = prev;
+        req->next = NULL;
+        pending_count--;
+        return req;
+    }
+    return NULL;
+}
+
+static void start_pending(void)
+{
+    double now = net_now_ms();
+    for (;;)
+    {
+        pthread_mutex_lock(&net_mutex);
+        net_request *req = take_pending(now);
+        bool cancelled = req && req->cancelled;
+        if (req && !cancelled) active_count++;
+        pthread_mutex_unlock(&net_mutex);
+        if (!req) return;
+        if (cancelled) {
+            req->done(req, CURLE_ABORTED_BY_CALLBACK, 0);
+            continue;
+        }
+
+        CURL *easy = take_handle();
+        if (!easy) {
+            pthread_mutex_lock(&net_mutex);
+            active_count--;
+            pthread_mutex_unlock(&net_mutex);
+            req->done(req, CURLE_OUT_OF_MEMORY, 0);
+            continue;
+        }
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, req);
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        req->setup(req, easy);
+        req->easy = easy;
+        req->next = active_head;
+        active_head = req;
+        curl_multi_add_handle(multi, easy);
+    }
+}
+
+static void unlink_active(net_request *req)
+{
+    for (net_request **p = &active_head; *p; p = &(*p)->next)
+    {
+        if (*p == req) {
+            *p = req->next;
+            break;
+        }
+    }
+    req->next = NULL;
+}
+
+/* Detaches a finished or aborted transfer and reports it */
+void net_read_timings(CURL *easy, net_timings *t)
+{
+    curl_off_t us = 0;
+    curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &us);
+    t->connect_ms = us / 1000.0;
+    us = 0;
+    curl_easy_getinfo(easy, CURLINFO_PRETRANSFER_TIME_T, &us);
+    t->pretransfer_ms = us / 1000.0;
+    us = 0;
+    curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &us);
+    t->total_ms = us / 1000.0;
+}
+
+static void finish_request(net_request *req, CURLcode code)
+{
+    long status = 0;
+    curl_easy_getinfo(req->easy, CURLINFO_RESPONSE_CODE, &status);
+    net_read_timings(req->easy, &req->timings);
+    curl_multi_remove_handle(multi, req->easy);
+    return_handle(req->easy);
+    req->easy = NULL;
+    unlink_active(req);
+
+    pthread_mutex_lock(&net_mutex);
+    active_count--;
+    pthread_mutex_unlock(&net_mutex);
+    req->done(req, code, status);
+}
+
+static void reap_finished(void)
+{
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL)
+    {
+        if (msg->msg != CURLMSG_DONE) continue;
+        net_request *req = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&req);
+        if (req) finish_request(req, msg->data.result);
+    }
+}
+
+/* Aborts cancelled transfers and fires due timers; returns the
+   milliseconds until the next timer or delayed start, -1 if none */
+static double run_timers(void)
+{
+    double now = net_now_ms();
+    double next = -1;
+    for (net_request *req = active_head; req; )
+    {
+        net_request *following = req->next;
+        pthread_mutex_lock(&net_mutex);
+        bool cancelled = req->cancelled;
+        pthread_mutex_unlock(&net_mutex);
+        if (cancelled) {
+            finish_request(req, CURLE_ABORTED_BY_CALLBACK);
+        } else if (req->timer && req->wake_ms > 0) {
+            if (req->wake_ms <= now) {
+                req->wake_ms = 0;
+                req->timer(req);
+            }
+            if (req->wake_ms > 0 && (next < 0 || req->wake_ms - now < next))
+                next = req->wake_ms - now;
+        }
+        req = following;
+    }
+    pthread_mutex_lock(&net_mutex);
+    for (net_request *req = pending_head; req; req = req->next)
+        if (req->not_before_ms > now && (next < 0 || req->not_before_ms - now < next))
+            next = req->not_before_ms - now;
+    pthread_mutex_unlock(&net_mutex);
+    return next;
+}
+
+void net_step(int timeout_ms)
+{
+    int running = 0;
+    start_pending();
+    curl_multi_perform(multi, &running);
+    reap_finished();
+    double next = run_timers();
+    start_pending();
+    if (next >= 0 && next < timeout_ms) timeout_ms = (int)next + 1;
+    /* curl_multi_wakeup() from net_submit ends the wait early */
+    curl_multi_poll(multi, NULL, 0, timeout_ms, NULL);
+    curl_multi_perform(multi, &running);
+    reap_finished();
+}
+
+static void *io_thread_func(void *arg)
+{
+    (void)arg;
+    while (!net_quit)
+        net_step(1000);
+    return NULL;
+}
+
+bool net_start(int active, bool use_io_thread)
+{
+    if (multi) return true;
+    max_active = active < 1 ? 1 : active;
+    free_handles = calloc(max_active, sizeof(CURL *));
+    multi = curl_multi_init();
+    if (!multi || !free_handles) {
+        if (multi) curl_multi_cleanup(multi);
+        free(free_handles);
+        multi = NULL;
+        free_handles = NULL;
+        return false;
+    }
+    /* Keep one warm connection per slot; never open more than that */
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)max_active);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)max_active);
+
+    net_quit = false;
+    has_io_thread = false;
+    if (use_io_thread)
+    {
+        if (pthread_create(&io_thread, NULL, io_thread_func, NULL) != 0) {
+            fprintf(stderr, "Failed to start network thread\n");
+            net_stop();
+            return false;
+        }
+        has_io_thread = true;
+    }
+    return true;
+}
+
+void net_stop(void)
+{
+    if (!multi) return;
+
+    net_quit = true;
+    if (has_io_thread) {
+        curl_multi_wakeup(multi);
+        pthread_join(io_thread, NULL);
+        has_io_thread = false;
+    }
+
+    /* Abort transfers still running, then everything still queued */
+    while (active_head)
+        finish_request(active_head, CURLE_ABORTED_BY_CALLBACK);
+
+    pthread_mutex_lock(&net_mutex);
+    net_request *req = pending_head;
+    pending_head = pending_tail = NULL;
+    pending_count = 0;
+    pthread_mutex_unlock(&net_mutex);
+    while (req) {
+        net_request *next = req->next;
+        req->done(req, CURLE_ABORTED_BY_CALLBACK, 0);
+        req = next;
+    }
+
+    while (free_count > 0)
+        curl_easy_cleanup(free_handles[--free_count]);
+    free(free_handles);
+    free_handles = NULL;
+    curl_multi_cleanup(multi);
+    multi = NULL;
+}
+
+bool net_running(void)
+{
+    return multi != NULL && !net_quit;
+}
+
+static bool enqueue(net_request *req, bool first)
+{
+    if (!net_running()) return false;
+
+    req->easy = NULL;
+    req->next = NULL;
+    req->cancelled = false;
+    memset(&req->timings, 0, sizeof(req->timings));
+    pthread_mutex_lock(&net_mutex);
+    if (first) {
+        req->next = pending_head;
+        pending_head = req;
+        if (!pending_tail) pending_tail = req;
+    } else {
+        if (pending_tail) pending_tail->next = req;
+        else pending_head = req;
+        pending_tail = req;
+    }
+    pending_count++;
+    pthread_mutex_unlock(&net_mutex);
+    curl_multi_wakeup(multi);
+    return true;
+}
+
+bool net_submit(net_request *req)
+{
+    return enqueue(req, false);
+}
+
+bool net_submit_first(net_request *req)
+{
+    return enqueue(req, true);
+}
+
+void net_cancel(net_request *req)
+{
+    pthread_mutex_lock(&net_mutex);
+    req->cancelled = true;
+    pthread_mutex_unlock(&net_mutex);
+    if (multi) curl_multi_wakeup(multi);
+}
+
+int net_outstanding(void)
+{
+    pthread_mutex_lock(&net_mutex);
+    int n = pending_count + active_count;
+    pthread_mutex_unlock(&net_mutex);
+    return n;
+}
@@ -0,0 +1,74 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stdbool.h>
+#include <curl/curl.h>
+
+/* -------------------------------------------------
+   Non-blocking network engine on top of curl_multi.
+   One multi handle owns the connection and DNS caches, so requests to
+   the same backend reuse keep-alive connections; easy handles are
+   recycled instead of created per request.
+   ------------------------------------------------- */
+
+typedef struct net_request net_request;
+
+/* curl's phase timestamps for a finished transfer, in milliseconds
+   since it started; 0 for phases it never reached */
+typedef struct {
+    double connect_ms;      /* TCP (and TLS) up; 0 on a reused connection */
+    double pretransfer_ms;  /* about to send the request */
+    double total_ms;
+} net_timings;
+
+struct net_request {
+    /* Sets URL, body and callbacks on a freshly reset easy handle */
+    void (*setup)(net_request *req, CURL *easy);
+    /* Called once on the engine thread after the handle is detached;
+       may free the request. CURLE_ABORTED_BY_CALLBACK on shutdown. */
+    void (*done)(net_request *req, CURLcode code, long http_status);
+    /* Filled in before done() runs */
+    net_timings timings;
+    /* Optional: called on the engine thread once the running transfer
+       passes `wake_ms` (net_now_ms() clock); may set it again */
+    void (*timer)(net_request *req);
+    double wake_ms;
+    /* Not started before this time, e.g. a retry after a backoff */
+    double not_before_ms;
+
+    /* engine-private */
+    CURL *easy;
+    bool cancelled;
+    net_request *next;
+};
+
+/* `max_active` transfers run at once, the rest wait in a queue.
+   With `io_thread` the engine runs on its own thread, otherwise the
+   caller drives it with net_step() (e.g. once per frame). */
+bool net_start(int max_active, bool io_thread);
+/* Aborts everything still queued or running and frees the handles */
+void net_stop(void);
+bool net_running(void);
+
+/* Thread-safe; the request must stay valid until done() runs */
+bool net_submit(net_request *req);
+/* Same, but ahead of everything queued (e.g. a hedge for a slow request) */
+bool net_submit_first(net_request *req);
+/* Thread-safe: aborts a queued or running request; done() still runs,
+   with CURLE_ABORTED_BY_CALLBACK unless it already finished */
+void net_cancel(net_request *req);
+
+/* Monotonic clock in milliseconds */
+double net_now_ms(void);
+
+/* Reads the phase timestamps of a finished easy handle */
+void net_read_timings(CURL *easy, net_timings *t);
+
+/* Runs transfers and completions; waits up to timeout_ms for activity.
+   Only for engines started without an I/O thread. */
+void net_step(int timeout_ms);
+
+/* Number of queued + running requests */
+int net_outstanding(void);
+
+#endif
@@ -0,0 +1,113 @@
+#include "options.h"
+#include "backend.h"
+#include "cache.h"
+#include "image_prep.h"
+#include "llm.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+app_options app_opts = { 4, NULL, true, true, 0, 0, NULL, 10 };
+static bool jobs_given = false;     /* else the backends' capacity decides */
+
+option_result parse_common_option(int argc, char **argv, int *i)
+{
+    const char *arg = argv[*i];
+    bool has_value = *i + 1 < argc;
+
+    if ((strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) && has_value) {
+        app_opts.jobs = atoi(argv[++*i]);
+        jobs_given = true;
+    }
+    else if (strcmp(arg, "--backend") == 0 && has_value)
+        return backend_add(argv[++*i]) ? OPTION_TAKEN : OPTION_BAD_VALUE;
+    else if (strcmp(arg, "--backends") == 0 && has_value)
+        return backend_add_file(argv[++*i]) ? OPTION_TAKEN : OPTION_BAD_VALUE;
+    else if (strcmp(arg, "--cache") == 0 && has_value)
+        app_opts.cache_path = argv[++*i];
+    else if (strcmp(arg, "--no-cache") == 0)
+        app_opts.use_cache = false;
+    else if (strcmp(arg, "--no-catalog") == 0)
+        app_opts.use_catalog = false;
+    else if (strcmp(arg, "--top-k") == 0 && has_value)
+        app_opts.top_k = atoi(argv[++*i]);
+    else if (strcmp(arg, "--stable") == 0 && has_value)
+        app_opts.stable = atoi(argv[++*i]);
+    else if (strcmp(arg, "--fast-verdict") == 0)
+        llm_opts.fast_verdict = true;
+    else if (strcmp(arg, "--constrain") == 0 && has_value)
+    {
+        const char *mode = argv[++*i];
+        if (strcmp(mode, "grammar") == 0) llm_opts.constraint = LLM_CONSTRAIN_GRAMMAR;
+        else if (strcmp(mode, "choice") == 0) llm_opts.constraint = LLM_CONSTRAIN_CHOICE;
+        else if (strcmp(mode, "none") == 0) llm_opts.constraint = LLM_CONSTRAIN_NONE;
+        else {
+            fprintf(stderr, "Unknown --constrain mode: %s\n", mode);
+            return OPTION_BAD_VALUE;
+        }
+        llm_opts.fast_verdict = true;
+    }
+    else if (strcmp(arg, "--logit-bias") == 0 && has_value)
+    {
+        llm_opts.bias_tokens = argv[++*i];
+        llm_opts.fast_verdict = true;
+    }
+    else if (strcmp(arg, "--metrics") == 0 && has_value)
+        app_opts.metrics_path = argv[++*i];
+    else if (strcmp(arg, "--metrics-interval") == 0 && has_value)
+        app_opts.metrics_interval = atof(argv[++*i]);
+    else if (strcmp(arg, "--hedge") == 0 && has_value)
+        llm_opts.hedge_percentile = atoi(argv[++*i]);
+    else if (strcmp(arg, "--retries") == 0 && has_value)
+        llm_opts.retries = atoi(argv[++*i]);
+    else if (strcmp(arg, "--stream") == 0)
+        llm_opts.stream = true;
+    else if (strcmp(arg, "--max-edge") == 0 && has_value)
+        prep_opts.max_edge = atoi(argv[++*i]);
+    else if (strcmp(arg, "--jpeg-quality") == 0 && has_value)
+        prep_opts.jpeg_quality = atoi(argv[++*i]);
+    else
+        return OPTION_UNKNOWN;
+    return OPTION_TAKEN;
+}
+
+void print_common_usage(void)
+{
+    fprintf(stderr,
+            "  -j, --jobs N          requests kept in flight (default 4, or the\n"
+            "                        backends' total max)\n"
+            "  --backend SPEC        chat endpoint URL[,model=NAME][,weight=W][,max=N];\n"
+            "                        repeat for several, balanced by load\n"
+            "  --backends FILE       backend specs, one per line\n"
+            "  --cache FILE          verdict cache file\n"
+            "  --no-cache            always query the backend\n"
+            "  --no-catalog          rescan folders instead of using their catalog\n"
+            "  --top-k K             rank by score and keep the K best images\n"
+            "  --stable N            stop ranking once the top K held for N images\n"
+            "  --fast-verdict        one-token yes/no answers with a probability\n"
+            "  --constrain MODE      restrict them: grammar (llama.cpp) or choice (vLLM)\n"
+            "  --logit-bias IDS      or bias these comma-separated token ids (+100)\n"
+            "  --metrics FILE        export request metrics periodically: Prometheus\n"
+            "                        text format, or CSV rows if FILE ends in .csv\n"
+            "  --metrics-interval S  seconds between exports (default 10)\n"
+            "  --hedge PCT           duplicate requests slower than this percentile of\n"
+            "                        recent ones (default 95, 0 = off)\n"
+            "  --retries N           retry failed requests N times (default 2)\n"
+            "  --stream              stream replies and stop once the answer is known\n"
+            "  --max-edge PX         downscale before upload (default 1024, 0 = off)\n"
+            "  --jpeg-quality Q      JPEG quality for re-encoding (default 85)\n");
+}
+
+void apply_common_options(void)
+{
+    if (!jobs_given && backend_total_capacity() > 0) app_opts.jobs = backend_total_capacity();
+    if (app_opts.jobs < 1) app_opts.jobs = 1;
+    if (app_opts.top_k < 0) app_opts.top_k = 0;
+    if (app_opts.stable < 0) app_opts.stable = 0;
+    if (llm_opts.hedge_percentile < 0 || llm_opts.hedge_percentile >= 100) llm_opts.hedge_percentile = 0;
+    if (llm_opts.retries < 0) llm_opts.retries = 0;
+    if (prep_opts.jpeg_quality < 1 || prep_opts.jpeg_quality > 100) prep_opts.jpeg_quality = 85;
+    if (app_opts.use_cache) verdict_cache_open(app_opts.cache_path);
+    if (app_opts.metrics_path) metrics_start(app_opts.metrics_path, app_opts.metrics_interval);
+}
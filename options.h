@@ -0,0 +1,38 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+
+/* -------------------------------------------------
+   Command line options shared by the GUI and the headless CLI
+   ------------------------------------------------- */
+
+typedef struct {
+    int jobs;                   /* requests kept in flight */
+    const char *cache_path;     /* NULL = default location */
+    bool use_cache;
+    bool use_catalog;           /* remember folder listings between runs */
+    int top_k;                  /* ranked search: images to keep, 0 = off */
+    int stable;                 /* stop once the top-K held for this many images */
+    const char *metrics_path;   /* Prometheus text or .csv export, NULL = none */
+    double metrics_interval;    /* seconds between exports */
+} app_options;
+
+extern app_options app_opts;
+
+typedef enum {
+    OPTION_UNKNOWN,     /* not a shared option: print the usage */
+    OPTION_TAKEN,
+    OPTION_BAD_VALUE    /* a shared option whose value was reported on stderr */
+} option_result;
+
+/* Consumes argv[*i] (and its value) if it is a shared option */
+option_result parse_common_option(int argc, char **argv, int *i);
+
+/* Usage lines for the shared options */
+void print_common_usage(void);
+
+/* Clamps values, opens the verdict cache and starts the metrics export */
+void apply_common_options(void);
+
+#endif
@@ -0,0 +1,98 @@
+#define _GNU_SOURCE
+#include "rank.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* a ranks below b */
+static bool worse(const rank_entry *a, const rank_entry *b)
+{
+    return a->score < b->score || (a->score == b->score && a->seq > b->seq);
+}
+
+static void swap(rank_entry *a, rank_entry *b)
+{
+    rank_entry tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void sift_up(rank_entry *heap, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!worse(&heap[i], &heap[parent])) break;
+        swap(&heap[i], &heap[parent]);
+        i = parent;
+    }
+}
+
+static void sift_down(rank_entry *heap, int count, int i)
+{
+    for (;;)
+    {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < count && worse(&heap[l], &heap[min])) min = l;
+        if (r < count && worse(&heap[r], &heap[min])) min = r;
+        if (min == i) break;
+        swap(&heap[i], &heap[min]);
+        i = min;
+    }
+}
+
+bool top_k_init(top_k *t, int k)
+{
+    *t = (top_k){0};
+    if (k < 1) return false;
+    t->heap = calloc(k, sizeof(rank_entry));
+    if (!t->heap) return false;
+    t->k = k;
+    return true;
+}
+
+void top_k_free(top_k *t)
+{
+    for (int i = 0; i < t->count; ++i)
+        free(t->heap[i].path);
+    free(t->heap);
+    *t = (top_k){0};
+}
+
+bool top_k_offer(top_k *t, const char *path, float score)
+{
+    if (!t->heap) return false;
+    rank_entry e = { NULL, score, t->seen++ };
+    if (t->count == t->k && !worse(&t->heap[0], &e)) return false;
+    if (!(e.path = strdup(path))) return false;
+
+    if (t->count < t->k) {
+        t->heap[t->count] = e;
+        sift_up(t->heap, t->count++);
+    } else {
+        free(t->heap[0].path);
+        t->heap[0] = e;
+        sift_down(t->heap, t->count, 0);
+    }
+    t->last_change = t->seen;
+    return true;
+}
+
+unsigned long top_k_stable_for(const top_k *t)
+{
+    return t->count < t->k ? 0 : t->seen - t->last_change;
+}
+
+static int cmp_best_first(const void *a, const void *b)
+{
+    const rank_entry *x = a, *y = b;
+    if (worse(y, x)) return -1;
+    if (worse(x, y)) return 1;
+    return 0;
+}
+
+int top_k_sorted(const top_k *t, rank_entry *out)
+{
+    memcpy(out, t->heap, t->count * sizeof(rank_entry));
+    qsort(out, t->count, sizeof(rank_entry), cmp_best_first);
+    return t->count;
+}
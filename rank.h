@@ -0,0 +1,36 @@
+#ifndef RANK_H
+#define RANK_H
+
+#include <stdbool.h>
+
+/* -------------------------------------------------
+   Bounded top-K set for ranked searches
+   A min-heap on score keeps the K best images seen so far; each new
+   score costs O(log K) and the worst kept one is always at the root.
+   ------------------------------------------------- */
+
+typedef struct {
+    char *path;             /* owned by the set */
+    float score;            /* 0..1, higher is better */
+    unsigned long seq;      /* arrival order: ties keep the earlier one */
+} rank_entry;
+
+typedef struct {
+    int k;
+    int count;
+    rank_entry *heap;
+    unsigned long seen;         /* scores offered */
+    unsigned long last_change;  /* `seen` when the set last changed */
+} top_k;
+
+bool top_k_init(top_k *t, int k);
+void top_k_free(top_k *t);
+/* Returns true if the image entered the set */
+bool top_k_offer(top_k *t, const char *path, float score);
+/* Scores offered in a row without changing a full set */
+unsigned long top_k_stable_for(const top_k *t);
+/* Copies the entries into `out` (room for t->k), best first; the
+   paths stay owned by the set. Returns the count. */
+int top_k_sorted(const top_k *t, rank_entry *out);
+
+#endif
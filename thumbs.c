@@ -0,0 +1,364 @@
+#define _GNU_SOURCE
+#include "thumbs.h"
+#include "hash.h"
+#include "image_prep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* -------------------------------------------------
+   Entries are owned by the main thread (table, LRU list, textures).
+   Decoders only see entries through the job stack and only touch
+   `state` and `image`, under thumb_mutex. An entry that is queued,
+   decoding or waiting for upload is never evicted.
+   ------------------------------------------------- */
+
+/* A queued request older than this many frames is off screen: skip it */
+#define THUMB_STALE_FRAMES 2
+#define THUMB_BUCKETS 4096
+
+typedef enum {
+    THUMB_IDLE,         /* known, nothing in flight (e.g. request went stale) */
+    THUMB_QUEUED,
+    THUMB_DECODING,
+    THUMB_READY,        /* CPU image waiting for upload */
+    THUMB_RESIDENT,     /* texture on the GPU */
+    THUMB_FAILED
+} thumb_state;
+
+typedef struct thumb {
+    char *path;
+    uint64_t hash;
+    thumb_state state;
+    bool changed;               /* forgotten while in flight: discard the result */
+    Image image;
+    Texture2D texture;
+    unsigned long last_used;    /* frame number */
+    struct thumb *bucket_next;
+    struct thumb *lru_prev, *lru_next;  /* most recently used at the head */
+    struct thumb *queue_next;           /* job stack or ready queue */
+} thumb;
+
+static pthread_mutex_t thumb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thumb_cond = PTHREAD_COND_INITIALIZER;
+static thumb *buckets[THUMB_BUCKETS];
+static thumb *lru_head = NULL, *lru_tail = NULL;
+static thumb *job_stack = NULL;     /* LIFO: newest requests are on screen */
+static thumb *ready_head = NULL, *ready_tail = NULL;
+static unsigned long frame = 0;
+static int entry_count = 0;
+static int resident_count = 0;
+static int max_resident = 0;
+static int max_entries = 0;
+static pthread_t *decoders = NULL;
+static int decoder_count = 0;
+static bool shutting_down = false;
+
+/* -------------------------------------------------
+   Decoding (background threads)
+   ------------------------------------------------- */
+
+static Image decode_thumb(const char *path)
+{
+    Image result = {0};
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return result;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        close(fd);
+        return result;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return result;
+
+    /* JPEG decodes at a reduced DCT scale, so big photos stay cheap */
+    rgb_image decoded, small;
+    if (image_decode(data, size, THUMB_SIZE, &decoded))
+    {
+        if (image_resize(&decoded, THUMB_SIZE, &small)) {
+            rgb_image_free(&decoded);
+            decoded = small;
+        }
+        result = (Image){ decoded.pixels, decoded.width, decoded.height, 1,
+                          PIXELFORMAT_UNCOMPRESSED_R8G8B8 };
+    }
+    else
+    {
+        /* GIF / BMP / WebP: raylib's CPU-side loaders */
+        result = LoadImageFromMemory(GetFileExtension(path), data, (int)size);
+        if (result.data)
+        {
+            ImageFormat(&result, PIXELFORMAT_UNCOMPRESSED_R8G8B8);
+            int longest = result.width > result.height ? result.width : result.height;
+            if (longest > THUMB_SIZE) {
+                int w = (int)((long)result.width * THUMB_SIZE / longest);
+                int h = (int)((long)result.height * THUMB_SIZE / longest);
+                ImageResize(&result, w > 0 ? w : 1, h > 0 ? h : 1);
+            }
+        }
+    }
+    munmap(data, size);
+    return result;
+}
+
+static void *decoder_thread(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&thumb_mutex);
+    for (;;)
+    {
+        while (!job_stack && !shutting_down)
+            pthread_cond_wait(&thumb_cond, &thumb_mutex);
+        if (shutting_down) break;
+
+        thumb *t = job_stack;
+        job_stack = t->queue_next;
+        t->queue_next = NULL;
+        if (t->last_used + THUMB_STALE_FRAMES < frame) {
+            /* Scrolled past; decode again if it comes back */
+            t->state = THUMB_IDLE;
+            continue;
+        }
+        t->state = THUMB_DECODING;
+        pthread_mutex_unlock(&thumb_mutex);
+
+        Image img = decode_thumb(t->path);
+
+        pthread_mutex_lock(&thumb_mutex);
+        if (!img.data) {
+            /* Forgotten mid-decode (still being written?): try the new bytes */
+            t->state = t->changed ? THUMB_IDLE : THUMB_FAILED;
+            t->changed = false;
+            continue;
+        }
+        t->image = img;
+        t->state = THUMB_READY;
+        if (ready_tail) ready_tail->queue_next = t;
+        else ready_head = t;
+        ready_tail = t;
+    }
+    pthread_mutex_unlock(&thumb_mutex);
+    return NULL;
+}
+
+/* -------------------------------------------------
+   Table and LRU (main thread)
+   ------------------------------------------------- */
+
+static void lru_unlink(thumb *t)
+{
+    if (t->lru_prev) t->lru_prev->lru_next = t->lru_next;
+    else lru_head = t->lru_next;
+    if (t->lru_next) t->lru_next->lru_prev = t->lru_prev;
+    else lru_tail = t->lru_prev;
+    t->lru_prev = t->lru_next = NULL;
+}
+
+static void lru_push_front(thumb *t)
+{
+    t->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = t;
+    lru_head = t;
+    if (!lru_tail) lru_tail = t;
+}
+
+/* Caller holds thumb_mutex; the entry must not be in flight */
+static void entry_free(thumb *t)
+{
+    thumb **link = &buckets[t->hash & (THUMB_BUCKETS - 1)];
+    while (*link != t) link = &(*link)->bucket_next;
+    *link = t->bucket_next;
+    lru_unlink(t);
+
+    if (t->state == THUMB_RESIDENT) {
+        UnloadTexture(t->texture);
+        resident_count--;
+    }
+    entry_count--;
+    free(t->path);
+    free(t);
+}
+
+static bool in_flight(const thumb *t)
+{
+    return t->state == THUMB_QUEUED || t->state == THUMB_DECODING || t->state == THUMB_READY;
+}
+
+/* Evicts the least recently used entry not shown this frame; with
+   `resident_only` only one holding a texture. Caller holds thumb_mutex. */
+static bool evict_one(bool resident_only)
+{
+    for (thumb *t = lru_tail; t; t = t->lru_prev)
+    {
+        if (t->last_used >= frame) return false;   /* everything older is on screen */
+        if (in_flight(t)) continue;
+        if (resident_only && t->state != THUMB_RESIDENT) continue;
+        entry_free(t);
+        return true;
+    }
+    return false;
+}
+
+static thumb *lookup(const char *path, uint64_t hash)
+{
+    for (thumb *t = buckets[hash & (THUMB_BUCKETS - 1)]; t; t = t->bucket_next)
+        if (t->hash == hash && strcmp(t->path, path) == 0) return t;
+    return NULL;
+}
+
+bool thumbs_init(int threads, int max_textures)
+{
+    if (decoders) return true;
+    if (threads <= 0) {
+        /* Leave cores for the render loop and the upload prep threads */
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 2 ? (int)cpus / 2 : 1;
+        if (threads > 4) threads = 4;
+    }
+    max_resident = max_textures > 0 ? max_textures : 1024;
+    max_entries = max_resident * 2;
+
+    decoders = calloc(threads, sizeof(pthread_t));
+    if (!decoders) return false;
+    shutting_down = false;
+    for (int i = 0; i < threads; ++i)
+    {
+        if (pthread_create(&decoders[i], NULL, decoder_thread, NULL) != 0) break;
+        decoder_count++;
+    }
+    return decoder_count > 0;
+}
+
+void thumbs_shutdown(void)
+{
+    if (!decoders) return;
+    pthread_mutex_lock(&thumb_mutex);
+    shutting_down = true;
+    pthread_cond_broadcast(&thumb_cond);
+    pthread_mutex_unlock(&thumb_mutex);
+    for (int i = 0; i < decoder_count; ++i)
+        pthread_join(decoders[i], NULL);
+    free(decoders);
+    decoders = NULL;
+    decoder_count = 0;
+
+    /* Threads are gone: everything can go, whatever its state */
+    job_stack = ready_head = ready_tail = NULL;
+    while (lru_head)
+    {
+        thumb *t = lru_head;
+        if (t->state == THUMB_READY) UnloadImage(t->image);
+        t->state = t->state == THUMB_RESIDENT ? THUMB_RESIDENT : THUMB_IDLE;
+        entry_free(t);
+    }
+}
+
+void thumbs_begin_frame(void)
+{
+    pthread_mutex_lock(&thumb_mutex);
+    frame++;
+    pthread_mutex_unlock(&thumb_mutex);
+}
+
+Texture2D thumbs_get(const char *path)
+{
+    Texture2D texture = {0};
+    if (!decoders) return texture;
+    uint64_t hash = hash64(path, strlen(path), 0);
+
+    pthread_mutex_lock(&thumb_mutex);
+    thumb *t = lookup(path, hash);
+    if (!t)
+    {
+        if (entry_count >= max_entries) evict_one(false);
+        t = calloc(1, sizeof(*t));
+        if (!t || !(t->path = strdup(path))) {
+            free(t);
+            pthread_mutex_unlock(&thumb_mutex);
+            return texture;
+        }
+        t->hash = hash;
+        t->bucket_next = buckets[hash & (THUMB_BUCKETS - 1)];
+        buckets[hash & (THUMB_BUCKETS - 1)] = t;
+        lru_push_front(t);
+        entry_count++;
+    }
+    else if (t != lru_head)
+    {
+        lru_unlink(t);
+        lru_push_front(t);
+    }
+    t->last_used = frame;
+
+    if (t->state == THUMB_IDLE) {
+        t->state = THUMB_QUEUED;
+        t->queue_next = job_stack;
+        job_stack = t;
+        pthread_cond_signal(&thumb_cond);
+    } else if (t->state == THUMB_RESIDENT) {
+        texture = t->texture;
+    }
+    pthread_mutex_unlock(&thumb_mutex);
+    return texture;
+}
+
+void thumbs_upload(double budget_ms)
+{
+    double start = GetTime();
+    pthread_mutex_lock(&thumb_mutex);
+    while (ready_head)
+    {
+        /* Make room first; if everything resident is on screen, wait */
+        if (resident_count >= max_resident && !evict_one(true)) break;
+
+        thumb *t = ready_head;
+        ready_head = t->queue_next;
+        if (!ready_head) ready_tail = NULL;
+        t->queue_next = NULL;
+
+        if (t->changed) {
+            UnloadImage(t->image);
+            t->image = (Image){0};
+            t->changed = false;
+            t->state = THUMB_IDLE;
+            continue;
+        }
+
+        /* Nobody else touches a READY entry: upload without the lock */
+        pthread_mutex_unlock(&thumb_mutex);
+        Texture2D tex = LoadTextureFromImage(t->image);
+        if (tex.id != 0) SetTextureFilter(tex, TEXTURE_FILTER_BILINEAR);
+        UnloadImage(t->image);
+        pthread_mutex_lock(&thumb_mutex);
+
+        t->image = (Image){0};
+        t->texture = tex;
+        t->state = tex.id != 0 ? THUMB_RESIDENT : THUMB_FAILED;
+        if (tex.id != 0) resident_count++;
+        if ((GetTime() - start) * 1000.0 >= budget_ms) break;
+    }
+    pthread_mutex_unlock(&thumb_mutex);
+}
+
+void thumbs_forget(const char *path)
+{
+    if (!decoders) return;
+    pthread_mutex_lock(&thumb_mutex);
+    thumb *t = lookup(path, hash64(path, strlen(path), 0));
+    if (t)
+    {
+        if (t->state == THUMB_DECODING || t->state == THUMB_READY)
+            t->changed = true;  /* old bytes: drop the result on upload */
+        else if (t->state != THUMB_QUEUED)
+            entry_free(t);      /* queued ones have not read the file yet */
+    }
+    pthread_mutex_unlock(&thumb_mutex);
+}
@@ -0,0 +1,35 @@
+#ifndef THUMBS_H
+#define THUMBS_H
+
+#include <stdbool.h>
+#include "raylib.h"
+
+/* -------------------------------------------------
+   Thumbnail cache for the grid view.
+   Background threads decode and downscale images to CPU buffers; the
+   main loop uploads them to textures under a per-frame time budget.
+   Textures live in a bounded LRU, so VRAM and RAM stay flat however
+   far the grid is scrolled.
+   ------------------------------------------------- */
+
+/* Longest side of a thumbnail in pixels */
+#define THUMB_SIZE 128
+
+/* `threads` <= 0 picks a default; `max_textures` bounds VRAM use.
+   Needs the window (GL context) to exist. */
+bool thumbs_init(int threads, int max_textures);
+/* Joins the decoders and unloads every texture (before CloseWindow) */
+void thumbs_shutdown(void);
+
+/* Call once per frame before any thumbs_get */
+void thumbs_begin_frame(void);
+/* Texture for `path` if it is resident, else id 0 and a decode is queued.
+   Requests not repeated within a couple of frames are dropped, so only
+   what is on screen gets decoded. */
+Texture2D thumbs_get(const char *path);
+/* Uploads decoded thumbnails until `budget_ms` has been spent */
+void thumbs_upload(double budget_ms);
+/* The file changed or went away: drop its cached thumbnail */
+void thumbs_forget(const char *path);
+
+#endif
@@ -0,0 +1,327 @@
+#define _GNU_SOURCE
+#include "watch.h"
+#include "files.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+/* Files are reported once written (not on create), so half-copied
+   images never reach the list; directories are picked up on create. */
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | \
+                    IN_DELETE | IN_EXCL_UNLINK | IN_ONLYDIR)
+
+struct dir_watch {
+    int fd;                 /* inotify instance */
+    int wake[2];            /* pipe: tells the thread to exit */
+    bool recursive;
+    char *root;
+    char **dirs;            /* watched directory per watch descriptor */
+    int dirs_cap;
+    bool limit_warned;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;  /* guards the event queue */
+    watch_event *queue;
+    int queue_count;
+    int queue_cap;
+};
+
+static char *join_path(const char *dir, const char *name)
+{
+    char *full = NULL;
+    if (asprintf(&full, "%s/%s", dir, name) == -1) return NULL;
+    return full;
+}
+
+/* Takes ownership of `path` */
+static void push_event(dir_watch *w, watch_event_kind kind, char *path)
+{
+    pthread_mutex_lock(&w->mutex);
+    if (w->queue_count == w->queue_cap)
+    {
+        int new_cap = w->queue_cap ? w->queue_cap * 2 : 256;
+        watch_event *q = realloc(w->queue, new_cap * sizeof(*q));
+        if (!q) {
+            pthread_mutex_unlock(&w->mutex);
+            free(path);
+            return;
+        }
+        w->queue = q;
+        w->queue_cap = new_cap;
+    }
+    w->queue[w->queue_count++] = (watch_event){ kind, path };
+    pthread_mutex_unlock(&w->mutex);
+}
+
+static void remember_dir(dir_watch *w, int wd, const char *path)
+{
+    if (wd >= w->dirs_cap)
+    {
+        int new_cap = w->dirs_cap ? w->dirs_cap : 256;
+        while (new_cap <= wd) new_cap *= 2;
+        char **dirs = realloc(w->dirs, new_cap * sizeof(char *));
+        if (!dirs) return;
+        memset(dirs + w->dirs_cap, 0, (new_cap - w->dirs_cap) * sizeof(char *));
+        w->dirs = dirs;
+        w->dirs_cap = new_cap;
+    }
+    free(w->dirs[wd]);
+    w->dirs[wd] = strdup(path);
+}
+
+/* Watches `dir` and, when recursive, everything below it. With
+   `report_files` the images already inside are queued as added: they
+   appeared after the initial scan (a folder created or moved in). */
+static void watch_tree(dir_watch *w, const char *dir, bool report_files)
+{
+    char **stack = NULL;
+    int depth = 0, cap = 0;
+    char *first = strdup(dir);
+    if (!first) return;
+
+    char *current = first;
+    while (current)
+    {
+        int wd = inotify_add_watch(w->fd, current, WATCH_MASK);
+        if (wd == -1) {
+            if (errno == ENOSPC && !w->limit_warned) {
+                fprintf(stderr, "Watch limit reached at %s; raise fs.inotify.max_user_watches\n",
+                        current);
+                w->limit_warned = true;
+            }
+        } else {
+            remember_dir(w, wd, current);
+        }
+
+        DIR *d = (wd != -1 && (w->recursive || report_files)) ? opendir(current) : NULL;
+        struct dirent *entry;
+        while (d && (entry = readdir(d)) != NULL)
+        {
+            const char *name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK)
+            {
+                struct stat st;
+                if (fstatat(dirfd(d), name, &st, 0) == -1) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR && w->recursive)
+            {
+                char *sub = join_path(current, name);
+                if (!sub) continue;
+                if (depth == cap) {
+                    cap = cap ? cap * 2 : 32;
+                    char **grown = realloc(stack, cap * sizeof(char *));
+                    if (!grown) { free(sub); continue; }
+                    stack = grown;
+                }
+                stack[depth++] = sub;
+            }
+            else if (type == DT_REG && report_files && has_image_extension(name))
+            {
+                char *full = join_path(current, name);
+                if (full) push_event(w, WATCH_ADDED, full);
+            }
+        }
+        if (d) closedir(d);
+
+        free(current);
+        current = depth ? stack[--depth] : NULL;
+    }
+    free(stack);
+}
+
+/* A directory left the tree: drop its watches and everything below */
+static void unwatch_tree(dir_watch *w, const char *dir)
+{
+    size_t len = strlen(dir);
+    for (int wd = 0; wd < w->dirs_cap; ++wd)
+    {
+        const char *path = w->dirs[wd];
+        if (!path || strncmp(path, dir, len) != 0 || (path[len] != '\0' && path[len] != '/'))
+            continue;
+        inotify_rm_watch(w->fd, wd);
+        free(w->dirs[wd]);
+        w->dirs[wd] = NULL;
+    }
+}
+
+static void handle_event(dir_watch *w, const struct inotify_event *ev)
+{
+    if (ev->mask & IN_Q_OVERFLOW) {
+        push_event(w, WATCH_OVERFLOW, NULL);
+        return;
+    }
+    if (ev->wd < 0 || ev->wd >= w->dirs_cap || !w->dirs[ev->wd]) return;
+    if (ev->mask & IN_IGNORED) {
+        /* Watched directory itself is gone */
+        free(w->dirs[ev->wd]);
+        w->dirs[ev->wd] = NULL;
+        return;
+    }
+    if (ev->len == 0) return;
+
+    char *path = join_path(w->dirs[ev->wd], ev->name);
+    if (!path) return;
+
+    if (ev->mask & IN_ISDIR)
+    {
+        if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            unwatch_tree(w, path);
+            push_event(w, WATCH_REMOVED_TREE, path);
+            return;
+        }
+        if (w->recursive && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+            watch_tree(w, path, true);
+        free(path);
+        return;
+    }
+
+    if (!has_image_extension(ev->name)) {
+        free(path);
+        return;
+    }
+    if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        push_event(w, WATCH_ADDED, path);
+    else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+        push_event(w, WATCH_REMOVED, path);
+    else
+        free(path); /* IN_CREATE of a file: wait for IN_CLOSE_WRITE */
+}
+
+static void *watch_thread(void *arg)
+{
+    dir_watch *w = arg;
+    watch_tree(w, w->root, false);
+
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2] = {
+        { .fd = w->fd, .events = POLLIN },
+        { .fd = w->wake[0], .events = POLLIN },
+    };
+    for (;;)
+    {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+
+        ssize_t len = read(w->fd, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len == -1 && (errno == EAGAIN || errno == EINTR)) continue;
+            break;
+        }
+        for (char *p = buf; p < buf + len; )
+        {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            handle_event(w, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return NULL;
+}
+
+dir_watch *dir_watch_start(const char *root, bool recursive)
+{
+    dir_watch *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    w->wake[0] = w->wake[1] = -1;
+    w->recursive = recursive;
+    w->root = strdup(root);
+    if (w->fd == -1 || !w->root || pipe2(w->wake, O_CLOEXEC) == -1)
+    {
+        fprintf(stderr, "Failed to start watching %s\n", root);
+        if (w->fd != -1) close(w->fd);
+        free(w->root);
+        free(w);
+        return NULL;
+    }
+
+    /* Strip trailing slashes so event paths match the loaded list */
+    size_t len = strlen(w->root);
+    while (len > 1 && w->root[len - 1] == '/') w->root[--len] = '\0';
+
+    pthread_mutex_init(&w->mutex, NULL);
+    if (pthread_create(&w->thread, NULL, watch_thread, w) != 0)
+    {
+        fprintf(stderr, "Failed to start watch thread\n");
+        pthread_mutex_destroy(&w->mutex);
+        close(w->wake[0]);
+        close(w->wake[1]);
+        close(w->fd);
+        free(w->root);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int dir_watch_poll(dir_watch *w, watch_event *events, int max)
+{
+    pthread_mutex_lock(&w->mutex);
+    int n = w->queue_count < max ? w->queue_count : max;
+    memcpy(events, w->queue, n * sizeof(*events));
+    memmove(w->queue, w->queue + n, (w->queue_count - n) * sizeof(*events));
+    w->queue_count -= n;
+    pthread_mutex_unlock(&w->mutex);
+    return n;
+}
+
+void dir_watch_stop(dir_watch *w)
+{
+    if (!w) return;
+    ssize_t rc = write(w->wake[1], "x", 1);
+    (void)rc;
+    pthread_join(w->thread, NULL);
+
+    for (int i = 0; i < w->queue_count; ++i)
+        free(w->queue[i].path);
+    free(w->queue);
+    for (int wd = 0; wd < w->dirs_cap; ++wd)
+        free(w->dirs[wd]);
+    free(w->dirs);
+    pthread_mutex_destroy(&w->mutex);
+    close(w->wake[0]);
+    close(w->wake[1]);
+    close(w->fd);   /* drops every watch */
+    free(w->root);
+    free(w);
+}
+
+#else /* !__linux__ */
+
+dir_watch *dir_watch_start(const char *root, bool recursive)
+{
+    (void)recursive;
+    fprintf(stderr, "Watching %s is not supported on this platform\n", root);
+    return NULL;
+}
+
+int dir_watch_poll(dir_watch *w, watch_event *events, int max)
+{
+    (void)w; (void)events; (void)max;
+    return 0;
+}
+
+void dir_watch_stop(dir_watch *w)
+{
+    (void)w;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+
+/* -------------------------------------------------
+   Live directory watching (inotify on Linux).
+   A background thread registers the loaded tree and turns filesystem
+   events into add / remove records the main thread applies to its
+   sorted file list; no rescans.
+   ------------------------------------------------- */
+
+typedef enum {
+    WATCH_ADDED,            /* image file finished writing or moved in */
+    WATCH_REMOVED,          /* image file deleted or moved away */
+    WATCH_REMOVED_TREE,     /* directory deleted or moved away: drop `path`/... */
+    WATCH_OVERFLOW          /* events were lost; reload to resync */
+} watch_event_kind;
+
+typedef struct {
+    watch_event_kind kind;
+    char *path;             /* malloc'd, NULL for WATCH_OVERFLOW */
+} watch_event;
+
+typedef struct dir_watch dir_watch;
+
+/* Watches `root` (and every sub-folder when recursive). Returns NULL
+   if watching is unavailable on this platform or fails to start. */
+dir_watch *dir_watch_start(const char *root, bool recursive);
+/* Non-blocking: moves up to `max` queued events into `events` */
+int dir_watch_poll(dir_watch *w, watch_event *events, int max);
+/* Stops the thread, drops queued events and closes the watches */
+void dir_watch_stop(dir_watch *w);
+
+#endif